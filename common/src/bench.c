@@ -0,0 +1,292 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "options.h"
+
+#define BENCH_DEFAULT_WARMUP 2
+#define BENCH_DEFAULT_REPETITIONS 7
+#define BENCH_DEFAULT_SECONDS 0.02
+#define BENCH_DEFAULT_TOLERANCE 0.15
+
+// Bounds of the integer options: the synthetic images have 16-bit sizes, and more runs than this is a typo
+#define BENCH_MIN_SIZE 16
+#define BENCH_MAX_SIZE UINT16_MAX
+#define BENCH_MAX_RUNS 10000
+
+// Cap on the operations per repetition, whatever the calibration finds
+#define BENCH_MAX_ITERATIONS (UINT64_C(1) << 40)
+
+static void printBenchUsage(const char *const program) {
+    fprintf(stderr, "Usage: %s [-W width] [-H height] [-w warmup] [-r repetitions] [-m seconds] [-f filter] "
+                    "[-o results.json|-] [-b baseline.json] [-t tolerance]\n"
+                    "Times every stage on a synthetic width x height image: the operations of one repetition are "
+                    "doubled until it takes 'seconds' (default %.2f), 'warmup' (default %d) repetitions are "
+                    "discarded and the median of 'repetitions' (default %d) is reported. -f runs the benchmarks "
+                    "whose name contains 'filter', -o writes the results as JSON and -b compares the fastest "
+                    "repetitions with a stored run, failing when a stage is more than 'tolerance' (default %.2f) "
+                    "slower.\n",
+            program, BENCH_DEFAULT_SECONDS, BENCH_DEFAULT_WARMUP, BENCH_DEFAULT_REPETITIONS, BENCH_DEFAULT_TOLERANCE);
+}
+
+BenchArgs parseBenchArgs(int const argc, char *argv[], uint32_t const defaultWidth, uint32_t const defaultHeight) {
+    BenchArgs args = {
+            .config={.warmupRuns=BENCH_DEFAULT_WARMUP, .repetitions=BENCH_DEFAULT_REPETITIONS,
+                     .minRepetitionSeconds=BENCH_DEFAULT_SECONDS, .filter=NULL},
+            .width=defaultWidth, .height=defaultHeight, .outputFile=NULL, .baselineFile=NULL,
+            .tolerance=BENCH_DEFAULT_TOLERANCE};
+    int option;
+    int valid = 1;
+    while ((option = getopt(argc, argv, "W:H:w:r:m:f:o:b:t:")) != -1) {
+        switch (option) {
+            case 'W':
+                valid &= parseUint32Option(optarg, BENCH_MIN_SIZE, BENCH_MAX_SIZE, &args.width) == 0;
+                break;
+            case 'H':
+                valid &= parseUint32Option(optarg, BENCH_MIN_SIZE, BENCH_MAX_SIZE, &args.height) == 0;
+                break;
+            case 'w':
+                valid &= parseUint32Option(optarg, 0, BENCH_MAX_RUNS, &args.config.warmupRuns) == 0;
+                break;
+            case 'r':
+                valid &= parseUint32Option(optarg, 1, BENCH_MAX_RUNS, &args.config.repetitions) == 0;
+                break;
+            case 'm':
+                args.config.minRepetitionSeconds = atof(optarg);
+                break;
+            case 'f':
+                args.config.filter = optarg;
+                break;
+            case 'o':
+                args.outputFile = optarg;
+                break;
+            case 'b':
+                args.baselineFile = optarg;
+                break;
+            case 't':
+                args.tolerance = atof(optarg);
+                break;
+            default:
+                printBenchUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!valid || optind != argc || args.config.minRepetitionSeconds <= 0.0 || args.tolerance < 0.0) {
+        printBenchUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return args;
+}
+
+void initBenchSuite(BenchSuite *const suite, const BenchConfig *const config) {
+    suite->config = *config;
+    suite->resultCount = 0;
+    suite->capacity = 16;
+    suite->results = (BenchResult *) malloc(sizeof(BenchResult) * suite->capacity);
+    if (suite->results == NULL) {
+        perror("initBenchSuite::malloc()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeBenchSuite(BenchSuite *const suite) {
+    free(suite->results);
+    suite->results = NULL;
+    suite->resultCount = suite->capacity = 0;
+}
+
+static double secondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static double timeRun(BenchBody const body, void *const context, uint64_t const iterations) {
+    double const start = secondsNow();
+    body(context, iterations);
+    return secondsNow() - start;
+}
+
+static int compareDoubles(const void *const a, const void *const b) {
+    double const x = *(const double *) a;
+    double const y = *(const double *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+void runBenchmark(BenchSuite *const suite, const char *const name, uint64_t const itemsPerIteration,
+                  BenchBody const body, void *const context) {
+    const BenchConfig *const config = &suite->config;
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return;
+    }
+
+    // The calibration runs double as the first warm-up
+    uint64_t iterations = 1;
+    while (timeRun(body, context, iterations) < config->minRepetitionSeconds && iterations < BENCH_MAX_ITERATIONS) {
+        iterations *= 2;
+    }
+    for (uint32_t i = 0; i < config->warmupRuns; ++i) {
+        timeRun(body, context, iterations);
+    }
+    double *const times = (double *) malloc(sizeof(double) * config->repetitions);
+    if (times == NULL) {
+        perror("runBenchmark::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < config->repetitions; ++i) {
+        times[i] = timeRun(body, context, iterations) * 1e9 / (double) iterations;
+    }
+    qsort(times, config->repetitions, sizeof(double), compareDoubles);
+
+    if (suite->resultCount == suite->capacity) {
+        suite->capacity *= 2;
+        suite->results = (BenchResult *) realloc(suite->results, sizeof(BenchResult) * suite->capacity);
+        if (suite->results == NULL) {
+            perror("runBenchmark::realloc()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    BenchResult *const result = &suite->results[suite->resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->iterations = iterations;
+    result->medianNs = times[config->repetitions / 2];
+    result->minNs = times[0];
+    result->maxNs = times[config->repetitions - 1];
+    result->itemsPerIteration = itemsPerIteration;
+    free(times);
+
+    fprintf(stderr, "%-28s %14.1f ns %12.1f Mitems/s  (min %.1f, max %.1f, %llu ops per repetition)\n",
+            result->name, result->medianNs, (double) itemsPerIteration * 1e3 / result->medianNs, result->minNs,
+            result->maxNs, (unsigned long long) iterations);
+}
+
+void writeBenchJson(const BenchSuite *const suite, const char *const suiteName, const BenchArgs *const args,
+                    FILE *const fptr) {
+    fprintf(fptr, "{\n\"suite\": \"%s\",\n\"width\": %u,\n\"height\": %u,\n\"warmup\": %u,\n\"repetitions\": %u,\n"
+                  "\"results\": [\n", suiteName, args->width, args->height, suite->config.warmupRuns,
+            suite->config.repetitions);
+    for (uint32_t i = 0; i < suite->resultCount; ++i) {
+        const BenchResult *const result = &suite->results[i];
+        fprintf(fptr, "{\"name\": \"%s\", \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, "
+                      "\"iterations\": %llu, \"items\": %llu}%s\n", result->name, result->medianNs, result->minNs,
+                result->maxNs, (unsigned long long) result->iterations,
+                (unsigned long long) result->itemsPerIteration, i + 1 < suite->resultCount ? "," : "");
+    }
+    fprintf(fptr, "]\n}\n");
+}
+
+// Fastest repetition of the named benchmark in a baseline, or a negative value when it has none
+static double findBaselineMin(FILE *const fptr, const char *const name) {
+    char line[512];
+    rewind(fptr);
+    while (fgets(line, sizeof(line), fptr) != NULL) {
+        char lineName[64];
+        double median, min;
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"median_ns\": %lf, \"min_ns\": %lf", lineName, &median,
+                   &min) == 3 && strcmp(lineName, name) == 0) {
+            return min;
+        }
+    }
+    return -1.0;
+}
+
+// Ratios are only meaningful against a baseline of the same suite on the same image size, anything
+// else is refused
+static void checkBaselineHeader(FILE *const fptr, const char *const baselineFile, const char *const suiteName,
+                                const BenchArgs *const args) {
+    char line[512];
+    char suite[64] = "";
+    uint32_t width = 0, height = 0;
+    int fields = 0;
+    rewind(fptr);
+    while (fields < 3 && fgets(line, sizeof(line), fptr) != NULL) {
+        if (sscanf(line, " \"suite\": \"%63[^\"]\"", suite) == 1 || sscanf(line, " \"width\": %u", &width) == 1 ||
+            sscanf(line, " \"height\": %u", &height) == 1) {
+            ++fields;
+        }
+    }
+    if (fields < 3) {
+        fprintf(stderr, "compareBenchBaseline(): %s: no suite, width and height in the baseline!\n", baselineFile);
+        exit(EXIT_FAILURE);
+    }
+    if (strcmp(suite, suiteName) != 0 || width != args->width || height != args->height) {
+        fprintf(stderr, "compareBenchBaseline(): %s: baseline is suite %s at %ux%u, this run is suite %s at %ux%u!\n",
+                baselineFile, suite, width, height, suiteName, args->width, args->height);
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint32_t compareBenchBaseline(const BenchSuite *const suite, const char *const suiteName, const BenchArgs *const args) {
+    const char *const baselineFile = args->baselineFile;
+    FILE *const fptr = fopen(baselineFile, "r");
+    if (fptr == NULL) {
+        perror("compareBenchBaseline::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    checkBaselineHeader(fptr, baselineFile, suiteName, args);
+    double const tolerance = args->tolerance;
+    uint32_t regressions = 0;
+    fprintf(stdout, "%-28s %12s %12s %8s\n", "benchmark", "baseline min", "current min", "ratio");
+    for (uint32_t i = 0; i < suite->resultCount; ++i) {
+        const BenchResult *const result = &suite->results[i];
+        double const baseline = findBaselineMin(fptr, result->name);
+        if (baseline <= 0.0) {
+            fprintf(stdout, "%-28s %12s %12.1f %8s  new\n", result->name, "-", result->minNs, "-");
+            continue;
+        }
+        double const ratio = result->minNs / baseline;
+        int const regressed = ratio > 1.0 + tolerance;
+        regressions += regressed;
+        fprintf(stdout, "%-28s %12.1f %12.1f %7.2fx%s\n", result->name, baseline, result->minNs, ratio,
+                regressed ? "  REGRESSED" : "");
+    }
+    fclose(fptr);
+    return regressions;
+}
+
+int finishBenchSuite(const BenchSuite *const suite, const char *const suiteName, const BenchArgs *const args) {
+    if (args->outputFile != NULL) {
+        int const toStdout = strcmp(args->outputFile, "-") == 0;
+        FILE *const fptr = toStdout ? stdout : fopen(args->outputFile, "w");
+        if (fptr == NULL) {
+            perror("finishBenchSuite::fopen()");
+            exit(EXIT_FAILURE);
+        }
+        writeBenchJson(suite, suiteName, args, fptr);
+        if (!toStdout) {
+            fclose(fptr);
+        }
+    }
+    if (args->baselineFile != NULL) {
+        uint32_t const regressions = compareBenchBaseline(suite, suiteName, args);
+        if (regressions > 0) {
+            fprintf(stdout, "%u of %u benchmarks regressed by more than %.0f%%\n", regressions, suite->resultCount,
+                    args->tolerance * 100.0);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+void fillSyntheticImage(uint8_t *const pixels, size_t const stride, uint32_t const width, uint32_t const height,
+                        uint32_t const channels, uint32_t const seed) {
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t *const row = pixels + (size_t) y * stride;
+        for (uint32_t x = 0; x < width; ++x) {
+            // xorshift32 noise on top of a diagonal gradient, a set of bands and a checkerboard of tiles
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            uint32_t const base = (x + y) * 160 / (width + height) + ((x / 37 + y / 53) & 1) * 48 +
+                                  (((x >> 6) ^ (y >> 6)) & 1) * 24;
+            for (uint32_t c = 0; c < channels; ++c) {
+                uint32_t const value = base + c * 13 + ((state >> (8 * c)) & 15);
+                row[(size_t) x * channels + c] = (uint8_t) (value > 255 ? 255 : value);
+            }
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef COMMON_BENCH_H
+#define COMMON_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Runs "iterations" operations of the benchmarked stage. Results have to end up somewhere the
+// compiler cannot prove unused, usually the context.
+typedef void (*BenchBody)(void *context, uint64_t iterations);
+
+typedef struct {
+    // Untimed repetitions before measuring
+    uint32_t warmupRuns;
+    // Timed repetitions, the reported time is their median
+    uint32_t repetitions;
+    // The operations per repetition are doubled until one repetition takes at least this long
+    double minRepetitionSeconds;
+    // Only benchmarks whose name contains it run, NULL runs every one
+    const char *filter;
+} BenchConfig;
+
+typedef struct {
+    char name[64];
+    uint64_t iterations;
+    // Per operation
+    double medianNs, minNs, maxNs;
+    // Items (pixels, blocks, samples, ...) one operation processes, for the throughput
+    uint64_t itemsPerIteration;
+} BenchResult;
+
+typedef struct {
+    BenchConfig config;
+    BenchResult *results;
+    uint32_t resultCount, capacity;
+} BenchSuite;
+
+// Command line of a benchmark program:
+//   -W width -H height   synthetic image size (defaults given by the caller)
+//   -w warmup -r reps -m seconds   BenchConfig
+//   -f filter            run matching benchmarks only
+//   -o file              write the results as JSON ("-" is stdout)
+//   -b baseline -t tol   compare with a JSON baseline, failing when the fastest repetition is more
+//                        than tol (default 0.15) slower
+typedef struct {
+    BenchConfig config;
+    uint32_t width, height;
+    const char *outputFile;
+    const char *baselineFile;
+    double tolerance;
+} BenchArgs;
+
+// Parses the options above. Prints a usage message naming the program and exits on bad input; sizes
+// must be in [16, 65535] and warmup and repetition counts at most 10000.
+BenchArgs parseBenchArgs(int argc, char *argv[], uint32_t defaultWidth, uint32_t defaultHeight);
+
+void initBenchSuite(BenchSuite *suite, const BenchConfig *config);
+
+void freeBenchSuite(BenchSuite *suite);
+
+// Calibrates, warms up and times one benchmark, prints a line for it to stderr and keeps the
+// result. Does nothing when the name does not match the filter.
+void runBenchmark(BenchSuite *suite, const char *name, uint64_t itemsPerIteration, BenchBody body, void *context);
+
+// One result object per line, so baselines can be read back line by line.
+void writeBenchJson(const BenchSuite *suite, const char *suiteName, const BenchArgs *args, FILE *fptr);
+
+// Compares every result with the benchmark of the same name in args->baselineFile, written by
+// writeBenchJson(), and prints the ratios. Compares the fastest repetitions: on a shared machine the
+// median of a few repetitions still moves by tens of percent, the minimum much less. Exits with a
+// message when the baseline was recorded for another suite or image size. Returns the number of
+// benchmarks more than args->tolerance slower.
+uint32_t compareBenchBaseline(const BenchSuite *suite, const char *suiteName, const BenchArgs *args);
+
+// Writes the JSON output and compares with the baseline as args ask. Returns the exit status.
+int finishBenchSuite(const BenchSuite *suite, const char *suiteName, const BenchArgs *args);
+
+// Deterministic test image: smooth gradients and edges with some noise, so transforms, searches and
+// histograms see something like a photograph rather than white noise.
+void fillSyntheticImage(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height, uint32_t channels,
+                        uint32_t seed);
+
+#endif
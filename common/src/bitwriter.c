@@ -0,0 +1,53 @@
+#include "bitwriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BIT_WRITER_INITIAL_CAPACITY (1 << 16)
+
+void initBitWriter(BitWriter *const writer, int const stuffBytes) {
+    writer->accumulator = 0;
+    writer->bitCount = 0;
+    writer->stuffBytes = stuffBytes;
+    writer->size = 0;
+    writer->capacity = BIT_WRITER_INITIAL_CAPACITY;
+    writer->data = (uint8_t *) malloc(writer->capacity);
+    if (writer->data == NULL) {
+        perror("initBitWriter::malloc()");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeBitWriter(BitWriter *const writer) {
+    free(writer->data);
+    writer->data = NULL;
+    writer->size = writer->capacity = 0;
+}
+
+void flushBitWriterBytes(BitWriter *const writer) {
+    // At most 8 data bytes plus as many stuffed zeros
+    if (writer->size + 16 > writer->capacity) {
+        writer->capacity *= 2;
+        writer->data = (uint8_t *) realloc(writer->data, writer->capacity);
+        if (writer->data == NULL) {
+            perror("flushBitWriterBytes::realloc()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (writer->bitCount >= 8) {
+        writer->bitCount -= 8;
+        uint8_t const byte = (uint8_t) (writer->accumulator >> writer->bitCount);
+        writer->data[writer->size++] = byte;
+        if (byte == 0xFF && writer->stuffBytes) {
+            writer->data[writer->size++] = 0x00;
+        }
+    }
+    // Drop the flushed bits so later shifts never bring them back into view
+    writer->accumulator &= (UINT64_C(1) << writer->bitCount) - 1;
+}
+
+void alignBitWriter(BitWriter *const writer, int const padWithOnes) {
+    uint32_t const padding = (8 - writer->bitCount % 8) % 8;
+    putBits(writer, padWithOnes ? (1u << padding) - 1 : 0, padding);
+    flushBitWriterBytes(writer);
+}
@@ -0,0 +1,46 @@
+#ifndef COMMON_BITWRITER_H
+#define COMMON_BITWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MSB-first bit packer into a growable byte buffer. Bits collect in a 64-bit accumulator and are
+// only moved to the buffer a few bytes at a time, so putBits() is a shift and an or in the common
+// case.
+typedef struct {
+    uint64_t accumulator;
+    // Number of pending bits, held in the low bits of the accumulator
+    uint32_t bitCount;
+    // JPEG entropy-coded data: follow every 0xFF byte with a 0x00
+    int stuffBytes;
+
+    uint8_t *data;
+    size_t size, capacity;
+} BitWriter;
+
+void initBitWriter(BitWriter *writer, int stuffBytes);
+
+void freeBitWriter(BitWriter *writer);
+
+// Moves every complete byte from the accumulator to the buffer, leaving fewer than 8 pending bits.
+void flushBitWriterBytes(BitWriter *writer);
+
+// Appends the low "length" bits of "bits", most significant first. length must not exceed 32 and
+// bits must not have anything set above them.
+static inline void putBits(BitWriter *const writer, uint32_t const bits, uint32_t const length) {
+    if (writer->bitCount + length > 64) {
+        flushBitWriterBytes(writer);
+    }
+    writer->accumulator = (writer->accumulator << length) | bits;
+    writer->bitCount += length;
+}
+
+// Pads the last byte with ones (padWithOnes) or zeros and flushes it.
+void alignBitWriter(BitWriter *writer, int padWithOnes);
+
+// Forgets the bytes already in the buffer (after the caller wrote them out), keeps pending bits.
+static inline void clearBitWriterBuffer(BitWriter *const writer) {
+    writer->size = 0;
+}
+
+#endif
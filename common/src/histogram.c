@@ -0,0 +1,158 @@
+#include "histogram.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Interleaved sub-histograms per channel
+#define SUB_HISTOGRAMS 4
+
+// Samples counted in the 32-bit sub-histograms before they are moved to 64-bit totals, well
+// below the point where a counter could overflow
+#define FLUSH_SAMPLES (1u << 30)
+
+// Images with fewer samples are counted on the calling thread, and workers get row ranges of at
+// least PARALLEL_GRAIN_SAMPLES, so merging never costs more than the counting it spreads
+#define PARALLEL_MIN_SAMPLES (1u << 18)
+#define PARALLEL_GRAIN_SAMPLES (1u << 16)
+
+// Occurrences of every value per channel
+typedef uint64_t ValueCounts[HISTOGRAM_MAX_CHANNELS][256];
+
+typedef uint32_t SubHistograms[SUB_HISTOGRAMS][HISTOGRAM_MAX_CHANNELS][256];
+
+void initHistogram(Histogram *const histogram, uint32_t const binCount, uint32_t const channels) {
+    if (binCount < 1 || binCount > HISTOGRAM_MAX_BINS) {
+        fprintf(stderr, "initHistogram(): %u bins, expected 1 to %d!\n", binCount, HISTOGRAM_MAX_BINS);
+        exit(EXIT_FAILURE);
+    }
+    if (channels < 1 || channels > HISTOGRAM_MAX_CHANNELS) {
+        fprintf(stderr, "initHistogram(): %u channels, expected 1 to %d!\n", channels, HISTOGRAM_MAX_CHANNELS);
+        exit(EXIT_FAILURE);
+    }
+    memset(histogram, 0, sizeof(Histogram));
+    histogram->binCount = binCount;
+    histogram->channels = channels;
+}
+
+static void flushSubHistograms(SubHistograms sub, uint32_t const channels, ValueCounts values) {
+    for (uint32_t s = 0; s < SUB_HISTOGRAMS; ++s) {
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (uint32_t v = 0; v < 256; ++v) {
+                values[c][v] += sub[s][c][v];
+            }
+        }
+    }
+    memset(sub, 0, sizeof(SubHistograms));
+}
+
+// Counts rows [rowBegin, rowEnd) into values. Consecutive pixels go to different sub-histograms.
+static void countRows(const uint8_t *const pixels, size_t const stride, uint32_t const width,
+                      uint32_t const channels, uint32_t const rowBegin, uint32_t const rowEnd, ValueCounts values) {
+    SubHistograms sub;
+    memset(sub, 0, sizeof(SubHistograms));
+    uint64_t const rowSamples = (uint64_t) width * channels;
+    uint32_t const flushRows = rowSamples >= FLUSH_SAMPLES ? 1 : (uint32_t) (FLUSH_SAMPLES / rowSamples);
+    uint32_t const quadWidth = width & ~3u;
+
+    for (uint32_t r = rowBegin; r < rowEnd; ++r) {
+        const uint8_t *const row = pixels + (size_t) r * stride;
+        if (channels == 1) {
+            for (uint32_t j = 0; j < quadWidth; j += 4) {
+                ++sub[0][0][row[j]];
+                ++sub[1][0][row[j + 1]];
+                ++sub[2][0][row[j + 2]];
+                ++sub[3][0][row[j + 3]];
+            }
+            for (uint32_t j = quadWidth; j < width; ++j) {
+                ++sub[j & 3][0][row[j]];
+            }
+        } else {
+            for (uint32_t j = 0; j < width; ++j) {
+                const uint8_t *const sample = row + (size_t) j * channels;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    ++sub[j & 3][c][sample[c]];
+                }
+            }
+        }
+        if ((r - rowBegin + 1) % flushRows == 0) {
+            flushSubHistograms(sub, channels, values);
+        }
+    }
+    flushSubHistograms(sub, channels, values);
+}
+
+typedef struct {
+    const uint8_t *pixels;
+    size_t stride;
+    uint32_t width;
+    uint32_t channels;
+    ValueCounts *workerValues;
+} HistogramContext;
+
+static void countRowRange(void *const context, uint32_t const workerIndex, uint32_t const begin, uint32_t const end) {
+    const HistogramContext *const ctx = (const HistogramContext *) context;
+    countRows(ctx->pixels, ctx->stride, ctx->width, ctx->channels, begin, end, ctx->workerValues[workerIndex]);
+}
+
+void addHistogramSamples(Histogram *const histogram, const uint8_t *const pixels, size_t const stride,
+                         uint32_t const width, uint32_t const height, ThreadPool *const pool) {
+    uint32_t const channels = histogram->channels;
+    uint64_t const rowSamples = (uint64_t) width * channels;
+    if (rowSamples == 0 || height == 0) {
+        return;
+    }
+
+    int const parallel = pool != NULL && rowSamples * height >= PARALLEL_MIN_SAMPLES;
+    uint32_t const workerCount = parallel ? threadPoolSize(pool) : 1;
+    ValueCounts *const workerValues = (ValueCounts *) calloc(workerCount, sizeof(ValueCounts));
+    if (workerValues == NULL) {
+        perror("addHistogramSamples::calloc()");
+        exit(EXIT_FAILURE);
+    }
+    if (workerCount == 1) {
+        countRows(pixels, stride, width, channels, 0, height, workerValues[0]);
+    } else {
+        HistogramContext context = {.pixels=pixels, .stride=stride, .width=width, .channels=channels,
+                                    .workerValues=workerValues};
+        uint32_t const grainRows =
+                rowSamples >= PARALLEL_GRAIN_SAMPLES ? 1 : (uint32_t) (PARALLEL_GRAIN_SAMPLES / rowSamples);
+        threadPoolParallelFor(pool, height, grainRows, countRowRange, &context);
+    }
+
+    // Merging the workers is a sum of integers, so the order they ran in does not matter
+    uint32_t const binCount = histogram->binCount;
+    for (uint32_t w = 0; w < workerCount; ++w) {
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (uint32_t v = 0; v < 256; ++v) {
+                histogram->counts[c][v * binCount / 256] += workerValues[w][c][v];
+            }
+        }
+    }
+    histogram->sampleCount += (uint64_t) width * height;
+    free(workerValues);
+}
+
+void addHistogramImage(Histogram *const histogram, const NetpbmImage *const image, ThreadPool *const pool) {
+    if (image->channels != histogram->channels) {
+        fprintf(stderr, "addHistogramImage(): image has %u channels, the histogram %u!\n", image->channels,
+                histogram->channels);
+        exit(EXIT_FAILURE);
+    }
+    addHistogramSamples(histogram, image->pixels, image->stride, image->width, image->height, pool);
+}
+
+double histogramEntropy(const Histogram *const histogram, uint32_t const channel) {
+    if (histogram->sampleCount == 0) {
+        return 0.0;
+    }
+    double entropy = 0.0;
+    for (uint32_t i = 0; i < histogram->binCount; ++i) {
+        if (histogram->counts[channel][i] > 0) {
+            double const p = (double) histogram->counts[channel][i] / (double) histogram->sampleCount;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
@@ -0,0 +1,41 @@
+#ifndef COMMON_HISTOGRAM_H
+#define COMMON_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "netpbm.h"
+#include "threadpool.h"
+
+#define HISTOGRAM_MAX_BINS 256
+#define HISTOGRAM_MAX_CHANNELS 3
+
+// Sample counts of 8-bit images, one histogram per channel. Value v falls into bin
+// v * binCount / 256, so 256 bins count every value separately and 16 bins group values by their
+// high nibble. Counts only ever grow, so one histogram can collect any number of images.
+typedef struct {
+    uint32_t binCount;
+    uint32_t channels;
+    // Samples added per channel
+    uint64_t sampleCount;
+    uint64_t counts[HISTOGRAM_MAX_CHANNELS][HISTOGRAM_MAX_BINS];
+} Histogram;
+
+// Empty histogram. Exits with a message when binCount is not within 1..256 or channels not within 1..3.
+void initHistogram(Histogram *histogram, uint32_t binCount, uint32_t channels);
+
+// Adds height rows of width pixels with histogram->channels interleaved samples each, row r
+// starting at pixels + r * stride. Every value is first counted in four interleaved sub-histograms,
+// so runs of equal values do not wait on their own counter updates, and the sub-histograms are
+// merged and grouped into bins at the end. Large images are split into row ranges counted on the
+// workers of pool (which may be NULL), the result does not depend on the worker count.
+void addHistogramSamples(Histogram *histogram, const uint8_t *pixels, size_t stride, uint32_t width, uint32_t height,
+                         ThreadPool *pool);
+
+// addHistogramSamples() for a whole image, which has to have as many channels as the histogram.
+void addHistogramImage(Histogram *histogram, const NetpbmImage *image, ThreadPool *pool);
+
+// Shannon entropy of one channel in bits per sample, 0 for an empty histogram.
+double histogramEntropy(const Histogram *histogram, uint32_t channel);
+
+#endif
@@ -0,0 +1,282 @@
+#include "huffman.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Heap builder nodes: the used symbols first, then the internal nodes in the order they are created
+typedef struct {
+    uint64_t weight[2 * HUFFMAN_MAX_SYMBOLS];
+    uint32_t parent[2 * HUFFMAN_MAX_SYMBOLS];
+    uint32_t heap[2 * HUFFMAN_MAX_SYMBOLS];
+    uint32_t heapSize;
+} HuffmanTree;
+
+// Equal weights go to the older node, which keeps the code independent of the heap layout
+static int isLighter(const HuffmanTree *const tree, uint32_t const a, uint32_t const b) {
+    return tree->weight[a] < tree->weight[b] || (tree->weight[a] == tree->weight[b] && a < b);
+}
+
+static void pushNode(HuffmanTree *const tree, uint32_t const node) {
+    uint32_t i = tree->heapSize++;
+    while (i > 0 && isLighter(tree, node, tree->heap[(i - 1) / 2])) {
+        tree->heap[i] = tree->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    tree->heap[i] = node;
+}
+
+static uint32_t popNode(HuffmanTree *const tree) {
+    uint32_t const top = tree->heap[0];
+    uint32_t const last = tree->heap[--tree->heapSize];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= tree->heapSize) {
+            break;
+        }
+        if (child + 1 < tree->heapSize && isLighter(tree, tree->heap[child + 1], tree->heap[child])) {
+            ++child;
+        }
+        if (!isLighter(tree, tree->heap[child], last)) {
+            break;
+        }
+        tree->heap[i] = tree->heap[child];
+        i = child;
+    }
+    tree->heap[i] = last;
+    return top;
+}
+
+// Unlimited Huffman lengths of the usedCount symbols in used[] (at least two). Returns the longest.
+static uint32_t heapCodeLengths(const uint64_t *const counts, const uint32_t *const used, uint32_t const usedCount,
+                                uint8_t *const lengths) {
+    HuffmanTree tree;
+    tree.heapSize = 0;
+    for (uint32_t i = 0; i < usedCount; ++i) {
+        tree.weight[i] = counts[used[i]];
+        pushNode(&tree, i);
+    }
+    uint32_t next = usedCount;
+    while (tree.heapSize > 1) {
+        uint32_t const a = popNode(&tree);
+        uint32_t const b = popNode(&tree);
+        tree.weight[next] = tree.weight[a] + tree.weight[b];
+        tree.parent[a] = tree.parent[b] = next;
+        pushNode(&tree, next++);
+    }
+
+    // Parents are always created after their children, so depths fill in from the root down
+    uint32_t depth[2 * HUFFMAN_MAX_SYMBOLS];
+    uint32_t const root = next - 1;
+    depth[root] = 0;
+    uint32_t maxLength = 0;
+    for (uint32_t node = root; node-- > 0;) {
+        depth[node] = depth[tree.parent[node]] + 1;
+        if (node < usedCount) {
+            lengths[used[node]] = (uint8_t) (depth[node] < 255 ? depth[node] : 255);
+            maxLength = depth[node] > maxLength ? depth[node] : maxLength;
+        }
+    }
+    return maxLength;
+}
+
+// Package-merge list entry: a symbol, or a package of two consecutive entries of the next deeper list
+typedef struct {
+    uint64_t weight;
+    int32_t symbol;
+    uint32_t child;
+} MergeItem;
+
+typedef struct {
+    MergeItem items[HUFFMAN_MAX_LENGTH][2 * HUFFMAN_MAX_SYMBOLS];
+    uint32_t sizes[HUFFMAN_MAX_LENGTH];
+} MergeLists;
+
+static void countLeaves(const MergeLists *const lists, uint32_t const level, uint32_t const index,
+                        uint8_t *const lengths) {
+    const MergeItem *const item = &lists->items[level][index];
+    if (item->symbol >= 0) {
+        ++lengths[item->symbol];
+    } else {
+        countLeaves(lists, level + 1, item->child, lengths);
+        countLeaves(lists, level + 1, item->child + 1, lengths);
+    }
+}
+
+// Optimal lengths of at most maxLength bits. List 0 is the shallowest: every symbol is a coin of
+// every level, and the cheapest 2 * (usedCount - 1) entries of list 0 count one bit for every
+// symbol they contain.
+static void packageMergeLengths(const uint64_t *const counts, const uint32_t *const used, uint32_t const usedCount,
+                                uint32_t const maxLength, uint8_t *const lengths) {
+    // Symbols by weight, stable in symbol order
+    uint32_t sorted[HUFFMAN_MAX_SYMBOLS];
+    for (uint32_t i = 0; i < usedCount; ++i) {
+        uint32_t j = i;
+        while (j > 0 && counts[sorted[j - 1]] > counts[used[i]]) {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = used[i];
+    }
+
+    MergeLists *const lists = (MergeLists *) malloc(sizeof(MergeLists));
+    if (lists == NULL) {
+        perror("packageMergeLengths::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t level = maxLength; level-- > 0;) {
+        MergeItem *const list = lists->items[level];
+        uint32_t const packageCount = level + 1 < maxLength ? lists->sizes[level + 1] / 2 : 0;
+        uint32_t size = 0;
+        uint32_t leaf = 0, package = 0;
+        while (leaf < usedCount || package < packageCount) {
+            uint64_t packageWeight = 0;
+            if (package < packageCount) {
+                const MergeItem *const deeper = lists->items[level + 1];
+                packageWeight = deeper[2 * package].weight + deeper[2 * package + 1].weight;
+            }
+            if (leaf < usedCount && (package == packageCount || counts[sorted[leaf]] <= packageWeight)) {
+                list[size++] = (MergeItem) {.weight=counts[sorted[leaf]], .symbol=(int32_t) sorted[leaf], .child=0};
+                ++leaf;
+            } else {
+                list[size++] = (MergeItem) {.weight=packageWeight, .symbol=-1, .child=2 * package};
+                ++package;
+            }
+        }
+        lists->sizes[level] = size;
+    }
+
+    for (uint32_t i = 0; i < 2 * (usedCount - 1); ++i) {
+        countLeaves(lists, 0, i, lengths);
+    }
+    free(lists);
+}
+
+void buildHuffmanCode(HuffmanCode *const code, const uint64_t *const counts, uint32_t const symbolCount,
+                      uint32_t const maxLength) {
+    if (symbolCount > HUFFMAN_MAX_SYMBOLS || maxLength < 1 || maxLength > HUFFMAN_MAX_LENGTH) {
+        fprintf(stderr, "buildHuffmanCode(): %u symbols with codes of up to %u bits, expected at most %d symbols "
+                        "and 1 to %d bits!\n", symbolCount, maxLength, HUFFMAN_MAX_SYMBOLS, HUFFMAN_MAX_LENGTH);
+        exit(EXIT_FAILURE);
+    }
+    memset(code, 0, sizeof(HuffmanCode));
+    code->symbolCount = symbolCount;
+
+    uint32_t used[HUFFMAN_MAX_SYMBOLS];
+    uint32_t usedCount = 0;
+    for (uint32_t s = 0; s < symbolCount; ++s) {
+        if (counts[s] > 0) {
+            used[usedCount++] = s;
+        }
+    }
+    if (maxLength < 32 && usedCount > (1u << maxLength)) {
+        fprintf(stderr, "buildHuffmanCode(): %u symbols do not fit into codes of %u bits!\n", usedCount, maxLength);
+        exit(EXIT_FAILURE);
+    }
+    if (usedCount == 0) {
+        return;
+    }
+    if (usedCount == 1) {
+        code->lengths[used[0]] = 1;
+    } else if (heapCodeLengths(counts, used, usedCount, code->lengths) > maxLength) {
+        memset(code->lengths, 0, sizeof(code->lengths));
+        packageMergeLengths(counts, used, usedCount, maxLength, code->lengths);
+    }
+
+    uint32_t next = 0;
+    for (uint32_t length = 1; length <= HUFFMAN_MAX_LENGTH; ++length) {
+        for (uint32_t s = 0; s < symbolCount; ++s) {
+            if (code->lengths[s] == length) {
+                code->codes[s] = next++;
+                code->maxLength = length;
+            }
+        }
+        next <<= 1;
+    }
+}
+
+double huffmanBitsPerSymbol(const HuffmanCode *const code, const uint64_t *const counts) {
+    uint64_t total = 0, bits = 0;
+    for (uint32_t s = 0; s < code->symbolCount; ++s) {
+        total += counts[s];
+        bits += counts[s] * code->lengths[s];
+    }
+    return total > 0 ? (double) bits / (double) total : 0.0;
+}
+
+void encodeHuffmanSymbols(BitWriter *const writer, const HuffmanCode *const code, const uint8_t *const symbols,
+                          size_t const count) {
+    for (size_t i = 0; i < count; ++i) {
+        putHuffmanSymbol(writer, code, symbols[i]);
+    }
+}
+
+void buildHuffmanDecoder(HuffmanDecoder *const decoder, const HuffmanCode *const code) {
+    memset(decoder, 0, sizeof(HuffmanDecoder));
+    decoder->maxLength = code->maxLength;
+    uint32_t index = 0;
+    for (uint32_t length = 1; length <= code->maxLength; ++length) {
+        decoder->firstIndex[length] = index;
+        for (uint32_t s = 0; s < code->symbolCount; ++s) {
+            if (code->lengths[s] != length) {
+                continue;
+            }
+            if (decoder->lengthCount[length]++ == 0) {
+                decoder->firstCode[length] = code->codes[s];
+            }
+            decoder->sortedSymbols[index++] = (uint16_t) s;
+
+            // Every lookup index that starts with the code
+            if (length <= HUFFMAN_LOOKUP_BITS) {
+                uint32_t const first = code->codes[s] << (HUFFMAN_LOOKUP_BITS - length);
+                uint32_t const span = 1u << (HUFFMAN_LOOKUP_BITS - length);
+                for (uint32_t i = first; i < first + span; ++i) {
+                    decoder->lookupSymbol[i] = (uint16_t) s;
+                    decoder->lookupLength[i] = (uint8_t) length;
+                }
+            }
+        }
+    }
+}
+
+size_t decodeHuffmanSymbols(const HuffmanDecoder *const decoder, const uint8_t *const data, size_t const size,
+                            uint8_t *const symbols, size_t const count) {
+    // Past the end the accumulator is fed zeros, remaining tells how many bits were real
+    uint64_t accumulator = 0;
+    uint32_t bitCount = 0;
+    size_t position = 0;
+    uint64_t remaining = (uint64_t) size * 8;
+    for (size_t n = 0; n < count; ++n) {
+        while (bitCount <= 56) {
+            accumulator = accumulator << 8 | (position < size ? data[position] : 0);
+            ++position;
+            bitCount += 8;
+        }
+
+        uint32_t const prefix = (uint32_t) (accumulator >> (bitCount - HUFFMAN_LOOKUP_BITS)) &
+                                ((1u << HUFFMAN_LOOKUP_BITS) - 1);
+        uint32_t length = decoder->lookupLength[prefix];
+        uint32_t symbol = decoder->lookupSymbol[prefix];
+        if (length == 0) {
+            for (length = HUFFMAN_LOOKUP_BITS + 1; length <= decoder->maxLength; ++length) {
+                uint32_t const bits = (uint32_t) ((accumulator >> (bitCount - length)) &
+                                                  ((UINT64_C(1) << length) - 1));
+                if (bits - decoder->firstCode[length] < decoder->lengthCount[length]) {
+                    symbol = decoder->sortedSymbols[decoder->firstIndex[length] + bits - decoder->firstCode[length]];
+                    break;
+                }
+            }
+            if (length > decoder->maxLength) {
+                return n;
+            }
+        }
+        if (length > remaining) {
+            return n;
+        }
+        remaining -= length;
+        bitCount -= length;
+        symbols[n] = (uint8_t) symbol;
+    }
+    return count;
+}
@@ -0,0 +1,62 @@
+#ifndef COMMON_HUFFMAN_H
+#define COMMON_HUFFMAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitwriter.h"
+
+#define HUFFMAN_MAX_SYMBOLS 256
+// Longest code putBits() can write in one go
+#define HUFFMAN_MAX_LENGTH 32
+// Codes of up to this many bits are decoded with one table lookup
+#define HUFFMAN_LOOKUP_BITS 10
+
+// Canonical prefix code: codes of equal length are consecutive numbers in symbol order and every
+// length continues from the shortest one, shifted left, as in T.81 Annex C. Symbols that never
+// occur have length 0 and no code.
+typedef struct {
+    uint32_t symbolCount;
+    uint32_t maxLength;
+    uint8_t lengths[HUFFMAN_MAX_SYMBOLS];
+    uint32_t codes[HUFFMAN_MAX_SYMBOLS];
+} HuffmanCode;
+
+// Builds the optimal code of at most maxLength bits per symbol for the given symbol counts. Lengths
+// come from a binary heap Huffman builder; when that exceeds maxLength they are recomputed with
+// package-merge, which is optimal under the limit. A single used symbol gets a 1-bit code. Exits
+// with a message when the symbols do not fit into maxLength bits.
+void buildHuffmanCode(HuffmanCode *code, const uint64_t *counts, uint32_t symbolCount, uint32_t maxLength);
+
+// Average code length in bits over the given counts
+double huffmanBitsPerSymbol(const HuffmanCode *code, const uint64_t *counts);
+
+static inline void putHuffmanSymbol(BitWriter *const writer, const HuffmanCode *const code, uint32_t const symbol) {
+    putBits(writer, code->codes[symbol], code->lengths[symbol]);
+}
+
+// Writes the codes of count symbols, every one of which has to have a code.
+void encodeHuffmanSymbols(BitWriter *writer, const HuffmanCode *code, const uint8_t *symbols, size_t count);
+
+// Table-driven decoder. The next HUFFMAN_LOOKUP_BITS bits index the symbol and length of every code
+// that short; longer codes are resolved with the canonical first code of every length.
+typedef struct {
+    uint16_t lookupSymbol[1 << HUFFMAN_LOOKUP_BITS];
+    // 0 when the prefix starts a longer code
+    uint8_t lookupLength[1 << HUFFMAN_LOOKUP_BITS];
+    uint32_t maxLength;
+    uint32_t firstCode[HUFFMAN_MAX_LENGTH + 1];
+    uint32_t firstIndex[HUFFMAN_MAX_LENGTH + 1];
+    uint32_t lengthCount[HUFFMAN_MAX_LENGTH + 1];
+    // Symbols in code order
+    uint16_t sortedSymbols[HUFFMAN_MAX_SYMBOLS];
+} HuffmanDecoder;
+
+void buildHuffmanDecoder(HuffmanDecoder *decoder, const HuffmanCode *code);
+
+// Decodes up to count symbols from the MSB-first bits of data. Returns how many were decoded, which
+// is less than count when the data ends or holds a bit pattern that is no code.
+size_t decodeHuffmanSymbols(const HuffmanDecoder *decoder, const uint8_t *data, size_t size, uint8_t *symbols,
+                            size_t count);
+
+#endif
@@ -0,0 +1,336 @@
+#include "netpbm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static int isWhitespace(uint8_t const c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Skips whitespace and '#' comments, then parses one decimal number.
+static int parseHeaderNumber(const uint8_t *const data, size_t const size, size_t *const pos, uint32_t *const value) {
+    while (*pos < size) {
+        if (data[*pos] == '#') {
+            while (*pos < size && data[*pos] != '\n') {
+                ++*pos;
+            }
+        } else if (isWhitespace(data[*pos])) {
+            ++*pos;
+        } else {
+            break;
+        }
+    }
+    uint64_t number = 0;
+    size_t const start = *pos;
+    while (*pos < size && data[*pos] >= '0' && data[*pos] <= '9' && number <= UINT32_MAX) {
+        number = number * 10 + (data[*pos] - '0');
+        ++*pos;
+    }
+    if (*pos == start || number > UINT32_MAX) {
+        return -1;
+    }
+    *value = (uint32_t) number;
+    return 0;
+}
+
+// Parses everything up to and including the whitespace after the max value, leaving *pos on the
+// first pixel byte.
+static int parseHeaderFields(const uint8_t *const data, size_t const size, NetpbmImage *const image,
+                             size_t *const pos, const char **const error) {
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+        *error = "unsupported magic number, expected P5 or P6";
+        return -1;
+    }
+    image->type[0] = 'P';
+    image->type[1] = (char) data[1];
+    image->type[2] = '\0';
+    image->channels = data[1] == '5' ? 1 : 3;
+
+    *pos = 2;
+    if (parseHeaderNumber(data, size, pos, &image->width) != 0 ||
+        parseHeaderNumber(data, size, pos, &image->height) != 0 ||
+        parseHeaderNumber(data, size, pos, &image->maxValue) != 0) {
+        *error = "malformed width, height or max value";
+        return -1;
+    }
+    if (image->maxValue == 0 || image->maxValue > 255) {
+        *error = "only 8-bit samples are supported";
+        return -1;
+    }
+    // Exactly one whitespace character separates the header from the payload
+    if (*pos >= size || !isWhitespace(data[*pos])) {
+        *error = "missing whitespace after max value";
+        return -1;
+    }
+    ++*pos;
+    image->stride = (size_t) image->width * image->channels;
+    return 0;
+}
+
+const uint8_t *parseNetpbmHeader(const uint8_t *const data, size_t const size, NetpbmImage *const image,
+                                 const char **const error) {
+    size_t pos;
+    if (parseHeaderFields(data, size, image, &pos, error) != 0) {
+        return NULL;
+    }
+    if (image->stride != 0 && (size - pos) / image->stride < image->height) {
+        *error = "pixel data is truncated";
+        return NULL;
+    }
+    image->pixels = data + pos;
+    return image->pixels;
+}
+
+// Reads the whole file into a heap buffer, for files that cannot be mapped.
+static void *readWholeFile(FILE *const fptr, size_t *const size) {
+    size_t capacity = 1 << 16, length = 0;
+    uint8_t *buffer = (uint8_t *) malloc(capacity);
+    if (buffer == NULL) {
+        perror("readWholeFile::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    size_t read;
+    while ((read = fread(buffer + length, 1, capacity - length, fptr)) > 0) {
+        length += read;
+        if (length == capacity) {
+            capacity *= 2;
+            uint8_t *const grown = (uint8_t *) realloc(buffer, capacity);
+            if (grown == NULL) {
+                perror("readWholeFile::realloc()");
+                exit(EXIT_FAILURE);
+            }
+            buffer = grown;
+        }
+    }
+    *size = length;
+    return buffer;
+}
+
+static int mapFile(const char *const file, NetpbmImage *const image) {
+#if defined(_WIN32)
+    HANDLE const handle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(handle);
+    if (mapping == NULL) {
+        return -1;
+    }
+    void *const data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // The view keeps the mapping alive on its own
+    CloseHandle(mapping);
+    if (data == NULL) {
+        return -1;
+    }
+    image->data = data;
+    image->dataSize = (size_t) fileSize.QuadPart;
+#else
+    int const fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *const data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    // Blocks are visited in raster order, let the kernel read ahead
+    posix_madvise(data, (size_t) info.st_size, POSIX_MADV_SEQUENTIAL);
+    image->data = data;
+    image->dataSize = (size_t) info.st_size;
+#endif
+    image->mapped = 1;
+    return 0;
+}
+
+NetpbmImage openNetpbmImage(const char *const file, const char *const expectedType) {
+    NetpbmImage image = {0};
+    if (mapFile(file, &image) != 0) {
+        // Pipes, empty files or platforms without mapping support end up here
+        FILE *const fptr = fopen(file, "rb");
+        if (fptr == NULL) {
+            perror("openNetpbmImage::fopen()");
+            exit(EXIT_FAILURE);
+        }
+        image.data = readWholeFile(fptr, &image.dataSize);
+        image.mapped = 0;
+        fclose(fptr);
+    }
+
+    const char *error = NULL;
+    if (parseNetpbmHeader((const uint8_t *) image.data, image.dataSize, &image, &error) == NULL) {
+        fprintf(stderr, "openNetpbmImage(): %s: %s!\n", file, error);
+        exit(EXIT_FAILURE);
+    }
+    if (expectedType != NULL && strcmp(image.type, expectedType) != 0) {
+        fprintf(stderr, "openNetpbmImage(): %s: expected %s image, got %s!\n", file, expectedType, image.type);
+        exit(EXIT_FAILURE);
+    }
+    return image;
+}
+
+// Copies the next header from the stream, with comments dropped, up to and including the
+// whitespace after the max value. Returns its length, 0 at the end of the stream, or -1 when the
+// header is longer than capacity or the stream ends inside it.
+static long readStreamHeader(FILE *const fptr, uint8_t *const header, size_t const capacity) {
+    size_t length = 0;
+    int numbers = 0;
+    int inNumber = 0;
+    int c;
+    while ((c = getc(fptr)) != EOF) {
+        // Some writers separate concatenated images with a newline
+        if (length == 0 && isWhitespace((uint8_t) c)) {
+            continue;
+        }
+        if (c == '#' && length >= 2) {
+            while (c != EOF && c != '\n') {
+                c = getc(fptr);
+            }
+            if (c == EOF) {
+                return -1;
+            }
+        }
+        if (length == capacity) {
+            return -1;
+        }
+        header[length++] = (uint8_t) c;
+        if (length <= 2) {
+            continue;
+        }
+        if (c >= '0' && c <= '9') {
+            inNumber = 1;
+        } else if (inNumber) {
+            inNumber = 0;
+            if (++numbers == 3) {
+                return (long) length;
+            }
+        }
+    }
+    return length == 0 ? 0 : -1;
+}
+
+// Reads and checks the header of the next image of the stream, leaving fptr on its first pixel.
+// Returns 0 at the end of the stream.
+static int readFrameHeader(FILE *const fptr, const char *const caller, const char *const name,
+                           const char *const expectedType, NetpbmImage *const image) {
+    uint8_t header[256];
+    long const headerLength = readStreamHeader(fptr, header, sizeof(header));
+    if (headerLength == 0) {
+        return 0;
+    }
+    size_t pos;
+    const char *error = "header is truncated or too long";
+    if (headerLength < 0 || parseHeaderFields(header, (size_t) headerLength, image, &pos, &error) != 0) {
+        fprintf(stderr, "%s(): %s: %s!\n", caller, name, error);
+        exit(EXIT_FAILURE);
+    }
+    if (expectedType != NULL && strcmp(image->type, expectedType) != 0) {
+        fprintf(stderr, "%s(): %s: expected %s image, got %s!\n", caller, name, expectedType, image->type);
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+int readNetpbmFrame(FILE *const fptr, const char *const name, const char *const expectedType,
+                    NetpbmImage *const image) {
+    if (!readFrameHeader(fptr, "readNetpbmFrame", name, expectedType, image)) {
+        return 0;
+    }
+
+    // The buffer of the previous frame is reused whenever it is large enough
+    size_t const payload = image->stride * image->height;
+    if (image->data == NULL || image->mapped || image->dataSize < payload) {
+        closeNetpbmImage(image);
+        image->data = malloc(payload > 0 ? payload : 1);
+        if (image->data == NULL) {
+            perror("readNetpbmFrame::malloc()");
+            exit(EXIT_FAILURE);
+        }
+        image->dataSize = payload;
+        image->mapped = 0;
+    }
+    if (fread(image->data, 1, payload, fptr) != payload) {
+        fprintf(stderr, "readNetpbmFrame(): %s: pixel data is truncated!\n", name);
+        exit(EXIT_FAILURE);
+    }
+    image->pixels = (const uint8_t *) image->data;
+    return 1;
+}
+
+void closeNetpbmImage(NetpbmImage *const image) {
+    if (image->data == NULL) {
+        return;
+    }
+    if (image->mapped) {
+#if defined(_WIN32)
+        UnmapViewOfFile(image->data);
+#else
+        munmap(image->data, image->dataSize);
+#endif
+    } else {
+        free(image->data);
+    }
+    image->data = NULL;
+    image->pixels = NULL;
+}
+
+NetpbmRowReader openNetpbmRowReader(const char *const file, const char *const expectedType) {
+    NetpbmRowReader reader = {.name=file, .rowsRead=0};
+    if (strcmp(file, "-") == 0) {
+        reader.fptr = stdin;
+        reader.name = "stdin";
+    } else {
+        reader.fptr = fopen(file, "rb");
+        if (reader.fptr == NULL) {
+            perror("openNetpbmRowReader::fopen()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!readFrameHeader(reader.fptr, "openNetpbmRowReader", reader.name, expectedType, &reader.image)) {
+        fprintf(stderr, "openNetpbmRowReader(): %s: file is empty!\n", reader.name);
+        exit(EXIT_FAILURE);
+    }
+    return reader;
+}
+
+uint32_t readNetpbmRows(NetpbmRowReader *const reader, uint8_t *const rows, size_t const stride,
+                        uint32_t const count) {
+    uint32_t const left = reader->image.height - reader->rowsRead;
+    uint32_t const rowCount = count < left ? count : left;
+    for (uint32_t r = 0; r < rowCount; ++r) {
+        if (fread(rows + r * stride, 1, reader->image.stride, reader->fptr) != reader->image.stride) {
+            fprintf(stderr, "readNetpbmRows(): %s: pixel data is truncated!\n", reader->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    reader->rowsRead += rowCount;
+    return rowCount;
+}
+
+void closeNetpbmRowReader(NetpbmRowReader *const reader) {
+    if (reader->fptr != NULL && reader->fptr != stdin) {
+        fclose(reader->fptr);
+    }
+    reader->fptr = NULL;
+}
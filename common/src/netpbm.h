@@ -0,0 +1,59 @@
+#ifndef COMMON_NETPBM_H
+#define COMMON_NETPBM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary PGM (P5) or PPM (P6) image with 8-bit samples. The pixel payload is not copied: "pixels"
+// points straight into the memory-mapped file, row r starts at pixels + r * stride.
+typedef struct {
+    char type[3];
+    uint32_t width, height, maxValue;
+    uint32_t channels;
+    size_t stride;
+    const uint8_t *pixels;
+
+    // Mapping (or, when the file cannot be mapped, heap buffer) the pixels live in
+    void *data;
+    size_t dataSize;
+    int mapped;
+} NetpbmImage;
+
+// Parses a netpbm header at the start of data. Returns a pointer to the first pixel and fills in
+// everything but the ownership fields of image, or returns NULL and sets *error to a description
+// when the header is malformed, unsupported or the payload is shorter than size.
+const uint8_t *parseNetpbmHeader(const uint8_t *data, size_t size, NetpbmImage *image, const char **error);
+
+// Maps the file and parses its header. Exits with a message when the file cannot be opened or is
+// not a valid 8-bit P5/P6 image. expectedType ("P5" or "P6") may be NULL to accept both.
+NetpbmImage openNetpbmImage(const char *file, const char *expectedType);
+
+// Reads the next image of a stream of concatenated netpbm images (a pipe, stdin or a single file).
+// image owns a heap buffer that is reused for the next frame when it is large enough, so it has to
+// be zero-initialised before the first call. Returns 1 when a frame was read, 0 at the end of the
+// stream; exits with a message naming "name" on malformed input.
+int readNetpbmFrame(FILE *fptr, const char *name, const char *expectedType, NetpbmImage *image);
+
+void closeNetpbmImage(NetpbmImage *image);
+
+// Reads one image (a file, or stdin for "-") a few rows at a time, for images that are too large
+// to keep in memory. Only the header fields of image are set, its pixels stay NULL.
+typedef struct {
+    FILE *fptr;
+    const char *name;
+    NetpbmImage image;
+    uint32_t rowsRead;
+} NetpbmRowReader;
+
+// Opens the file and parses its header, with the same checks and messages as openNetpbmImage().
+NetpbmRowReader openNetpbmRowReader(const char *file, const char *expectedType);
+
+// Reads the next rows of the image, at most count of them, into rows (one every "stride" bytes) and
+// returns how many were read; 0 once every row has been read. Exits with a message when the pixel
+// data is truncated.
+uint32_t readNetpbmRows(NetpbmRowReader *reader, uint8_t *rows, size_t stride, uint32_t count);
+
+void closeNetpbmRowReader(NetpbmRowReader *reader);
+
+#endif
@@ -0,0 +1,15 @@
+#include "options.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+int parseUint32Option(const char *const text, uint32_t const min, uint32_t const max, uint32_t *const value) {
+    char *end;
+    errno = 0;
+    long long const number = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || number < (long long) min || number > (long long) max) {
+        return -1;
+    }
+    *value = (uint32_t) number;
+    return 0;
+}
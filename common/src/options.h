@@ -0,0 +1,10 @@
+#ifndef COMMON_OPTIONS_H
+#define COMMON_OPTIONS_H
+
+#include <stdint.h>
+
+// Parses a decimal command line value in [min, max]. Returns 0 and sets *value, or -1 when text is
+// not a number, has anything after it or is out of range (atoi() would turn "-1" into a huge count).
+int parseUint32Option(const char *text, uint32_t min, uint32_t max, uint32_t *value);
+
+#endif
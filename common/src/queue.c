@@ -0,0 +1,65 @@
+#include "queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void initBoundedQueue(BoundedQueue *const queue, uint32_t const capacity) {
+    queue->capacity = capacity > 0 ? capacity : 1;
+    queue->items = (void **) malloc(sizeof(void *) * queue->capacity);
+    if (queue->items == NULL) {
+        perror("initBoundedQueue::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    queue->head = queue->count = 0;
+    queue->closed = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+}
+
+void freeBoundedQueue(BoundedQueue *const queue) {
+    pthread_cond_destroy(&queue->notFull);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+    queue->items = NULL;
+}
+
+void pushBoundedQueue(BoundedQueue *const queue, void *const item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->notFull, &queue->lock);
+    }
+    if (queue->closed) {
+        fprintf(stderr, "pushBoundedQueue(): queue is closed!\n");
+        exit(EXIT_FAILURE);
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    ++queue->count;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void *popBoundedQueue(BoundedQueue *const queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    }
+    void *item = NULL;
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        --queue->count;
+        pthread_cond_signal(&queue->notFull);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void closeBoundedQueue(BoundedQueue *const queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_cond_broadcast(&queue->notFull);
+    pthread_mutex_unlock(&queue->lock);
+}
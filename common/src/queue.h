@@ -0,0 +1,32 @@
+#ifndef COMMON_QUEUE_H
+#define COMMON_QUEUE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Fixed-capacity FIFO of pointers between threads. Producers block while it is full, which keeps
+// the stages of a pipeline from running ahead of the slowest one and bounds what is in flight;
+// consumers block while it is empty.
+typedef struct {
+    void **items;
+    uint32_t capacity, head, count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty, notFull;
+} BoundedQueue;
+
+void initBoundedQueue(BoundedQueue *queue, uint32_t capacity);
+
+void freeBoundedQueue(BoundedQueue *queue);
+
+// Appends item, waiting while the queue is full. Pushing to a closed queue is an error.
+void pushBoundedQueue(BoundedQueue *queue, void *item);
+
+// Removes the oldest item, waiting while the queue is empty. Returns NULL once the queue is closed
+// and every item has been taken.
+void *popBoundedQueue(BoundedQueue *queue);
+
+// Marks the end of the items and wakes every waiting consumer.
+void closeBoundedQueue(BoundedQueue *queue);
+
+#endif
@@ -0,0 +1,249 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "threadpool.h"
+
+#include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Chunks [begin, end) still waiting in one worker's queue. The owner takes chunks from the front,
+// thieves split off the back half.
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t begin, end;
+} WorkQueue;
+
+typedef struct {
+    ThreadPool *pool;
+    uint32_t index;
+} WorkerArgs;
+
+struct ThreadPool {
+    uint32_t size;
+    pthread_t *threads;
+    WorkerArgs *args;
+    WorkQueue *queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t running;
+    int shutdown;
+
+    ParallelForBody body;
+    void *context;
+    uint32_t itemCount;
+    uint32_t grainSize;
+};
+
+uint32_t onlineCpuCount(void) {
+    long const count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count < 1 ? 1 : (uint32_t) count;
+}
+
+static int takeOwnChunk(WorkQueue *const queue, uint32_t *const chunk) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->begin < queue->end) {
+        *chunk = queue->begin++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int stealChunk(ThreadPool *const pool, uint32_t const index, uint32_t *const chunk) {
+    for (uint32_t k = 1; k < pool->size; ++k) {
+        WorkQueue *const victim = pool->queues + (index + k) % pool->size;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin >= victim->end) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        uint32_t const remaining = victim->end - victim->begin;
+        uint32_t const stolenEnd = victim->end;
+        uint32_t const stolenBegin = stolenEnd - (remaining + 1) / 2;
+        victim->end = stolenBegin;
+        pthread_mutex_unlock(&victim->lock);
+
+        // Our own queue is empty at this point, so the rest of the stolen range simply becomes it
+        WorkQueue *const own = pool->queues + index;
+        pthread_mutex_lock(&own->lock);
+        own->begin = stolenBegin + 1;
+        own->end = stolenEnd;
+        pthread_mutex_unlock(&own->lock);
+
+        *chunk = stolenBegin;
+        return 1;
+    }
+    return 0;
+}
+
+static void runWorker(ThreadPool *const pool, uint32_t const index) {
+    uint32_t chunk;
+    while (takeOwnChunk(pool->queues + index, &chunk) || stealChunk(pool, index, &chunk)) {
+        uint32_t const begin = chunk * pool->grainSize;
+        uint32_t const end = begin + pool->grainSize < pool->itemCount ? begin + pool->grainSize : pool->itemCount;
+        pool->body(pool->context, index, begin, end);
+    }
+}
+
+static void *workerMain(void *const arg) {
+    const WorkerArgs *const args = (const WorkerArgs *) arg;
+    ThreadPool *const pool = args->pool;
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seenGeneration = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runWorker(pool, args->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool *createThreadPool(uint32_t const threadCount) {
+    ThreadPool *const pool = (ThreadPool *) calloc(1, sizeof(ThreadPool));
+    if (pool == NULL) {
+        perror("createThreadPool::calloc()");
+        exit(EXIT_FAILURE);
+    }
+    pool->size = threadCount == 0 ? onlineCpuCount() : threadCount;
+    pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * pool->size);
+    pool->args = (WorkerArgs *) malloc(sizeof(WorkerArgs) * pool->size);
+    pool->queues = (WorkQueue *) calloc(pool->size, sizeof(WorkQueue));
+    if (pool->threads == NULL || pool->args == NULL || pool->queues == NULL) {
+        perror("createThreadPool::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (uint32_t i = 0; i < pool->size; ++i) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+
+    // Worker 0 is whoever calls threadPoolParallelFor, so only size - 1 threads are started
+    for (uint32_t i = 1; i < pool->size; ++i) {
+        pool->args[i] = (WorkerArgs) {.pool=pool, .index=i};
+        if (pthread_create(pool->threads + i, NULL, workerMain, pool->args + i) != 0) {
+            perror("createThreadPool::pthread_create()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+uint32_t threadPoolSize(const ThreadPool *const pool) {
+    return pool->size;
+}
+
+void threadPoolParallelFor(ThreadPool *const pool, uint32_t const itemCount, uint32_t const grainSize,
+                           ParallelForBody const body, void *const context) {
+    uint32_t const grain = grainSize == 0 ? 1 : grainSize;
+    uint32_t const chunkCount = (itemCount + grain - 1) / grain;
+    if (chunkCount == 0) {
+        return;
+    }
+    if (pool->size == 1 || chunkCount == 1) {
+        body(context, 0, 0, itemCount);
+        return;
+    }
+
+    pool->body = body;
+    pool->context = context;
+    pool->itemCount = itemCount;
+    pool->grainSize = grain;
+    for (uint32_t i = 0; i < pool->size; ++i) {
+        WorkQueue *const queue = pool->queues + i;
+        pthread_mutex_lock(&queue->lock);
+        queue->begin = (uint32_t) ((uint64_t) chunkCount * i / pool->size);
+        queue->end = (uint32_t) ((uint64_t) chunkCount * (i + 1) / pool->size);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->size - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    runWorker(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int pinThreadPool(ThreadPool *const pool) {
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+    int const allowedCount = CPU_COUNT(&allowed);
+    if (allowedCount == 0) {
+        return -1;
+    }
+    int status = 0;
+    int cpu = -1;
+    for (uint32_t i = 0; i < pool->size; ++i) {
+        // Next allowed CPU after the previous one, wrapping around
+        do {
+            cpu = (cpu + 1) % CPU_SETSIZE;
+        } while (!CPU_ISSET(cpu, &allowed));
+        cpu_set_t single;
+        CPU_ZERO(&single);
+        CPU_SET(cpu, &single);
+        pthread_t const thread = i == 0 ? pthread_self() : pool->threads[i];
+        if (pthread_setaffinity_np(thread, sizeof(single), &single) != 0) {
+            status = -1;
+        }
+    }
+    return status;
+#else
+    (void) pool;
+    return -1;
+#endif
+}
+
+void destroyThreadPool(ThreadPool *const pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 1; i < pool->size; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (uint32_t i = 0; i < pool->size; ++i) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->queues);
+    free(pool->args);
+    free(pool->threads);
+    free(pool);
+}
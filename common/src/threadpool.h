@@ -0,0 +1,36 @@
+#ifndef COMMON_THREADPOOL_H
+#define COMMON_THREADPOOL_H
+
+#include <stdint.h>
+
+// Body of a parallel loop. Called with a half-open range [begin, end) of item indices and the index
+// of the worker running it (0 is the calling thread), which can be used to pick per-thread state.
+typedef void (*ParallelForBody)(void *context, uint32_t workerIndex, uint32_t begin, uint32_t end);
+
+typedef struct ThreadPool ThreadPool;
+
+// Largest thread count the command line tools accept; anything above is a typo, not a machine.
+#define THREAD_COUNT_MAX 1024
+
+// Creates a pool with threadCount workers in total, including the thread that calls
+// threadPoolParallelFor. A threadCount of 0 means one worker per online CPU.
+ThreadPool *createThreadPool(uint32_t threadCount);
+
+uint32_t threadPoolSize(const ThreadPool *pool);
+
+// Splits [0, itemCount) into chunks of grainSize items, hands every worker a contiguous share of
+// the chunks and lets idle workers steal half of the remaining chunks of a busy one. Returns once
+// every item has been processed.
+void threadPoolParallelFor(ThreadPool *pool, uint32_t itemCount, uint32_t grainSize,
+                           ParallelForBody body, void *context);
+
+// Pins worker i to the i-th CPU the process may run on (wrapping around when there are more
+// workers than CPUs). Worker 0 is the calling thread, so call this from the thread that will run
+// threadPoolParallelFor. Returns 0 on success, -1 when pinning failed or is not supported.
+int pinThreadPool(ThreadPool *pool);
+
+void destroyThreadPool(ThreadPool *pool);
+
+uint32_t onlineCpuCount(void);
+
+#endif
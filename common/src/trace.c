@@ -0,0 +1,248 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(MAS_TRACE) && MAS_TRACE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_MAX_COUNTERS 64
+// Events kept per thread, later calls still count in the totals
+#define TRACE_MAX_EVENTS (UINT32_C(1) << 20)
+
+typedef struct {
+    uint64_t calls, ticks, bytes, items;
+} TraceTotals;
+
+typedef struct {
+    uint32_t counter;
+    uint64_t start, end;
+} TraceEvent;
+
+// Everything one thread records. Threads only ever touch their own, the lists are read once they
+// are done.
+typedef struct TraceThread {
+    uint32_t index;
+    TraceTotals totals[TRACE_MAX_COUNTERS];
+    TraceEvent *events;
+    uint32_t eventCount, eventCapacity;
+    uint64_t droppedEvents;
+    struct TraceThread *next;
+} TraceThread;
+
+static struct {
+    pthread_mutex_t lock;
+    int active;
+    int recordEvents;
+    const char *summaryFile;
+    const char *chromeFile;
+    TraceCounter *counters[TRACE_MAX_COUNTERS];
+    uint32_t counterCount;
+    // Never freed, a thread keeps its pointer for as long as it lives
+    TraceThread *threads;
+    uint32_t threadCount;
+    uint64_t startTicks;
+    double startSeconds;
+} trace = {.lock=PTHREAD_MUTEX_INITIALIZER};
+
+static __thread TraceThread *currentThread;
+
+static double secondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static uint32_t registerCounter(TraceCounter *const counter) {
+    pthread_mutex_lock(&trace.lock);
+    uint32_t id = counter->id;
+    if (id == 0) {
+        if (trace.counterCount == TRACE_MAX_COUNTERS) {
+            fprintf(stderr, "registerCounter(): more than %d trace counters!\n", TRACE_MAX_COUNTERS);
+            exit(EXIT_FAILURE);
+        }
+        trace.counters[trace.counterCount++] = counter;
+        id = trace.counterCount;
+        __atomic_store_n(&counter->id, id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&trace.lock);
+    return id;
+}
+
+static TraceThread *registerThread(void) {
+    TraceThread *const thread = (TraceThread *) calloc(1, sizeof(TraceThread));
+    if (thread == NULL) {
+        perror("registerThread::calloc()");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&trace.lock);
+    thread->index = trace.threadCount++;
+    thread->next = trace.threads;
+    trace.threads = thread;
+    pthread_mutex_unlock(&trace.lock);
+    return thread;
+}
+
+static void recordEvent(TraceThread *const thread, uint32_t const counter, uint64_t const start,
+                        uint64_t const end) {
+    if (thread->eventCount == thread->eventCapacity) {
+        if (thread->eventCapacity == TRACE_MAX_EVENTS) {
+            ++thread->droppedEvents;
+            return;
+        }
+        thread->eventCapacity = thread->eventCapacity == 0 ? 4096 : thread->eventCapacity * 2;
+        thread->events = (TraceEvent *) realloc(thread->events, sizeof(TraceEvent) * thread->eventCapacity);
+        if (thread->events == NULL) {
+            perror("recordEvent::realloc()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    thread->events[thread->eventCount++] = (TraceEvent) {.counter=counter, .start=start, .end=end};
+}
+
+void traceRecord(TraceCounter *const counter, uint64_t const start, uint64_t const end, uint64_t const bytes,
+                 uint64_t const items) {
+    if (!__atomic_load_n(&trace.active, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    uint32_t id = __atomic_load_n(&counter->id, __ATOMIC_ACQUIRE);
+    if (id == 0) {
+        id = registerCounter(counter);
+    }
+    TraceThread *thread = currentThread;
+    if (thread == NULL) {
+        thread = currentThread = registerThread();
+    }
+    TraceTotals *const totals = &thread->totals[id - 1];
+    ++totals->calls;
+    totals->ticks += end - start;
+    totals->bytes += bytes;
+    totals->items += items;
+    if (trace.recordEvents) {
+        recordEvent(thread, id - 1, start, end);
+    }
+}
+
+void traceStart(const char *const summaryFile, const char *const chromeFile) {
+    pthread_mutex_lock(&trace.lock);
+    for (TraceThread *thread = trace.threads; thread != NULL; thread = thread->next) {
+        memset(thread->totals, 0, sizeof(thread->totals));
+        thread->eventCount = 0;
+        thread->droppedEvents = 0;
+    }
+    trace.summaryFile = summaryFile;
+    trace.chromeFile = chromeFile;
+    trace.recordEvents = chromeFile != NULL;
+    trace.startSeconds = secondsNow();
+    trace.startTicks = traceTicks();
+    pthread_mutex_unlock(&trace.lock);
+    __atomic_store_n(&trace.active, summaryFile != NULL || chromeFile != NULL, __ATOMIC_RELEASE);
+}
+
+static FILE *openTraceFile(const char *const file) {
+    FILE *const fptr = fopen(file, "w");
+    if (fptr == NULL) {
+        perror("openTraceFile::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    return fptr;
+}
+
+static void writeSummary(const char *const file, double const nsPerTick, double const elapsedNs) {
+    TraceTotals totals[TRACE_MAX_COUNTERS] = {{0}};
+    for (TraceThread *thread = trace.threads; thread != NULL; thread = thread->next) {
+        for (uint32_t i = 0; i < trace.counterCount; ++i) {
+            totals[i].calls += thread->totals[i].calls;
+            totals[i].ticks += thread->totals[i].ticks;
+            totals[i].bytes += thread->totals[i].bytes;
+            totals[i].items += thread->totals[i].items;
+        }
+    }
+
+    FILE *const fptr = openTraceFile(file);
+    fprintf(fptr, "{\n\"clock\": \"%s\",\n\"ns_per_tick\": %.6f,\n\"elapsed_ns\": %.0f,\n\"threads\": %u,\n"
+                  "\"stages\": [\n", TRACE_HAS_TSC ? "tsc" : "monotonic", nsPerTick, elapsedNs, trace.threadCount);
+    // Stages in the order they were first reached
+    for (uint32_t i = 0; i < trace.counterCount; ++i) {
+        const TraceTotals *const total = &totals[i];
+        double const ns = (double) total->ticks * nsPerTick;
+        double const calls = total->calls > 0 ? (double) total->calls : 1.0;
+        fprintf(fptr, "{\"name\": \"%s\", \"calls\": %llu, \"ns\": %.0f, \"ticks\": %llu, \"bytes\": %llu, "
+                      "\"items\": %llu, \"ns_per_call\": %.3f, \"items_per_call\": %.3f}%s\n",
+                trace.counters[i]->name, (unsigned long long) total->calls, ns, (unsigned long long) total->ticks,
+                (unsigned long long) total->bytes, (unsigned long long) total->items, ns / calls,
+                (double) total->items / calls, i + 1 < trace.counterCount ? "," : "");
+    }
+    fprintf(fptr, "]\n}\n");
+    fclose(fptr);
+}
+
+// Trace event format: one complete ("X") event per call with microsecond timestamps since
+// traceStart(), threads numbered in the order they first recorded
+static void writeChromeTrace(const char *const file, double const nsPerTick) {
+    FILE *const fptr = openTraceFile(file);
+    uint64_t dropped = 0;
+    int first = 1;
+    fprintf(fptr, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (TraceThread *thread = trace.threads; thread != NULL; thread = thread->next) {
+        fprintf(fptr, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                      "\"args\": {\"name\": \"thread %u\"}}", first ? "" : ",\n", thread->index, thread->index);
+        first = 0;
+        for (uint32_t i = 0; i < thread->eventCount; ++i) {
+            const TraceEvent *const event = &thread->events[i];
+            // Events of stages that started before traceStart() are clamped to it
+            double const start = event->start > trace.startTicks ? (double) (event->start - trace.startTicks) : 0.0;
+            double const duration = (double) (event->end - event->start);
+            fprintf(fptr, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, "
+                          "\"dur\": %.3f}", trace.counters[event->counter]->name, thread->index,
+                    start * nsPerTick * 1e-3, duration * nsPerTick * 1e-3);
+        }
+        dropped += thread->droppedEvents;
+    }
+    fprintf(fptr, "\n]}\n");
+    fclose(fptr);
+    if (dropped > 0) {
+        fprintf(stderr, "writeChromeTrace(): %llu events over the limit of %u per thread were dropped!\n",
+                (unsigned long long) dropped, TRACE_MAX_EVENTS);
+    }
+}
+
+void traceFinish(void) {
+    if (!__atomic_load_n(&trace.active, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    __atomic_store_n(&trace.active, 0, __ATOMIC_RELEASE);
+    uint64_t const ticks = traceTicks() - trace.startTicks;
+    double const elapsedNs = (secondsNow() - trace.startSeconds) * 1e9;
+    double const nsPerTick = ticks > 0 ? elapsedNs / (double) ticks : 1.0;
+
+    pthread_mutex_lock(&trace.lock);
+    if (trace.summaryFile != NULL) {
+        writeSummary(trace.summaryFile, nsPerTick, elapsedNs);
+    }
+    if (trace.chromeFile != NULL) {
+        writeChromeTrace(trace.chromeFile, nsPerTick);
+    }
+    for (TraceThread *thread = trace.threads; thread != NULL; thread = thread->next) {
+        free(thread->events);
+        thread->events = NULL;
+        thread->eventCount = thread->eventCapacity = 0;
+    }
+    pthread_mutex_unlock(&trace.lock);
+}
+
+#else
+
+void traceStart(const char *const summaryFile, const char *const chromeFile) {
+    if (summaryFile != NULL || chromeFile != NULL) {
+        fprintf(stderr, "traceStart(): built without MAS_TRACE, no trace is written!\n");
+    }
+}
+
+void traceFinish(void) {
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef COMMON_TRACE_H
+#define COMMON_TRACE_H
+
+#include <stdint.h>
+
+// Stage instrumentation for the hot paths. Built with MAS_TRACE defined to 1 (cmake -DMAS_TRACE=ON),
+// every stage wrapped in TRACE_BEGIN / TRACE_END adds its calls, time, bytes and items (SAD
+// evaluations, ...) to per-thread totals, and can record every call as an event of a Chrome trace
+// (chrome://tracing, Perfetto). Without it the macros expand to nothing, so neither the timers nor
+// the byte and item expressions are evaluated.
+//
+//     TRACE_COUNTER(dctCounter, "encode/dct");        // file scope
+//     ...
+//     TRACE_BEGIN(dctStart);
+//     dct(...);
+//     TRACE_END(dctCounter, dctStart, sizeof(block), 0);
+
+#if defined(MAS_TRACE) && MAS_TRACE
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRACE_HAS_TSC 1
+#include <x86intrin.h>
+#else
+#define TRACE_HAS_TSC 0
+#include <time.h>
+#endif
+
+// A named stage. The id is handed out on first use, counters only ever live in static storage.
+typedef struct {
+    const char *name;
+    uint32_t id;
+} TraceCounter;
+
+// Time stamp counter where there is one (cycles at the nominal frequency), otherwise nanoseconds
+static inline uint64_t traceTicks(void) {
+#if TRACE_HAS_TSC
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+#endif
+}
+
+// Adds one call of [start, end) to the totals of the calling thread, and to its events when a
+// Chrome trace is being recorded. Does nothing before traceStart().
+void traceRecord(TraceCounter *counter, uint64_t start, uint64_t end, uint64_t bytes, uint64_t items);
+
+#define TRACE_COUNTER(var, stage) static TraceCounter var = {stage, 0}
+#define TRACE_BEGIN(start) uint64_t const start = traceTicks()
+#define TRACE_END(counter, start, bytes, items) traceRecord(&(counter), start, traceTicks(), bytes, items)
+// A value kept only for TRACE_END, e.g. a work counter before the stage
+#define TRACE_VALUE(var, value) uint64_t const var = (value)
+
+#else
+
+#define TRACE_COUNTER(var, stage) extern int var
+#define TRACE_BEGIN(start) ((void) 0)
+#define TRACE_END(counter, start, bytes, items) ((void) 0)
+#define TRACE_VALUE(var, value) ((void) 0)
+
+#endif
+
+// Starts collecting. The summary is written to summaryFile as JSON, one object per stage with its
+// calls, nanoseconds, ticks, bytes and items; with chromeFile set, every call is kept as a complete
+// event too (up to a cap per thread) and written in the Chrome trace event format. Either file may
+// be NULL. Without MAS_TRACE this only warns that the build has no instrumentation.
+void traceStart(const char *summaryFile, const char *chromeFile);
+
+// Writes the files traceStart() asked for and stops collecting. Call it when no other thread is
+// inside an instrumented stage any more.
+void traceFinish(void);
+
+#endif
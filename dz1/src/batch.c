@@ -0,0 +1,328 @@
+#include "batch.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+#include "threadpool.h"
+#include "trace.h"
+
+TRACE_COUNTER(readCounter, "batch/read");
+TRACE_COUNTER(encodeCounter, "batch/encode");
+TRACE_COUNTER(writeCounter, "batch/write");
+
+// One image on its way through the pipeline. The reader fills in the image, the encoder replaces it
+// with its blocks (4:4:4) or MCUs, the writer frees the job.
+typedef struct {
+    const char *input;
+    char *output;
+    PPMImageRGB imageRGB;
+    uint16_t width, height;
+    uint32_t unitCount;
+    BlockQuantized *blocks;
+    McuQuantized *mcus;
+} BatchJob;
+
+typedef struct {
+    char **inputs;
+    uint32_t inputCount;
+    const char *outDirectory;
+    const EncoderOptions *options;
+    OutputFormat format;
+
+    // Next input a reader takes, and readers still running
+    uint32_t nextInput;
+    uint32_t activeReaders;
+    BoundedQueue readQueue, writeQueue;
+
+    // Nanoseconds each stage spent working
+    uint64_t readNs, encodeNs, writeNs;
+} Batch;
+
+static uint64_t nanosecondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static int compareNames(const void *const a, const void *const b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static int hasPpmSuffix(const char *const name) {
+    size_t const length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".ppm") == 0;
+}
+
+static char *joinPath(const char *const directory, const char *const name) {
+    size_t const length = strlen(directory) + strlen(name) + 2;
+    char *const path = (char *) malloc(length);
+    if (path == NULL) {
+        perror("joinPath::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, length, "%s/%s", directory, name);
+    return path;
+}
+
+static void appendInput(Batch *const batch, uint32_t *const capacity, char *const path) {
+    if (batch->inputCount == *capacity) {
+        *capacity = *capacity == 0 ? 64 : *capacity * 2;
+        batch->inputs = (char **) realloc(batch->inputs, sizeof(char *) * *capacity);
+        if (batch->inputs == NULL) {
+            perror("appendInput::realloc()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    batch->inputs[batch->inputCount++] = path;
+}
+
+// Expands the directories among the inputs into their .ppm files
+static void collectInputs(Batch *const batch, char *const *const inputs, uint32_t const inputCount) {
+    uint32_t capacity = 0;
+    for (uint32_t i = 0; i < inputCount; ++i) {
+        DIR *const dir = opendir(inputs[i]);
+        if (dir == NULL) {
+            appendInput(batch, &capacity, strdup(inputs[i]));
+            continue;
+        }
+        uint32_t const first = batch->inputCount;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (hasPpmSuffix(entry->d_name)) {
+                appendInput(batch, &capacity, joinPath(inputs[i], entry->d_name));
+            }
+        }
+        closedir(dir);
+        qsort(batch->inputs + first, batch->inputCount - first, sizeof(char *), compareNames);
+    }
+}
+
+// Output file of an input: its name without directories and the .ppm suffix, in the output directory
+static char *outputPathOf(const Batch *const batch, const char *const input) {
+    const char *const slash = strrchr(input, '/');
+    const char *const name = slash != NULL ? slash + 1 : input;
+    size_t const nameLength = hasPpmSuffix(name) ? strlen(name) - 4 : strlen(name);
+    const char *const extension = outputExtension(batch->format);
+    size_t const length = strlen(batch->outDirectory) + nameLength + strlen(extension) + 2;
+    char *const path = (char *) malloc(length);
+    if (path == NULL) {
+        perror("outputPathOf::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, length, "%s/%.*s%s", batch->outDirectory, (int) nameLength, name, extension);
+    return path;
+}
+
+typedef struct {
+    const char *input;
+    char *output;
+} BatchTarget;
+
+static int compareTargets(const void *const a, const void *const b) {
+    return strcmp(((const BatchTarget *) a)->output, ((const BatchTarget *) b)->output);
+}
+
+// Refuses inputs that share a name in different directories, as the later one would overwrite the other
+static void checkOutputPaths(const Batch *const batch) {
+    BatchTarget *const targets = (BatchTarget *) malloc(sizeof(BatchTarget) * (batch->inputCount + 1));
+    if (targets == NULL) {
+        perror("checkOutputPaths::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < batch->inputCount; ++i) {
+        targets[i] = (BatchTarget) {.input=batch->inputs[i], .output=outputPathOf(batch, batch->inputs[i])};
+    }
+    qsort(targets, batch->inputCount, sizeof(BatchTarget), compareTargets);
+    for (uint32_t i = 1; i < batch->inputCount; ++i) {
+        if (strcmp(targets[i - 1].output, targets[i].output) == 0) {
+            fprintf(stderr, "checkOutputPaths(): %s and %s would both be written to %s!\n",
+                    targets[i - 1].input, targets[i].input, targets[i].output);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (uint32_t i = 0; i < batch->inputCount; ++i) {
+        free(targets[i].output);
+    }
+    free(targets);
+}
+
+static void *readerMain(void *const arg) {
+    Batch *const batch = (Batch *) arg;
+    for (;;) {
+        uint32_t const index = __atomic_fetch_add(&batch->nextInput, 1, __ATOMIC_RELAXED);
+        if (index >= batch->inputCount) {
+            break;
+        }
+        uint64_t const start = nanosecondsNow();
+        TRACE_BEGIN(traceStart);
+        BatchJob *const job = (BatchJob *) calloc(1, sizeof(BatchJob));
+        if (job == NULL) {
+            perror("readerMain::calloc()");
+            exit(EXIT_FAILURE);
+        }
+        job->input = batch->inputs[index];
+        job->output = outputPathOf(batch, job->input);
+        // Read into memory rather than mapped, so the encoder never waits on a page fault
+        FILE *const fptr = fopen(job->input, "rb");
+        if (fptr == NULL) {
+            perror("readerMain::fopen()");
+            exit(EXIT_FAILURE);
+        }
+        NetpbmImage source = {0};
+        if (readNetpbmFrame(fptr, job->input, "P6", &source) == 0) {
+            fprintf(stderr, "readerMain(): %s: no image in file!\n", job->input);
+            exit(EXIT_FAILURE);
+        }
+        fclose(fptr);
+        job->imageRGB = wrapPPMImageRGB(source, job->input);
+        TRACE_END(readCounter, traceStart, source.dataSize, 1);
+        __atomic_fetch_add(&batch->readNs, nanosecondsNow() - start, __ATOMIC_RELAXED);
+        pushBoundedQueue(&batch->readQueue, job);
+    }
+    // The last reader to finish tells the encoder there is nothing more to come
+    if (__atomic_sub_fetch(&batch->activeReaders, 1, __ATOMIC_ACQ_REL) == 0) {
+        closeBoundedQueue(&batch->readQueue);
+    }
+    return NULL;
+}
+
+// Encodes the image of the job into its blocks or MCUs and releases the image
+static void encodeJob(const Batch *const batch, BatchJob *const job, ThreadPool *const pool) {
+    const EncoderOptions *const options = batch->options;
+    const PPMImageRGB *const imageRGB = &job->imageRGB;
+    job->width = imageRGB->width;
+    job->height = imageRGB->height;
+    if (options->sampling != CHROMA_444) {
+        job->unitCount = mcuCountOf(imageRGB, options->sampling);
+        job->mcus = (McuQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(McuQuantized) * job->unitCount);
+        PlanarImage planes = convertImageToSubsampledPlanes(imageRGB, options->rowConverter, options->sampling,
+                                                            options->chromaFilter, pool);
+        encodeImageMcus(&planes, options->sampling, options->dct, options->quantizer, pool, job->mcus);
+        freePlanarImage(&planes);
+    } else {
+        job->unitCount = blockCountOf(imageRGB);
+        job->blocks = (BlockQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(BlockQuantized) * job->unitCount);
+        PlanarImage planes = {0};
+        if (options->rowConverter != NULL) {
+            planes = convertImageToPlanes(imageRGB, options->rowConverter, pool);
+        }
+        encodeImageBlocks(imageRGB, options->rowConverter != NULL ? &planes : NULL, options->dct,
+                          options->quantizer, pool, job->blocks);
+        freePlanarImage(&planes);
+    }
+    freePPMImageRGB(&job->imageRGB);
+}
+
+static void *writerMain(void *const arg) {
+    Batch *const batch = (Batch *) arg;
+    BatchJob *job;
+    while ((job = (BatchJob *) popBoundedQueue(&batch->writeQueue)) != NULL) {
+        uint64_t const start = nanosecondsNow();
+        TRACE_BEGIN(traceStart);
+        FILE *const fptr = fopen(job->output, "wb");
+        if (fptr == NULL) {
+            perror("writerMain::fopen()");
+            exit(EXIT_FAILURE);
+        }
+        BlockOutput output = beginOutput(batch->format, fptr, job->width, job->height, batch->options,
+                                         job->unitCount);
+        for (uint32_t i = 0; i < job->unitCount; ++i) {
+            if (job->mcus != NULL) {
+                writeEncodedMcu(&output, job->mcus + i);
+            } else {
+                writeEncodedBlock(&output, job->blocks + i);
+            }
+        }
+        endOutput(&output);
+        if (ferror(fptr)) {
+            perror("writerMain::fwrite()");
+            exit(EXIT_FAILURE);
+        }
+        fclose(fptr);
+        TRACE_END(writeCounter, traceStart, (uint64_t) job->width * job->height * 3, 1);
+
+        alignedFree(job->blocks);
+        alignedFree(job->mcus);
+        free(job->output);
+        free(job);
+        __atomic_fetch_add(&batch->writeNs, nanosecondsNow() - start, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static pthread_t *startThreads(uint32_t const count, void *(*const main)(void *), Batch *const batch) {
+    pthread_t *const threads = (pthread_t *) malloc(sizeof(pthread_t) * count);
+    if (threads == NULL) {
+        perror("startThreads::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (pthread_create(&threads[i], NULL, main, batch) != 0) {
+            perror("startThreads::pthread_create()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return threads;
+}
+
+static void joinThreads(pthread_t *const threads, uint32_t const count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+BatchStats encodeBatch(char *const *const inputs, uint32_t const inputCount, const char *const outDirectory,
+                       const EncoderOptions *const options, OutputFormat const format,
+                       const BatchOptions *const batchOptions) {
+    uint64_t const start = nanosecondsNow();
+    uint32_t const readerCount = batchOptions->readerCount > 0 ? batchOptions->readerCount : 1;
+    uint32_t const writerCount = batchOptions->writerCount > 0 ? batchOptions->writerCount : 1;
+    Batch batch = {.outDirectory=outDirectory, .options=options, .format=format, .activeReaders=readerCount};
+    collectInputs(&batch, inputs, inputCount);
+    checkOutputPaths(&batch);
+    initBoundedQueue(&batch.readQueue, batchOptions->queueDepth);
+    initBoundedQueue(&batch.writeQueue, batchOptions->queueDepth);
+
+    BatchStats stats = {0};
+    pthread_t *const readers = startThreads(readerCount, readerMain, &batch);
+    pthread_t *const writers = startThreads(writerCount, writerMain, &batch);
+
+    // The encoder stage is this thread and the workers of the pool
+    ThreadPool *const pool = options->threadCount == 1 ? NULL : createThreadPool(options->threadCount);
+    BatchJob *job;
+    while ((job = (BatchJob *) popBoundedQueue(&batch.readQueue)) != NULL) {
+        uint64_t const encodeStart = nanosecondsNow();
+        TRACE_BEGIN(traceStart);
+        stats.pixelBytes += (uint64_t) job->imageRGB.width * job->imageRGB.height * 3;
+        encodeJob(&batch, job, pool);
+        TRACE_END(encodeCounter, traceStart, (uint64_t) job->width * job->height * 3, job->unitCount);
+        batch.encodeNs += nanosecondsNow() - encodeStart;
+        ++stats.imageCount;
+        pushBoundedQueue(&batch.writeQueue, job);
+    }
+    closeBoundedQueue(&batch.writeQueue);
+    if (pool != NULL) {
+        destroyThreadPool(pool);
+    }
+    joinThreads(readers, readerCount);
+    joinThreads(writers, writerCount);
+
+    freeBoundedQueue(&batch.writeQueue);
+    freeBoundedQueue(&batch.readQueue);
+    for (uint32_t i = 0; i < batch.inputCount; ++i) {
+        free(batch.inputs[i]);
+    }
+    free(batch.inputs);
+
+    stats.seconds = (double) (nanosecondsNow() - start) * 1e-9;
+    stats.readSeconds = (double) batch.readNs * 1e-9;
+    stats.encodeSeconds = (double) batch.encodeNs * 1e-9;
+    stats.writeSeconds = (double) batch.writeNs * 1e-9;
+    return stats;
+}
@@ -0,0 +1,36 @@
+#ifndef DZ1_BATCH_H
+#define DZ1_BATCH_H
+
+#include <stdint.h>
+
+#include "encoder.h"
+#include "output.h"
+
+typedef struct {
+    // Threads reading input files ahead of the encoder, and threads entropy coding and writing
+    // the encoded images
+    uint32_t readerCount, writerCount;
+    // Images each of the two queues between the stages holds at most
+    uint32_t queueDepth;
+} BatchOptions;
+
+typedef struct {
+    uint32_t imageCount;
+    // RGB bytes of every image
+    uint64_t pixelBytes;
+    double seconds;
+    // Time each stage spent working, summed over its threads
+    double readSeconds, encodeSeconds, writeSeconds;
+} BatchStats;
+
+// Encodes every input image (a .ppm file, or a directory standing for every .ppm file in it in name
+// order) into outDirectory, as the input's name with the .ppm replaced by outputExtension(format).
+// Inputs from different directories that would end up at the same output path are refused up front.
+// Reader threads load the next images while the current one is encoded on a pool of
+// options->threadCount workers and the writer threads code and write the ones before it. Bounded
+// queues connect the stages, so a stage that gets ahead waits for the next one, and throughput is
+// set by the slowest stage while memory stays bounded however many images there are.
+BatchStats encodeBatch(char *const *inputs, uint32_t inputCount, const char *outDirectory,
+                       const EncoderOptions *options, OutputFormat format, const BatchOptions *batch);
+
+#endif
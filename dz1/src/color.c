@@ -0,0 +1,438 @@
+#include "color.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_HAS_X86 1
+#include <immintrin.h>
+#else
+#define COLOR_HAS_X86 0
+#endif
+
+// Same constants as Y_R_CONST, Cb_R_CONST, ... scaled by 2^14. Every row sums to 2^14 (or 0 for
+// chroma), so mid-grey stays exactly at 128.
+#define FIX_Y_R 4899
+#define FIX_Y_G 9617
+#define FIX_Y_B 1868
+#define FIX_CB_R (-2764)
+#define FIX_CB_G (-5428)
+#define FIX_CB_B 8192
+#define FIX_CR_R 8192
+#define FIX_CR_G (-6860)
+#define FIX_CR_B (-1332)
+
+// Inverse transform, 1.402, 0.344136, 0.714136 and 1.772 scaled by 2^14
+#define FIX_R_CR 22970
+#define FIX_G_CB 5638
+#define FIX_G_CR 11700
+#define FIX_B_CB 29032
+
+#define FIX_HALF (1 << (COLOR_FIX_BITS - 1))
+#define FIX_CHROMA_OFFSET ((128 << COLOR_FIX_BITS) + FIX_HALF)
+
+static uint8_t clampToByte(int32_t const value) {
+    return value > 255 ? 255 : (uint8_t) value;
+}
+
+void convertRowScalar(const uint8_t *const rgb, uint8_t *const y, uint8_t *const cb, uint8_t *const cr,
+                      size_t const width) {
+    for (size_t i = 0; i < width; ++i) {
+        int32_t const r = rgb[3 * i];
+        int32_t const g = rgb[3 * i + 1];
+        int32_t const b = rgb[3 * i + 2];
+        // All three sums are non-negative for 8-bit input, so the shift rounds correctly
+        y[i] = clampToByte((FIX_Y_R * r + FIX_Y_G * g + FIX_Y_B * b + FIX_HALF) >> COLOR_FIX_BITS);
+        cb[i] = clampToByte((FIX_CB_R * r + FIX_CB_G * g + FIX_CB_B * b + FIX_CHROMA_OFFSET) >> COLOR_FIX_BITS);
+        cr[i] = clampToByte((FIX_CR_R * r + FIX_CR_G * g + FIX_CR_B * b + FIX_CHROMA_OFFSET) >> COLOR_FIX_BITS);
+    }
+}
+
+static uint8_t clampToRange(int32_t const value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t) value;
+}
+
+void convertRowToRGB(const uint8_t *const y, const uint8_t *const cb, const uint8_t *const cr, uint8_t *const rgb,
+                     size_t const width) {
+    for (size_t i = 0; i < width; ++i) {
+        int32_t const luma = y[i];
+        int32_t const blue = cb[i] - 128;
+        int32_t const red = cr[i] - 128;
+        // Arithmetic right shifts, so negative offsets round the same way as positive ones
+        rgb[3 * i] = clampToRange(luma + ((FIX_R_CR * red + FIX_HALF) >> COLOR_FIX_BITS));
+        rgb[3 * i + 1] = clampToRange(luma + ((-FIX_G_CB * blue - FIX_G_CR * red + FIX_HALF) >> COLOR_FIX_BITS));
+        rgb[3 * i + 2] = clampToRange(luma + ((FIX_B_CB * blue + FIX_HALF) >> COLOR_FIX_BITS));
+    }
+}
+
+#if COLOR_HAS_X86
+
+// Splits 16 packed RGB pixels (48 bytes) into 16 R, 16 G and 16 B bytes.
+__attribute__((target("ssse3")))
+static inline void deinterleave16(const uint8_t *const rgb, __m128i *const r, __m128i *const g, __m128i *const b) {
+    __m128i const a0 = _mm_loadu_si128((const __m128i *) rgb);
+    __m128i const a1 = _mm_loadu_si128((const __m128i *) (rgb + 16));
+    __m128i const a2 = _mm_loadu_si128((const __m128i *) (rgb + 32));
+
+    *r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+                      _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    *g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+                      _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    *b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+                      _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// One channel for 8 pixels held as 16-bit lanes. R/G and B/0 are interleaved so that pmaddwd
+// produces cR * r + cG * g and cB * b per pixel in 32-bit lanes.
+__attribute__((target("ssse3")))
+static inline __m128i channel8(__m128i const r, __m128i const g, __m128i const b,
+                               __m128i const coefRG, __m128i const coefB, __m128i const offset) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), coefRG),
+                                                   _mm_madd_epi16(_mm_unpacklo_epi16(b, zero), coefB)), offset);
+    __m128i const hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), coefRG),
+                                                   _mm_madd_epi16(_mm_unpackhi_epi16(b, zero), coefB)), offset);
+    return _mm_packs_epi32(_mm_srai_epi32(lo, COLOR_FIX_BITS), _mm_srai_epi32(hi, COLOR_FIX_BITS));
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i channel16(__m128i const r, __m128i const g, __m128i const b,
+                                __m128i const coefRG, __m128i const coefB, __m128i const offset) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const lo = channel8(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero),
+                                coefRG, coefB, offset);
+    __m128i const hi = channel8(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero),
+                                coefRG, coefB, offset);
+    // Unsigned saturation clamps the one overflow case (Cb/Cr of pure blue/red rounds up to 256)
+    return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("ssse3")))
+static void convertRowSSSE3(const uint8_t *const rgb, uint8_t *const y, uint8_t *const cb, uint8_t *const cr,
+                            size_t const width) {
+    __m128i const yRG = _mm_setr_epi16(FIX_Y_R, FIX_Y_G, FIX_Y_R, FIX_Y_G, FIX_Y_R, FIX_Y_G, FIX_Y_R, FIX_Y_G);
+    __m128i const yB = _mm_setr_epi16(FIX_Y_B, 0, FIX_Y_B, 0, FIX_Y_B, 0, FIX_Y_B, 0);
+    __m128i const cbRG = _mm_setr_epi16(FIX_CB_R, FIX_CB_G, FIX_CB_R, FIX_CB_G, FIX_CB_R, FIX_CB_G, FIX_CB_R, FIX_CB_G);
+    __m128i const cbB = _mm_setr_epi16(FIX_CB_B, 0, FIX_CB_B, 0, FIX_CB_B, 0, FIX_CB_B, 0);
+    __m128i const crRG = _mm_setr_epi16(FIX_CR_R, FIX_CR_G, FIX_CR_R, FIX_CR_G, FIX_CR_R, FIX_CR_G, FIX_CR_R, FIX_CR_G);
+    __m128i const crB = _mm_setr_epi16(FIX_CR_B, 0, FIX_CR_B, 0, FIX_CR_B, 0, FIX_CR_B, 0);
+    __m128i const lumaOffset = _mm_set1_epi32(FIX_HALF);
+    __m128i const chromaOffset = _mm_set1_epi32(FIX_CHROMA_OFFSET);
+
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m128i r, g, b;
+        deinterleave16(rgb + 3 * i, &r, &g, &b);
+        _mm_storeu_si128((__m128i *) (y + i), channel16(r, g, b, yRG, yB, lumaOffset));
+        _mm_storeu_si128((__m128i *) (cb + i), channel16(r, g, b, cbRG, cbB, chromaOffset));
+        _mm_storeu_si128((__m128i *) (cr + i), channel16(r, g, b, crRG, crB, chromaOffset));
+    }
+    convertRowScalar(rgb + 3 * i, y + i, cb + i, cr + i, width - i);
+}
+
+// AVX2 version of channel16. The 256-bit unpack and pack instructions both work per 128-bit lane, so
+// their reordering cancels out and only the final byte pack needs a cross-lane permute.
+__attribute__((target("avx2")))
+static inline __m128i channel16AVX2(__m256i const r, __m256i const g, __m256i const b,
+                                    __m256i const coefRG, __m256i const coefB, __m256i const offset) {
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const lo = _mm256_add_epi32(_mm256_add_epi32(
+            _mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), coefRG),
+            _mm256_madd_epi16(_mm256_unpacklo_epi16(b, zero), coefB)), offset);
+    __m256i const hi = _mm256_add_epi32(_mm256_add_epi32(
+            _mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), coefRG),
+            _mm256_madd_epi16(_mm256_unpackhi_epi16(b, zero), coefB)), offset);
+    __m256i const words = _mm256_packs_epi32(_mm256_srai_epi32(lo, COLOR_FIX_BITS),
+                                             _mm256_srai_epi32(hi, COLOR_FIX_BITS));
+    __m256i const bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+    return _mm256_castsi256_si128(bytes);
+}
+
+__attribute__((target("avx2")))
+static void convertRowAVX2(const uint8_t *const rgb, uint8_t *const y, uint8_t *const cb, uint8_t *const cr,
+                           size_t const width) {
+    __m256i const yRG = _mm256_set1_epi32((int32_t) ((uint32_t) (uint16_t) FIX_Y_G << 16 | (uint16_t) FIX_Y_R));
+    __m256i const yB = _mm256_set1_epi32(FIX_Y_B);
+    __m256i const cbRG = _mm256_set1_epi32((int32_t) ((uint32_t) (uint16_t) FIX_CB_G << 16 | (uint16_t) FIX_CB_R));
+    __m256i const cbB = _mm256_set1_epi32(FIX_CB_B);
+    __m256i const crRG = _mm256_set1_epi32((int32_t) ((uint32_t) (uint16_t) FIX_CR_G << 16 | (uint16_t) FIX_CR_R));
+    __m256i const crB = _mm256_set1_epi32((int32_t) (uint16_t) FIX_CR_B);
+    __m256i const lumaOffset = _mm256_set1_epi32(FIX_HALF);
+    __m256i const chromaOffset = _mm256_set1_epi32(FIX_CHROMA_OFFSET);
+
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m128i r8, g8, b8;
+        deinterleave16(rgb + 3 * i, &r8, &g8, &b8);
+        __m256i const r = _mm256_cvtepu8_epi16(r8);
+        __m256i const g = _mm256_cvtepu8_epi16(g8);
+        __m256i const b = _mm256_cvtepu8_epi16(b8);
+        _mm_storeu_si128((__m128i *) (y + i), channel16AVX2(r, g, b, yRG, yB, lumaOffset));
+        _mm_storeu_si128((__m128i *) (cb + i), channel16AVX2(r, g, b, cbRG, cbB, chromaOffset));
+        _mm_storeu_si128((__m128i *) (cr + i), channel16AVX2(r, g, b, crRG, crB, chromaOffset));
+    }
+    // The compiler turns the scalar tail into a jump without clearing the upper halves first. Left
+    // dirty, they slow down the SSE code that runs after, the libm cos of the reference DCT ~10x.
+    _mm256_zeroupper();
+    convertRowScalar(rgb + 3 * i, y + i, cb + i, cr + i, width - i);
+}
+
+#endif
+
+RowConverter selectRowConverter(ColorKernel const kernel) {
+#if COLOR_HAS_X86
+    __builtin_cpu_init();
+    int const hasAVX2 = __builtin_cpu_supports("avx2");
+    int const hasSSSE3 = __builtin_cpu_supports("ssse3");
+    switch (kernel) {
+        case COLOR_AUTO:
+            return hasAVX2 ? convertRowAVX2 : hasSSSE3 ? convertRowSSSE3 : convertRowScalar;
+        case COLOR_AVX2:
+            return hasAVX2 ? convertRowAVX2 : convertRowScalar;
+        case COLOR_SSSE3:
+            return hasSSSE3 ? convertRowSSSE3 : convertRowScalar;
+        case COLOR_SCALAR:
+        default:
+            return convertRowScalar;
+    }
+#else
+    (void) kernel;
+    return convertRowScalar;
+#endif
+}
+
+const char *colorKernelName(ColorKernel const kernel) {
+    switch (kernel) {
+        case COLOR_SCALAR:
+            return "scalar";
+        case COLOR_SSSE3:
+            return "ssse3";
+        case COLOR_AVX2:
+            return "avx2";
+        case COLOR_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+int parseColorKernel(const char *const name, ColorKernel *const kernel) {
+    ColorKernel const kernels[] = {COLOR_AUTO, COLOR_SCALAR, COLOR_SSSE3, COLOR_AVX2};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        if (strcmp(name, colorKernelName(kernels[i])) == 0) {
+            *kernel = kernels[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void convertRowsToYCbCr(const uint8_t *const rgb, size_t const rgbStride, PlanarImage *const image,
+                        uint32_t const firstRow, uint32_t const endRow, RowConverter const convert) {
+    for (uint32_t row = firstRow; row < endRow; ++row) {
+        convert(rgb + row * rgbStride, planarRow(image, CHANNEL_Y, row), planarRow(image, CHANNEL_CB, row),
+                planarRow(image, CHANNEL_CR, row), image->width);
+    }
+}
+
+const char *chromaSamplingName(ChromaSampling const sampling) {
+    switch (sampling) {
+        case CHROMA_422:
+            return "422";
+        case CHROMA_420:
+            return "420";
+        case CHROMA_444:
+        default:
+            return "444";
+    }
+}
+
+int parseChromaSampling(const char *const name, ChromaSampling *const sampling) {
+    ChromaSampling const samplings[] = {CHROMA_444, CHROMA_422, CHROMA_420};
+    for (size_t i = 0; i < sizeof(samplings) / sizeof(samplings[0]); ++i) {
+        if (strcmp(name, chromaSamplingName(samplings[i])) == 0) {
+            *sampling = samplings[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *chromaFilterName(ChromaFilter const filter) {
+    return filter == CHROMA_TRIANGLE ? "triangle" : "box";
+}
+
+int parseChromaFilter(const char *const name, ChromaFilter *const filter) {
+    if (strcmp(name, "box") == 0) {
+        *filter = CHROMA_BOX;
+    } else if (strcmp(name, "triangle") == 0) {
+        *filter = CHROMA_TRIANGLE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Taps of a downsampling filter along one direction, starting "offset" samples before the first
+// sample an output sample covers. The weights sum to 1 << shift.
+typedef struct {
+    uint32_t count;
+    int32_t offset;
+    uint32_t shift;
+    uint32_t weights[4];
+} ChromaTaps;
+
+static ChromaTaps chromaTapsOf(ChromaFilter const filter, uint32_t const factor) {
+    if (factor == 1) {
+        return (ChromaTaps) {.count=1, .offset=0, .shift=0, .weights={1}};
+    }
+    if (filter == CHROMA_TRIANGLE) {
+        return (ChromaTaps) {.count=4, .offset=-1, .shift=3, .weights={1, 3, 3, 1}};
+    }
+    return (ChromaTaps) {.count=2, .offset=0, .shift=1, .weights={1, 1}};
+}
+
+static int64_t clampIndex(int64_t const index, int64_t const count) {
+    return index < 0 ? 0 : index >= count ? count - 1 : index;
+}
+
+// Filters the vertically weighted sums of one full resolution row into "count" chroma samples,
+// every subsampled mode halves the width
+static void downsampleRow(const uint32_t *const sums, int64_t const width, const ChromaTaps *const taps,
+                          uint32_t const shift, uint8_t *const out, uint32_t const count) {
+    uint32_t const rounding = (1u << shift) >> 1;
+    for (uint32_t x = 0; x < count; ++x) {
+        int64_t const first = (int64_t) x * 2 + taps->offset;
+        uint32_t sum = rounding;
+        for (uint32_t k = 0; k < taps->count; ++k) {
+            sum += taps->weights[k] * sums[clampIndex(first + k, width)];
+        }
+        out[x] = (uint8_t) (sum >> shift);
+    }
+}
+
+// Full resolution rows [sourceFirst, sourceEnd) can be read from rgb, the filter clamps to them. The
+// whole image has them all, a strip has the rows of the image around it as well.
+static void subsampleRowRange(const uint8_t *const rgb, size_t const rgbStride, int64_t const sourceFirst,
+                              int64_t const sourceEnd, PlanarImage *const image, ChromaSampling const sampling,
+                              ChromaFilter const filter, uint32_t const firstRow, uint32_t const endRow,
+                              RowConverter const convert) {
+    uint32_t const yFactor = mcuBlocksY(sampling);
+    ChromaTaps const rowTaps = chromaTapsOf(filter, mcuBlocksX(sampling));
+    ChromaTaps const columnTaps = chromaTapsOf(filter, yFactor);
+    size_t const width = image->width;
+
+    // Full resolution row r lives in slot r % 4: the rows one chroma row reads are at most four
+    // consecutive ones, and the next chroma row reuses the last two of them. The sums come first in
+    // the allocation so they stay aligned whatever the width.
+    uint32_t *const sumRows = (uint32_t *) malloc(width * sizeof(uint32_t) * 2 + width * 9);
+    if (sumRows == NULL) {
+        perror("convertRowsSubsampled::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t *const sums[2] = {sumRows, sumRows + width};
+    uint8_t *const buffer = (uint8_t *) (sumRows + width * 2);
+    uint8_t *const spareY = buffer + width * 8;
+    // Strips read the row above them as row -1, so no row index marks an empty slot
+    int64_t slotRows[4] = {INT64_MIN, INT64_MIN, INT64_MIN, INT64_MIN};
+    // Luma rows of this range, rows around them only feed the filter
+    int64_t const ownFirst = (int64_t) firstRow * yFactor;
+    int64_t const ownEnd = (int64_t) endRow * yFactor;
+
+    for (uint32_t row = firstRow; row < endRow; ++row) {
+        int64_t const first = (int64_t) row * yFactor + columnTaps.offset;
+        memset(sums[0], 0, width * sizeof(uint32_t));
+        memset(sums[1], 0, width * sizeof(uint32_t));
+        for (uint32_t k = 0; k < columnTaps.count; ++k) {
+            int64_t const source = sourceFirst + clampIndex(first + k - sourceFirst, sourceEnd - sourceFirst);
+            uint32_t const slot = (uint32_t) (source & 3);
+            uint8_t *const cb = buffer + width * slot;
+            uint8_t *const cr = buffer + width * (4 + slot);
+            if (slotRows[slot] != source) {
+                uint8_t *const y = source >= ownFirst && source < ownEnd ?
+                                   planarRow(image, CHANNEL_Y, (uint32_t) source) : spareY;
+                convert(rgb + (ptrdiff_t) source * (ptrdiff_t) rgbStride, y, cb, cr, width);
+                slotRows[slot] = source;
+            }
+            uint32_t const weight = columnTaps.weights[k];
+            for (size_t x = 0; x < width; ++x) {
+                sums[0][x] += weight * cb[x];
+                sums[1][x] += weight * cr[x];
+            }
+        }
+        uint32_t const shift = rowTaps.shift + columnTaps.shift;
+        downsampleRow(sums[0], (int64_t) width, &rowTaps, shift, planarRow(image, CHANNEL_CB, row),
+                      image->chromaWidth);
+        downsampleRow(sums[1], (int64_t) width, &rowTaps, shift, planarRow(image, CHANNEL_CR, row),
+                      image->chromaWidth);
+    }
+    free(sumRows);
+}
+
+void convertRowsSubsampled(const uint8_t *const rgb, size_t const rgbStride, PlanarImage *const image,
+                           ChromaSampling const sampling, ChromaFilter const filter, uint32_t const firstRow,
+                           uint32_t const endRow, RowConverter const convert) {
+    subsampleRowRange(rgb, rgbStride, 0, image->height, image, sampling, filter, firstRow, endRow, convert);
+}
+
+void convertStripSubsampled(const uint8_t *const rgb, size_t const rgbStride, uint32_t const rowsAbove,
+                            uint32_t const rowsBelow, PlanarImage *const image, ChromaSampling const sampling,
+                            ChromaFilter const filter, uint32_t const firstRow, uint32_t const endRow,
+                            RowConverter const convert) {
+    subsampleRowRange(rgb, rgbStride, -(int64_t) rowsAbove, (int64_t) image->height + rowsBelow, image, sampling,
+                      filter, firstRow, endRow, convert);
+}
+
+void upsampleChromaRow(const PlanarImage *const image, ChromaSampling const sampling, uint32_t const channel,
+                       uint32_t const row, uint8_t *const out) {
+    int64_t const chromaWidth = image->chromaWidth;
+    // Chroma rows are weighted 3 (the nearest) and 1, and so are chroma columns, so the sum is scaled by 16
+    const uint8_t *nearRow = planarRow(image, channel, row);
+    const uint8_t *farRow = nearRow;
+    if (mcuBlocksY(sampling) == 2) {
+        int64_t const chromaRow = clampIndex(row / 2, image->chromaHeight);
+        nearRow = planarRow(image, channel, (uint32_t) chromaRow);
+        farRow = planarRow(image, channel, (uint32_t) clampIndex(chromaRow + (row % 2 == 0 ? -1 : 1),
+                                                                 image->chromaHeight));
+    }
+    for (uint32_t x = 0; x < image->width; ++x) {
+        int64_t const chroma = clampIndex(x / 2, chromaWidth);
+        int64_t const other = clampIndex(chroma + (x % 2 == 0 ? -1 : 1), chromaWidth);
+        uint32_t const nearColumn = 3u * nearRow[chroma] + farRow[chroma];
+        uint32_t const farColumn = 3u * nearRow[other] + farRow[other];
+        out[x] = (uint8_t) ((3 * nearColumn + farColumn + 8) >> 4);
+    }
+}
+
+uint64_t colorMismatchCount(ColorKernel const kernel) {
+    RowConverter const convert = selectRowConverter(kernel);
+    size_t const maxWidth = 131;
+    uint8_t rgb[3 * 131];
+    uint8_t expected[3][131], actual[3][131];
+    uint32_t seed = 0x9E3779B9u;
+    uint64_t mismatches = 0;
+    for (size_t width = 1; width <= maxWidth; ++width) {
+        for (size_t i = 0; i < 3 * width; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            rgb[i] = (uint8_t) (seed >> 24);
+        }
+        // Make sure the saturating corners are always exercised
+        if (width >= 3) {
+            memcpy(rgb, "\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF", 9);
+        }
+        convertRowScalar(rgb, expected[0], expected[1], expected[2], width);
+        convert(rgb, actual[0], actual[1], actual[2], width);
+        for (size_t c = 0; c < 3; ++c) {
+            for (size_t i = 0; i < width; ++i) {
+                mismatches += expected[c][i] != actual[c][i];
+            }
+        }
+    }
+    return mismatches;
+}
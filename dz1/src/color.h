@@ -0,0 +1,88 @@
+#ifndef DZ1_COLOR_H
+#define DZ1_COLOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+// Fixed-point JFIF RGB -> YCbCr with 14 fractional bits. Every kernel uses exactly the same integer
+// arithmetic, so scalar and SIMD results are bit-identical.
+#define COLOR_FIX_BITS 14
+
+// Converts "width" packed RGB pixels of one row into planar Y, Cb and Cr rows.
+typedef void (*RowConverter)(const uint8_t *rgb, uint8_t *y, uint8_t *cb, uint8_t *cr, size_t width);
+
+typedef enum {
+    COLOR_AUTO,
+    COLOR_SCALAR,
+    COLOR_SSSE3,
+    COLOR_AVX2
+} ColorKernel;
+
+void convertRowScalar(const uint8_t *rgb, uint8_t *y, uint8_t *cb, uint8_t *cr, size_t width);
+
+// Returns the requested kernel, or for COLOR_AUTO the fastest one the CPU supports. Kernels the
+// CPU (or compiler) does not support fall back to the scalar one.
+RowConverter selectRowConverter(ColorKernel kernel);
+
+const char *colorKernelName(ColorKernel kernel);
+
+// Returns 0 and sets *kernel when name is one of "auto", "scalar", "ssse3" or "avx2".
+int parseColorKernel(const char *name, ColorKernel *kernel);
+
+// Fixed-point JFIF YCbCr -> RGB of one row of planar samples into packed RGB, clamped to [0, 255].
+void convertRowToRGB(const uint8_t *y, const uint8_t *cb, const uint8_t *cr, uint8_t *rgb, size_t width);
+
+// Converts rows [firstRow, endRow) of a packed RGB image (rows rgbStride bytes apart) into the Y, Cb
+// and Cr planes of a three-channel planar image of the same size.
+void convertRowsToYCbCr(const uint8_t *rgb, size_t rgbStride, PlanarImage *image, uint32_t firstRow,
+                        uint32_t endRow, RowConverter convert);
+
+// Filter Cb and Cr are downsampled with. The box filter averages the samples an MCU chroma sample
+// covers; the triangle filter weighs them and their outer neighbours 1 3 3 1, which keeps edges
+// from aliasing at the cost of some sharpness.
+typedef enum {
+    CHROMA_BOX,
+    CHROMA_TRIANGLE
+} ChromaFilter;
+
+const char *chromaSamplingName(ChromaSampling sampling);
+
+// Returns 0 and sets *sampling when name is one of "444", "422" or "420".
+int parseChromaSampling(const char *name, ChromaSampling *sampling);
+
+const char *chromaFilterName(ChromaFilter filter);
+
+// Returns 0 and sets *filter when name is "box" or "triangle".
+int parseChromaFilter(const char *name, ChromaFilter *filter);
+
+// Converts a packed RGB image into an image made by createSubsampledPlanarImage(), for chroma rows
+// [firstRow, endRow) and the luma rows they cover. Every RGB row is converted once into a window
+// of full resolution Cb and Cr rows, which the chroma rows are filtered from, so the full
+// resolution chroma planes never exist. Rows and columns past the edges repeat the edge.
+void convertRowsSubsampled(const uint8_t *rgb, size_t rgbStride, PlanarImage *image, ChromaSampling sampling,
+                           ChromaFilter filter, uint32_t firstRow, uint32_t endRow, RowConverter convert);
+
+// Same for a horizontal strip of a taller image, with image holding the planes of the strip. The
+// rowsAbove rows before rgb and the rowsBelow rows after the strip are the image rows around it
+// (as many as exist, at most haloRowsOf()), so the filter sees what it sees in the whole image.
+void convertStripSubsampled(const uint8_t *rgb, size_t rgbStride, uint32_t rowsAbove, uint32_t rowsBelow,
+                            PlanarImage *image, ChromaSampling sampling, ChromaFilter filter, uint32_t firstRow,
+                            uint32_t endRow, RowConverter convert);
+
+// Full resolution rows the filter reads above and below the rows of the chroma rows it computes
+static inline uint32_t haloRowsOf(ChromaSampling const sampling, ChromaFilter const filter) {
+    return sampling == CHROMA_420 && filter == CHROMA_TRIANGLE ? 1 : 0;
+}
+
+// Interpolates a full resolution row (image->width samples) of a subsampled Cb or Cr plane, with
+// weights 3/4 and 1/4 from the two nearest chroma samples in each subsampled direction.
+void upsampleChromaRow(const PlanarImage *image, ChromaSampling sampling, uint32_t channel, uint32_t row,
+                       uint8_t *out);
+
+// Runs the selected kernel and the scalar kernel on pseudo-random rows of varying widths and
+// returns the number of samples that differ.
+uint64_t colorMismatchCount(ColorKernel kernel);
+
+#endif
@@ -1,266 +1,459 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "color.h"
+#include "dct.h"
+#include "encoder.h"
+#include "options.h"
+#include "output.h"
+#include "quantize.h"
+#include "threadpool.h"
+#include "trace.h"
+
+TRACE_COUNTER(imageCounter, "encode/image");
+
+void writeToFile(const BlockQuantized *const quantizedBlock, const char *const file) {
+    FILE *const fptr = fopen(file, "w");
+    if (fptr == NULL) {
+        perror("writeToFile::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        const int16_t *const channel = quantizedBlock->channels[c];
+        if (c != 0) {
+            fprintf(fptr, "\n");
+        }
+        for (size_t i = 0; i < BLOCK_DIM; ++i) {
+            for (size_t j = 0; j < BLOCK_DIM; ++j) {
+                fprintf(fptr, "%d%s", channel[i * BLOCK_DIM + j], j != BLOCK_DIM - 1 ? " " : "");
+            }
+            fprintf(fptr, "\n");
+        }
+    }
+    fclose(fptr);
+}
 
-#define BLOCK_DIM 8
-#define BLOCK_SIZE BLOCK_DIM * BLOCK_DIM
-
-#define Y_R_CONST 0.299
-#define Y_G_CONST 0.587
-#define Y_B_CONST 0.114
-
-#define Cb_R_CONST (-0.1687)
-#define Cb_G_CONST (-0.3313)
-#define Cb_B_CONST 0.5
-#define Cb_ADD_CONST 128
-
-#define Cr_R_CONST 0.5
-#define Cr_G_CONST (-0.4187)
-#define Cr_B_CONST (-0.0813)
-#define Cr_ADD_CONST 128
-
-#define SHIFT_CONST 128
-
-float const k1Table[BLOCK_SIZE] = {
-        16, 11, 10, 16, 24, 40, 51, 61,
-        12, 12, 14, 19, 26, 58, 60, 55,
-        14, 13, 16, 24, 40, 57, 69, 56,
-        14, 17, 22, 29, 51, 87, 80, 62,
-        18, 22, 37, 56, 68, 109, 103, 77,
-        24, 35, 55, 64, 81, 104, 113, 92,
-        49, 64, 78, 87, 103, 121, 120, 101,
-        72, 92, 95, 98, 112, 100, 103, 99
-};
-
-float const k2Table[BLOCK_SIZE] = {
-        17, 18, 24, 47, 99, 99, 99, 99,
-        18, 21, 26, 66, 99, 99, 99, 99,
-        24, 26, 56, 99, 99, 99, 99, 99,
-        47, 66, 99, 99, 99, 99, 99, 99,
-        99, 99, 99, 99, 99, 99, 99, 99,
-        99, 99, 99, 99, 99, 99, 99, 99,
-        99, 99, 99, 99, 99, 99, 99, 99,
-        99, 99, 99, 99, 99, 99, 99, 99
-};
-
-typedef struct {
-    uint8_t r, g, b;
-} PixelRGB;
-
-typedef struct {
-    float y, cb, cr;
-} PixelYCbCr;
-
-typedef struct {
-    int8_t y, cb, cr;
-} PixelYCbCrQuantized;
-
-typedef struct {
-    char *type;
-    uint16_t width, height, maxValue;
-    PixelRGB *pixels;
-} PPMImageRGB;
-
-void skipComments(FILE *const fptr) {
-    unsigned char c;
-    while ((c = getc(fptr)) == '#') {
-        while (getc(fptr) != '\n');
+// Subsampled chroma: the planes are converted up front, then the MCUs are encoded like blocks are
+void encodeMcusToOutput(const PPMImageRGB *const imageRGB, const EncoderOptions *const options, ThreadPool *const pool,
+                        BlockOutput *const output) {
+    uint32_t const mcuCount = mcuCountOf(imageRGB, options->sampling);
+    PlanarImage planes = convertImageToSubsampledPlanes(imageRGB, options->rowConverter, options->sampling,
+                                                        options->chromaFilter, pool);
+    if (pool == NULL) {
+        McuScratch scratch;
+        for (uint32_t i = 0; i < mcuCount; ++i) {
+            encodeMcu(&planes, options->sampling, i, options->dct, options->quantizer, &scratch);
+            writeEncodedMcu(output, &scratch.quantized);
+        }
+    } else {
+        McuQuantized *const mcus = (McuQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(McuQuantized) * mcuCount);
+        encodeImageMcus(&planes, options->sampling, options->dct, options->quantizer, pool, mcus);
+        for (uint32_t i = 0; i < mcuCount; ++i) {
+            writeEncodedMcu(output, mcus + i);
+        }
+        alignedFree(mcus);
     }
-    ungetc(c, fptr);
+    freePlanarImage(&planes);
 }
 
-PPMImageRGB parsePPMImageRGB(const char *const file) {
-    FILE *const fptr = fopen(file, "rb");
+void encodeImageToFile(const PPMImageRGB *const imageRGB, const EncoderOptions *const options,
+                       OutputFormat const format, const char *const file) {
+    FILE *const fptr = fopen(file, "wb");
     if (fptr == NULL) {
-        perror("parsePPMImageRGB::fopen()");
+        perror("encodeImageToFile::fopen()");
         exit(EXIT_FAILURE);
     }
+    TRACE_BEGIN(start);
 
-    // Parse "magic number"
-    char magicNumber[3];
-    if (fscanf(fptr, "%s ", magicNumber) != 1) {
-        perror("parsePPMImageRGB::magic number fscanf()");
-        exit(EXIT_FAILURE);
-    }
+    uint32_t const blockCount = blockCountOf(imageRGB);
+    int const subsampled = options->sampling != CHROMA_444;
+    uint32_t const unitCount = subsampled ? mcuCountOf(imageRGB, options->sampling) : blockCount;
+    BlockOutput output = beginOutput(format, fptr, imageRGB->width, imageRGB->height, options, unitCount);
 
-    // Skip all possible comments
-    skipComments(fptr);
+    ThreadPool *const pool = options->threadCount == 1 ? NULL : createThreadPool(options->threadCount);
 
-    // Parse width and height
-    uint16_t width, height;
-    if (fscanf(fptr, "%hu %hu ", &width, &height) != 2) {
-        perror("parsePPMImageRGB::width and height fscanf()");
-        exit(EXIT_FAILURE);
+    // Fixed-point colour conversion runs over whole rows before any block is encoded
+    PlanarImage planes = {0};
+    if (options->rowConverter != NULL && !subsampled) {
+        planes = convertImageToPlanes(imageRGB, options->rowConverter, pool);
+    }
+    const PlanarImage *const source = options->rowConverter != NULL && !subsampled ? &planes : NULL;
+
+    if (subsampled) {
+        encodeMcusToOutput(imageRGB, options, pool, &output);
+        if (pool != NULL) {
+            destroyThreadPool(pool);
+        }
+    } else if (pool == NULL) {
+        // Stream block by block, no buffer for the whole output is needed
+        BlockScratch scratch;
+        for (uint32_t i = 0; i < blockCount; ++i) {
+            encodeBlock(imageRGB, source, i, options->dct, options->quantizer, &scratch);
+            writeEncodedBlock(&output, &scratch.quantized);
+        }
+    } else {
+        BlockQuantized *const blocks = (BlockQuantized *) alignedAlloc(IMAGE_ALIGNMENT,
+                                                                        sizeof(BlockQuantized) * blockCount);
+        encodeImageBlocks(imageRGB, source, options->dct, options->quantizer, pool, blocks);
+        for (uint32_t i = 0; i < blockCount; ++i) {
+            writeEncodedBlock(&output, blocks + i);
+        }
+        alignedFree(blocks);
+        destroyThreadPool(pool);
     }
 
-    // Skip all possible comments
-    skipComments(fptr);
+    if (source != NULL) {
+        freePlanarImage(&planes);
+    }
+    endOutput(&output);
+    TRACE_END(imageCounter, start, (uint64_t) imageRGB->width * imageRGB->height * 3, unitCount);
 
-    // Parse max RGB value
-    uint16_t maxValue;
-    if (fscanf(fptr, "%hu ", &maxValue) != 1) {
-        perror("parsePPMImageRGB::max value fscanf()");
+    if (ferror(fptr)) {
+        perror("encodeImageToFile::fwrite()");
         exit(EXIT_FAILURE);
     }
+    fclose(fptr);
+}
 
-    // Skip all possible comments
-    skipComments(fptr);
-
-    // Parse data
-    uint32_t const size = width * height;
-    PixelRGB *const pixels = (PixelRGB *) malloc(sizeof(PixelRGB) * size);
-    if (fread(pixels, sizeof(PixelRGB), size, fptr) != size) {
-        perror("parsePPMImageRGB::fread()");
+// Same output as encodeImageToFile(), but the image is read and encoded one strip of block (or MCU)
+// rows at a time, so only O(width) of it is ever in memory
+void encodeStripsToFile(const char *const inFile, const EncoderOptions *const options, OutputFormat const format,
+                        const char *const file) {
+    StripEncoder encoder = openStripEncoder(inFile, options);
+    FILE *const fptr = fopen(file, "wb");
+    if (fptr == NULL) {
+        perror("encodeStripsToFile::fopen()");
         exit(EXIT_FAILURE);
     }
+    TRACE_BEGIN(start);
+
+    uint32_t const unitCount = encoder.unitsPerStrip * encoder.stripCount;
+    BlockOutput output = beginOutput(format, fptr, encoder.width, encoder.height, options, unitCount);
+    ThreadPool *const pool = options->threadCount == 1 ? NULL : createThreadPool(options->threadCount);
+    while (encodeNextStrip(&encoder, pool)) {
+        for (uint32_t i = 0; i < encoder.unitsPerStrip; ++i) {
+            if (options->sampling != CHROMA_444) {
+                writeEncodedMcu(&output, encoder.mcus + i);
+            } else {
+                writeEncodedBlock(&output, encoder.blocks + i);
+            }
+        }
+    }
+    if (pool != NULL) {
+        destroyThreadPool(pool);
+    }
+    endOutput(&output);
+    TRACE_END(imageCounter, start, (uint64_t) encoder.width * encoder.height * 3, unitCount);
 
+    if (ferror(fptr)) {
+        perror("encodeStripsToFile::fwrite()");
+        exit(EXIT_FAILURE);
+    }
     fclose(fptr);
-    return (PPMImageRGB) {.type=magicNumber, .width=width, .height=height, .maxValue=maxValue, .pixels=pixels};
+    closeStripEncoder(&encoder);
 }
 
-PixelRGB *retrieveRGBBlock(const PPMImageRGB *const imageRGB, uint32_t const blockNumber) {
-    const PixelRGB *const pixels = imageRGB->pixels;
-    PixelRGB *const blockRGB = (PixelRGB *) malloc(sizeof(PixelRGB) * BLOCK_SIZE);
-    uint32_t const xBlockCount = imageRGB->width / BLOCK_DIM;
-    uint32_t const yBlockCount = imageRGB->height / BLOCK_DIM;
-    uint32_t const yOffset = blockNumber / yBlockCount * BLOCK_DIM * imageRGB->width;
-    uint32_t const xOffset = blockNumber % xBlockCount * BLOCK_DIM;
-    for (size_t i = 0, y = yOffset, counter = 0; i < BLOCK_DIM; ++i, y += imageRGB->width) {
-        for (size_t j = 0, x = xOffset; j < BLOCK_DIM; ++j, ++x) {
-            blockRGB[counter++] = pixels[y + x];
+int checkDct(void) {
+    // Coefficients are quantized with steps of at least 10, so this is far below anything visible
+    double const tolerance = 1e-3;
+    DctKind const kinds[] = {DCT_SEPARABLE, DCT_AAN};
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+        double const error = dctMaxError(kinds[i], 1000);
+        int const ok = error <= tolerance;
+        fprintf(stdout, "dct %-10s max error %e %s\n", dctName(kinds[i]), error, ok ? "OK" : "FAIL");
+        if (!ok) {
+            status = EXIT_FAILURE;
         }
     }
-    return blockRGB;
+    return status;
 }
 
-PixelYCbCr *fromRGBToYCbCr(const PixelRGB *const blockRGB) {
-    PixelYCbCr *const blockYCbCr = (PixelYCbCr *) malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
-    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-        PixelRGB const pixelRGB = blockRGB[i];
-        float const y = Y_R_CONST * pixelRGB.r + Y_G_CONST * pixelRGB.g + Y_B_CONST * pixelRGB.b;
-        float const cb = Cb_R_CONST * pixelRGB.r + Cb_G_CONST * pixelRGB.g + Cb_B_CONST * pixelRGB.b + Cb_ADD_CONST;
-        float const cr = Cr_R_CONST * pixelRGB.r + Cr_G_CONST * pixelRGB.g + Cr_B_CONST * pixelRGB.b + Cr_ADD_CONST;
-        blockYCbCr[i] = (PixelYCbCr) {.y=y, .cb=cb, .cr=cr};
+int checkIdct(void) {
+    // Far below the half a grey level the decoder rounds away
+    double const tolerance = 1e-3;
+    double const error = idctMaxError(1000);
+    int const ok = error <= tolerance;
+    fprintf(stdout, "idct %-9s max error %e %s\n", "separable", error, ok ? "OK" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int checkColor(void) {
+    ColorKernel const kernels[] = {COLOR_AUTO, COLOR_SSSE3, COLOR_AVX2};
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        uint64_t const mismatches = colorMismatchCount(kernels[i]);
+        fprintf(stdout, "color %-8s %llu mismatches %s\n", colorKernelName(kernels[i]),
+                (unsigned long long) mismatches, mismatches == 0 ? "OK" : "FAIL");
+        if (mismatches != 0) {
+            status = EXIT_FAILURE;
+        }
     }
-    return blockYCbCr;
+    return status;
 }
 
-void shiftBlockYCbCr(PixelYCbCr *const blockYCbCr) {
-    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-        PixelYCbCr *const pixel = blockYCbCr + i;
-        pixel->y -= SHIFT_CONST;
-        pixel->cb -= SHIFT_CONST;
-        pixel->cr -= SHIFT_CONST;
+int checkQuantizer(void) {
+    QuantKernel const kernels[] = {QUANT_AUTO, QUANT_SCALAR, QUANT_SSE41, QUANT_AVX2};
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        uint64_t const mismatches = quantMismatchCount(kernels[i]);
+        fprintf(stdout, "quantize %-8s %llu mismatches %s\n", quantKernelName(kernels[i]),
+                (unsigned long long) mismatches, mismatches == 0 ? "OK" : "FAIL");
+        if (mismatches != 0) {
+            status = EXIT_FAILURE;
+        }
     }
+    return status;
 }
 
-PixelYCbCr *dctOnBlockYCbCr(PixelYCbCr *const blockYCbCr) {
-    float const cSqrt = 1 / (float) sqrt(2);
-    PixelYCbCr *const dctBlock = (PixelYCbCr *) malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
-    for (size_t u = 0; u < BLOCK_DIM; ++u) {
-        float const cu = u == 0 ? cSqrt : 1;
-        for (size_t v = 0; v < BLOCK_DIM; ++v) {
-            float const cv = v == 0 ? cSqrt : 1;
-            float tmpY = 0, tmpCb = 0, tmpCr = 0;
-            for (size_t i = 0; i < BLOCK_DIM; ++i) {
-                for (size_t j = 0; j < BLOCK_DIM; ++j) {
-                    float const common = (float) (cos((2 * i + 1) * u * M_PI / 16) * cos((2 * j + 1) * v * M_PI / 16));
-                    PixelYCbCr const block = blockYCbCr[i * BLOCK_DIM + j];
-                    tmpY += block.y * common;
-                    tmpCb += block.cb * common;
-                    tmpCr += block.cr * common;
+// Compares every fast kernel with its reference implementation
+int check(void) {
+    int status = EXIT_SUCCESS;
+    if (checkDct() != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    if (checkIdct() != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    if (checkColor() != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    if (checkQuantizer() != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+void printUsage(const char *const program) {
+    fprintf(stderr, "Usage: %s [-d reference|separable|aan] [-c float|auto|scalar|ssse3|avx2] [-t threads] "
+                    "[-q quality] [-Q tables.txt] [-f masq|jpeg] [-s 444|422|420] [-F box|triangle] [-j summary.json] "
+                    "[-T trace.json] [-S] image.ppm block|all output\n"
+                    "       %s [options] -B output-dir [-R readers] [-W writers] image.ppm|dir...\n"
+                    "       %s --check\n"
+                    "Program expects path to some .ppm image file, block number (or 'all' for the whole image) "
+                    "and output file! Colour conversion other than 'float' runs in fixed point over whole rows "
+                    "(whole image mode only). Thread count 0 uses every CPU. Quality (1-100, default 50) scales the "
+                    "standard quantisation tables, -Q reads 128 steps (luma, then chroma) instead. Whole images are "
+                    "written as a raw coefficient stream (masq) or a baseline JFIF file (jpeg). -s 422 and 420 "
+                    "halve the chroma resolution horizontally (and vertically) with a box (default) or triangle "
+                    "filter and encode whole MCUs; they always convert colours in fixed point (float means auto "
+                    "there). -S reads and encodes the image one strip of 8 (16 with 420) rows at a time, "
+                    "for images too large to keep in memory; image.ppm may then be - for stdin. In builds with "
+                    "MAS_TRACE, -j writes the time, calls and bytes of every encoder stage of a whole image as JSON "
+                    "and -T a Chrome trace of every call. Batch mode encodes every image (and every .ppm file of "
+                    "every directory) into output-dir: readers (default 1) load images ahead, the thread pool "
+                    "encodes them and writers (default 2) code and write them, with bounded queues between.\n",
+            program, program, program);
+}
+
+int main(int32_t const argc, char *const argv[]) {
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
+    }
+
+    DctKind dctKind = DCT_DEFAULT;
+    EncoderOptions options = {
+            .rowConverter=NULL, .threadCount=1, .sampling=CHROMA_444, .chromaFilter=CHROMA_BOX};
+    uint32_t quality = 50;
+    const char *tablesFile = NULL;
+    OutputFormat format = OUTPUT_MASQ;
+    const char *summaryFile = NULL;
+    const char *chromeFile = NULL;
+    int strips = 0;
+    const char *batchDirectory = NULL;
+    BatchOptions batch = {.readerCount=1, .writerCount=2, .queueDepth=4};
+    int option;
+    while ((option = getopt(argc, argv, "d:c:t:q:Q:f:s:F:j:T:SB:R:W:")) != -1) {
+        switch (option) {
+            case 'd':
+                if (parseDctKind(optarg, &dctKind) != 0) {
+                    fprintf(stderr, "Unknown DCT kernel '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c': {
+                ColorKernel kernel;
+                if (strcmp(optarg, "float") == 0) {
+                    options.rowConverter = NULL;
+                } else if (parseColorKernel(optarg, &kernel) == 0) {
+                    options.rowConverter = selectRowConverter(kernel);
+                } else {
+                    fprintf(stderr, "Unknown colour conversion '%s'!\n", optarg);
+                    return EXIT_FAILURE;
                 }
+                break;
             }
-            PixelYCbCr *const block = dctBlock + u * BLOCK_DIM + v;
-            block->y = 0.25f * cu * cv * tmpY;
-            block->cb = 0.25f * cu * cv * tmpCb;
-            block->cr = 0.25f * cu * cv * tmpCr;
+            case 't':
+                if (parseUint32Option(optarg, 0, THREAD_COUNT_MAX, &options.threadCount) != 0) {
+                    fprintf(stderr, "Thread count must be in [0, %u]!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'q':
+                if (parseUint32Option(optarg, 1, 100, &quality) != 0) {
+                    fprintf(stderr, "Quality must be in [1, 100]!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'Q':
+                tablesFile = optarg;
+                break;
+            case 'f':
+                if (parseOutputFormat(optarg, &format) != 0) {
+                    fprintf(stderr, "Unknown output format '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                if (parseChromaSampling(optarg, &options.sampling) != 0) {
+                    fprintf(stderr, "Unknown chroma sampling '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'F':
+                if (parseChromaFilter(optarg, &options.chromaFilter) != 0) {
+                    fprintf(stderr, "Unknown chroma filter '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                strips = 1;
+                break;
+            case 'B':
+                batchDirectory = optarg;
+                break;
+            case 'R':
+                if (parseUint32Option(optarg, 1, THREAD_COUNT_MAX, &batch.readerCount) != 0) {
+                    fprintf(stderr, "Reader count must be in [1, %u]!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'W':
+                if (parseUint32Option(optarg, 1, THREAD_COUNT_MAX, &batch.writerCount) != 0) {
+                    fprintf(stderr, "Writer count must be in [1, %u]!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                summaryFile = optarg;
+                break;
+            case 'T':
+                chromeFile = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
         }
     }
-    return dctBlock;
-}
 
-PixelYCbCrQuantized *quantizeBlock(const PixelYCbCr *const block) {
-    PixelYCbCrQuantized *const quantizedBlock = (PixelYCbCrQuantized *)
-            malloc(sizeof(PixelYCbCrQuantized) * BLOCK_SIZE);
-    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-        PixelYCbCr const pixel = block[i];
-        quantizedBlock[i] = (PixelYCbCrQuantized) {
-                .y = (int8_t) round((double) pixel.y / (double) k1Table[i]),
-                .cb = (int8_t) round((double) pixel.cb / (double) k2Table[i]),
-                .cr = (int8_t) round((double) pixel.cr / (double) k2Table[i])};
+    if (batchDirectory != NULL ? argc - optind < 1 : argc - optind != 3) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (batchDirectory != NULL && strips) {
+        fprintf(stderr, "Strip mode (-S) cannot be combined with batch mode (-B)!\n");
+        return EXIT_FAILURE;
     }
-    return quantizedBlock;
-}
 
-void writeToFile(const PixelYCbCrQuantized *const quantizedPixels, const char *const file) {
-    FILE *const fptr = fopen(file, "w");
-    if (fptr == NULL) {
-        perror("writeToFile::fopen()");
-        exit(EXIT_FAILURE);
+    uint8_t luma[BLOCK_SIZE], chroma[BLOCK_SIZE];
+    if (tablesFile != NULL) {
+        readQuantValues(tablesFile, luma, chroma);
+    } else {
+        scaleQuantValues(lumaQuantValues, quality, luma);
+        scaleQuantValues(chromaQuantValues, quality, chroma);
     }
-    for (size_t i = 0; i < BLOCK_DIM; ++i) {
-        for (size_t j = 0; j < BLOCK_DIM; ++j) {
-            fprintf(fptr, "%d%s", quantizedPixels[i * BLOCK_DIM + j].y, j != BLOCK_DIM - 1 ? " " : "");
+    Quantizer quantizer;
+    initQuantizer(&quantizer, luma, chroma, selectQuantizer(QUANT_AUTO));
+    options.quantizer = &quantizer;
+
+    // Batch mode, every input image goes to its own file in the output directory
+    if (batchDirectory != NULL) {
+        options.dct = selectDct(dctKind);
+        if (options.sampling != CHROMA_444 && options.rowConverter == NULL) {
+            options.rowConverter = selectRowConverter(COLOR_AUTO);
         }
-        fprintf(fptr, "\n");
+        traceStart(summaryFile, chromeFile);
+        BatchStats const stats = encodeBatch(argv + optind, (uint32_t) (argc - optind), batchDirectory, &options,
+                                             format, &batch);
+        traceFinish();
+        double const megabytes = (double) stats.pixelBytes / 1e6;
+        fprintf(stdout, "batch: %u images, %.1f MB in %.3f s, %.1f MB/s\n", stats.imageCount, megabytes,
+                stats.seconds, stats.seconds > 0 ? megabytes / stats.seconds : 0.0);
+        // The busiest stage per thread is the one that sets the throughput
+        fprintf(stdout, "busy: read %.3f s (%u threads), encode %.3f s, write %.3f s (%u threads)\n",
+                stats.readSeconds, batch.readerCount, stats.encodeSeconds, stats.writeSeconds, batch.writerCount);
+        return EXIT_SUCCESS;
     }
-    fprintf(fptr, "\n");
-    for (size_t i = 0; i < BLOCK_DIM; ++i) {
-        for (size_t j = 0; j < BLOCK_DIM; ++j) {
-            fprintf(fptr, "%d%s", quantizedPixels[i * BLOCK_DIM + j].cb, j != BLOCK_DIM - 1 ? " " : "");
+
+    const char *const inFile = argv[optind];
+    const char *const blockArg = argv[optind + 1];
+    const char *const outFile = argv[optind + 2];
+
+    int const wholeImage = strcmp(blockArg, "all") == 0;
+    if (wholeImage) {
+        options.dct = selectDct(dctKind);
+        if (options.sampling != CHROMA_444 && options.rowConverter == NULL) {
+            options.rowConverter = selectRowConverter(COLOR_AUTO);
         }
-        fprintf(fptr, "\n");
     }
-    fprintf(fptr, "\n");
-    for (size_t i = 0; i < BLOCK_DIM; ++i) {
-        for (size_t j = 0; j < BLOCK_DIM; ++j) {
-            fprintf(fptr, "%d%s", quantizedPixels[i * BLOCK_DIM + j].cr, j != BLOCK_DIM - 1 ? " " : "");
+    // Strip mode never holds the whole image
+    if (strips) {
+        if (!wholeImage) {
+            fprintf(stderr, "Strip mode (-S) encodes whole images only!\n");
+            return EXIT_FAILURE;
         }
-        fprintf(fptr, "\n");
+        traceStart(summaryFile, chromeFile);
+        encodeStripsToFile(inFile, &options, format, outFile);
+        traceFinish();
+        return EXIT_SUCCESS;
     }
-    fclose(fptr);
-}
 
-int main(int32_t const argc, const char *const argv[]) {
-    if (argc != (1 + 3)) {
-        fprintf(stderr, "Program expects path to some .ppm image file, block number and output file!\n");
-        return EXIT_FAILURE;
+    // Load image
+    PPMImageRGB imageRGB = parsePPMImageRGB(inFile);
+
+    // Whole image mode, every block goes to one binary coefficient stream
+    if (wholeImage) {
+        traceStart(summaryFile, chromeFile);
+        encodeImageToFile(&imageRGB, &options, format, outFile);
+        traceFinish();
+        freePPMImageRGB(&imageRGB);
+        return EXIT_SUCCESS;
     }
 
-    const char *const inFile = argv[1];
-    uint32_t const blockNumber = atoi(argv[2]);
-    const char *const outFile = argv[3];
-
-    // Load image
-    PPMImageRGB const imageRGB = parsePPMImageRGB(inFile);
+    // Block mode encodes one whole block, so the image needs at least one
+    uint32_t const blockCount = blockCountOf(&imageRGB);
+    if (blockCount == 0) {
+        fprintf(stderr, "%s: image is smaller than one %dx%d block!\n", inFile, BLOCK_DIM, BLOCK_DIM);
+        return EXIT_FAILURE;
+    }
+    uint32_t blockNumber;
+    if (parseUint32Option(blockArg, 0, blockCount - 1, &blockNumber) != 0) {
+        fprintf(stderr, "Block number must be 'all' or in [0, %u]!\n", blockCount - 1);
+        return EXIT_FAILURE;
+    }
+    BlockScratch scratch;
 
     // Retrieve RGB block
-    PixelRGB *const blockRGB = retrieveRGBBlock(&imageRGB, blockNumber);
+    retrieveRGBBlockInto(&imageRGB, blockNumber, scratch.rgb);
     // Free not needed memory...
-    free(imageRGB.pixels);
+    freePPMImageRGB(&imageRGB);
 
     // Transform from RGB to YCbCr
-    PixelYCbCr *const blockYCbCr = fromRGBToYCbCr(blockRGB);
-    // Free not needed memory...
-    free(blockRGB);
+    fromRGBToYCbCrInto(scratch.rgb, &scratch.yCbCr);
 
     // Shift pixels by 128
-    shiftBlockYCbCr(blockYCbCr);
+    shiftBlockYCbCr(&scratch.yCbCr);
 
     // Apply DCT
-    PixelYCbCr *const dctBlock = dctOnBlockYCbCr(blockYCbCr);
-    // Free not needed memory...
-    free(blockYCbCr);
+    dctOnBlockYCbCrInto(&scratch.yCbCr, selectDct(dctKind), &scratch.dct);
 
     // Apply quantization
-    PixelYCbCrQuantized *const quantizedPixels = quantizeBlock(dctBlock);
-    // Free not needed memory...
-    free(dctBlock);
-
-    writeToFile(quantizedPixels, outFile);
+    quantizeBlockInto(&scratch.dct, &quantizer, &scratch.quantized);
 
-    free(quantizedPixels);
+    writeToFile(&scratch.quantized, outFile);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,256 @@
+#include "dct.h"
+
+#include <math.h>
+#include <string.h>
+
+// cosTable[u][i] = c(u) / 2 * cos((2i + 1) * u * PI / 16), where c(0) = 1 / sqrt(2) and c(u) = 1 otherwise.
+// The 1/4 * c(u) * c(v) factor of the 2D transform is split evenly between the row and the column pass.
+static float const cosTable[DCT_DIM][DCT_DIM] = {
+        {0.353553391f, 0.353553391f,  0.353553391f,  0.353553391f,  0.353553391f,  0.353553391f,  0.353553391f,  0.353553391f},
+        {0.490392640f, 0.415734806f,  0.277785117f,  0.097545161f,  -0.097545161f, -0.277785117f, -0.415734806f, -0.490392640f},
+        {0.461939766f, 0.191341716f,  -0.191341716f, -0.461939766f, -0.461939766f, -0.191341716f, 0.191341716f,  0.461939766f},
+        {0.415734806f, -0.097545161f, -0.490392640f, -0.277785117f, 0.277785117f,  0.490392640f,  0.097545161f,  -0.415734806f},
+        {0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f,  0.353553391f,  -0.353553391f, -0.353553391f, 0.353553391f},
+        {0.277785117f, -0.490392640f, 0.097545161f,  0.415734806f,  -0.415734806f, -0.097545161f, 0.490392640f,  -0.277785117f},
+        {0.191341716f, -0.461939766f, 0.461939766f,  -0.191341716f, -0.191341716f, 0.461939766f,  -0.461939766f, 0.191341716f},
+        {0.097545161f, -0.277785117f, 0.415734806f,  -0.490392640f, 0.490392640f,  -0.415734806f, 0.277785117f,  -0.097545161f}
+};
+
+// Transpose of cosTable, cosTableT[i][u] = cosTable[u][i].
+static float const cosTableT[DCT_DIM][DCT_DIM] = {
+        {0.353553391f, 0.490392640f,  0.461939766f,  0.415734806f,  0.353553391f,  0.277785117f,  0.191341716f,  0.097545161f},
+        {0.353553391f, 0.415734806f,  0.191341716f,  -0.097545161f, -0.353553391f, -0.490392640f, -0.461939766f, -0.277785117f},
+        {0.353553391f, 0.277785117f,  -0.191341716f, -0.490392640f, -0.353553391f, 0.097545161f,  0.461939766f,  0.415734806f},
+        {0.353553391f, 0.097545161f,  -0.461939766f, -0.277785117f, 0.353553391f,  0.415734806f,  -0.191341716f, -0.490392640f},
+        {0.353553391f, -0.097545161f, -0.461939766f, 0.277785117f,  0.353553391f,  -0.415734806f, -0.191341716f, 0.490392640f},
+        {0.353553391f, -0.277785117f, -0.191341716f, 0.490392640f,  -0.353553391f, -0.097545161f, 0.461939766f,  -0.415734806f},
+        {0.353553391f, -0.415734806f, 0.191341716f,  0.097545161f,  -0.353553391f, 0.490392640f,  -0.461939766f, 0.277785117f},
+        {0.353553391f, -0.490392640f, 0.461939766f,  -0.415734806f, 0.353553391f,  -0.277785117f, 0.191341716f,  -0.097545161f}
+};
+
+// AAN leaves coefficient (u, v) multiplied by 8 * s(u) * s(v), where s(0) = 1 and s(k) = sqrt(2) * cos(k * PI / 16).
+// This table holds the reciprocals of those factors.
+static float const aanScaleTable[DCT_SIZE] = {
+        0.125000000f, 0.090119978f, 0.095670858f, 0.106303762f, 0.125000000f, 0.159094823f, 0.230969883f, 0.453063723f,
+        0.090119978f, 0.064972883f, 0.068974845f, 0.076640741f, 0.090119978f, 0.114700975f, 0.166520006f, 0.326640741f,
+        0.095670858f, 0.068974845f, 0.073223305f, 0.081361377f, 0.095670858f, 0.121765906f, 0.176776695f, 0.346759961f,
+        0.106303762f, 0.076640741f, 0.081361377f, 0.090403918f, 0.106303762f, 0.135299025f, 0.196423740f, 0.385299025f,
+        0.125000000f, 0.090119978f, 0.095670858f, 0.106303762f, 0.125000000f, 0.159094823f, 0.230969883f, 0.453063723f,
+        0.159094823f, 0.114700975f, 0.121765906f, 0.135299025f, 0.159094823f, 0.202489301f, 0.293968901f, 0.576640741f,
+        0.230969883f, 0.166520006f, 0.176776695f, 0.196423740f, 0.230969883f, 0.293968901f, 0.426776695f, 0.837152602f,
+        0.453063723f, 0.326640741f, 0.346759961f, 0.385299025f, 0.453063723f, 0.576640741f, 0.837152602f, 1.642133898f
+};
+
+void dctReference(const float *const src, size_t const step, float *const dst, size_t const dstStep) {
+    float const cSqrt = 1 / (float) sqrt(2);
+    for (size_t u = 0; u < DCT_DIM; ++u) {
+        float const cu = u == 0 ? cSqrt : 1;
+        for (size_t v = 0; v < DCT_DIM; ++v) {
+            float const cv = v == 0 ? cSqrt : 1;
+            float tmp = 0;
+            for (size_t i = 0; i < DCT_DIM; ++i) {
+                for (size_t j = 0; j < DCT_DIM; ++j) {
+                    float const common = (float) (cos((2 * i + 1) * u * M_PI / 16) * cos((2 * j + 1) * v * M_PI / 16));
+                    tmp += src[(i * DCT_DIM + j) * step] * common;
+                }
+            }
+            dst[(u * DCT_DIM + v) * dstStep] = 0.25f * cu * cv * tmp;
+        }
+    }
+}
+
+// out = a * b for 8x8 matrices. The innermost loop runs along rows of b and out, which are
+// contiguous, so it maps directly onto 8-wide vector multiply-adds.
+static void multiply8x8(const float *const a, const float *const b, float *const out) {
+    for (size_t r = 0; r < DCT_DIM; ++r) {
+        float row[DCT_DIM] = {0};
+        for (size_t k = 0; k < DCT_DIM; ++k) {
+            float const factor = a[r * DCT_DIM + k];
+            for (size_t c = 0; c < DCT_DIM; ++c) {
+                row[c] += factor * b[k * DCT_DIM + c];
+            }
+        }
+        memcpy(out + r * DCT_DIM, row, sizeof(row));
+    }
+}
+
+void dctSeparable(const float *const src, size_t const step, float *const dst, size_t const dstStep) {
+    float block[DCT_SIZE], columns[DCT_SIZE], result[DCT_SIZE];
+    const float *input = src;
+    if (step != 1) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            block[i] = src[i * step];
+        }
+        input = block;
+    }
+
+    // F = C * X * C^T, first the 1D DCT of every column, then of every row
+    multiply8x8(&cosTable[0][0], input, columns);
+    multiply8x8(columns, &cosTableT[0][0], dstStep == 1 ? dst : result);
+
+    if (dstStep != 1) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            dst[i * dstStep] = result[i];
+        }
+    }
+}
+
+void idctSeparable(const float *const src, size_t const step, float *const dst, size_t const dstStep) {
+    float block[DCT_SIZE], columns[DCT_SIZE], result[DCT_SIZE];
+    const float *input = src;
+    if (step != 1) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            block[i] = src[i * step];
+        }
+        input = block;
+    }
+
+    // C is orthonormal, so the inverse is its transpose: X = C^T * F * C
+    multiply8x8(&cosTableT[0][0], input, columns);
+    multiply8x8(columns, &cosTable[0][0], dstStep == 1 ? dst : result);
+
+    if (dstStep != 1) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            dst[i * dstStep] = result[i];
+        }
+    }
+}
+
+// One 8-point AAN butterfly. Reads d[0], d[stride], ..., d[7 * stride] and writes the scaled
+// outputs back in place.
+static void aanPass(float *const d, size_t const stride) {
+    float const tmp0 = d[0] + d[7 * stride];
+    float const tmp7 = d[0] - d[7 * stride];
+    float const tmp1 = d[stride] + d[6 * stride];
+    float const tmp6 = d[stride] - d[6 * stride];
+    float const tmp2 = d[2 * stride] + d[5 * stride];
+    float const tmp5 = d[2 * stride] - d[5 * stride];
+    float const tmp3 = d[3 * stride] + d[4 * stride];
+    float const tmp4 = d[3 * stride] - d[4 * stride];
+
+    // Even part
+    float const tmp10 = tmp0 + tmp3;
+    float const tmp13 = tmp0 - tmp3;
+    float const tmp11 = tmp1 + tmp2;
+    float const tmp12 = tmp1 - tmp2;
+
+    d[0] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+
+    float const z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    // Odd part
+    float const odd10 = tmp4 + tmp5;
+    float const odd11 = tmp5 + tmp6;
+    float const odd12 = tmp6 + tmp7;
+
+    float const z5 = (odd10 - odd12) * 0.382683433f;
+    float const z2 = 0.541196100f * odd10 + z5;
+    float const z4 = 1.306562965f * odd12 + z5;
+    float const z3 = odd11 * 0.707106781f;
+
+    float const z11 = tmp7 + z3;
+    float const z13 = tmp7 - z3;
+
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+void dctAAN(const float *const src, size_t const step, float *const dst, size_t const dstStep) {
+    float data[DCT_SIZE];
+    for (size_t i = 0; i < DCT_SIZE; ++i) {
+        data[i] = src[i * step];
+    }
+    for (size_t i = 0; i < DCT_DIM; ++i) {
+        aanPass(data + i * DCT_DIM, 1);
+    }
+    for (size_t j = 0; j < DCT_DIM; ++j) {
+        aanPass(data + j, DCT_DIM);
+    }
+    for (size_t i = 0; i < DCT_SIZE; ++i) {
+        dst[i * dstStep] = data[i] * aanScaleTable[i];
+    }
+}
+
+DctFunction selectDct(DctKind const kind) {
+    switch (kind) {
+        case DCT_REFERENCE:
+            return dctReference;
+        case DCT_AAN:
+            return dctAAN;
+        case DCT_SEPARABLE:
+        default:
+            return dctSeparable;
+    }
+}
+
+const char *dctName(DctKind const kind) {
+    switch (kind) {
+        case DCT_REFERENCE:
+            return "reference";
+        case DCT_AAN:
+            return "aan";
+        case DCT_SEPARABLE:
+        default:
+            return "separable";
+    }
+}
+
+int parseDctKind(const char *const name, DctKind *const kind) {
+    DctKind const kinds[] = {DCT_REFERENCE, DCT_SEPARABLE, DCT_AAN};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+        if (strcmp(name, dctName(kinds[i])) == 0) {
+            *kind = kinds[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+double dctMaxError(DctKind const kind, uint32_t const trials) {
+    DctFunction const dct = selectDct(kind);
+    float block[DCT_SIZE], expected[DCT_SIZE], actual[DCT_SIZE];
+    uint32_t seed = 0x2545F491u;
+    double maxError = 0.0;
+    for (uint32_t t = 0; t < trials; ++t) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            // Same range as level-shifted 8-bit samples, [-128, 127]
+            block[i] = (float) (seed >> 24) - 128;
+        }
+        dctReference(block, 1, expected, 1);
+        dct(block, 1, actual, 1);
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            double const error = fabs((double) expected[i] - (double) actual[i]);
+            if (error > maxError) {
+                maxError = error;
+            }
+        }
+    }
+    return maxError;
+}
+
+double idctMaxError(uint32_t const trials) {
+    float block[DCT_SIZE], coefficients[DCT_SIZE], restored[DCT_SIZE];
+    uint32_t seed = 0x68E31DA4u;
+    double maxError = 0.0;
+    for (uint32_t t = 0; t < trials; ++t) {
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            block[i] = (float) (seed >> 24) - 128;
+        }
+        dctReference(block, 1, coefficients, 1);
+        idctSeparable(coefficients, 1, restored, 1);
+        for (size_t i = 0; i < DCT_SIZE; ++i) {
+            double const error = fabs((double) block[i] - (double) restored[i]);
+            if (error > maxError) {
+                maxError = error;
+            }
+        }
+    }
+    return maxError;
+}
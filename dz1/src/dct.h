@@ -0,0 +1,51 @@
+#ifndef DZ1_DCT_H
+#define DZ1_DCT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DCT_DIM 8
+#define DCT_SIZE (DCT_DIM * DCT_DIM)
+
+// Forward 8x8 DCT over one channel. "step" is the distance (in floats) between two horizontally
+// neighbouring samples, so the same kernel works on interleaved and planar blocks. Rows are
+// DCT_DIM * step floats apart. The output is written with the same layout into dst, which must not
+// overlap src.
+typedef void (*DctFunction)(const float *src, size_t step, float *dst, size_t dstStep);
+
+typedef enum {
+    DCT_REFERENCE,
+    DCT_SEPARABLE,
+    DCT_AAN
+} DctKind;
+
+#define DCT_DEFAULT DCT_SEPARABLE
+
+// Direct O(N^4) evaluation of the DCT-II definition, kept as the accuracy reference.
+void dctReference(const float *src, size_t step, float *dst, size_t dstStep);
+
+// Row/column separable transform, computed as C * X * C^T with precomputed cosine tables (O(N^3)).
+void dctSeparable(const float *src, size_t step, float *dst, size_t dstStep);
+
+// Arai-Agui-Nakajima butterfly factorisation with a precomputed output scaling table.
+void dctAAN(const float *src, size_t step, float *dst, size_t dstStep);
+
+// Inverse of dctSeparable, X = C^T * F * C. Same layout conventions as the forward kernels.
+void idctSeparable(const float *src, size_t step, float *dst, size_t dstStep);
+
+DctFunction selectDct(DctKind kind);
+
+const char *dctName(DctKind kind);
+
+// Returns 0 and sets *kind when name is one of "reference", "separable" or "aan".
+int parseDctKind(const char *name, DctKind *kind);
+
+// Runs the selected kernel and the reference kernel on "trials" pseudo-random level-shifted blocks
+// and returns the largest absolute coefficient difference.
+double dctMaxError(DctKind kind, uint32_t trials);
+
+// Runs the reference DCT followed by idctSeparable on "trials" pseudo-random level-shifted blocks and
+// returns the largest absolute difference from the original samples.
+double idctMaxError(uint32_t trials);
+
+#endif
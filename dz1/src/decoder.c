@@ -0,0 +1,223 @@
+#include "decoder.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHIFT_CONST 128
+
+void initDequantizer(Dequantizer *const dequantizer, const uint8_t *const luma, const uint8_t *const chroma) {
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        dequantizer->steps[QUANT_LUMA][i] = luma[i];
+        dequantizer->steps[QUANT_CHROMA][i] = chroma[i];
+    }
+}
+
+void dequantizeBlockInto(const BlockQuantized *const quantizedBlock, const Dequantizer *const dequantizer,
+                         BlockYCbCr *const dctBlock) {
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        const int16_t *const quantized = quantizedBlock->channels[c];
+        const float *const steps = dequantizer->steps[c == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA];
+        float *const channel = dctBlock->channels[c];
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            channel[i] = (float) quantized[i] * steps[i];
+        }
+    }
+}
+
+void idctOnBlockYCbCrInto(const BlockYCbCr *const dctBlock, DctFunction const idct, BlockYCbCr *const blockYCbCr) {
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        idct(dctBlock->channels[c], 1, blockYCbCr->channels[c], 1);
+    }
+}
+
+// Stores one block of samples into a plane starting at pixel (x, y)
+static void storeSamples(const float *const samples, PlanarImage *const planes, uint32_t const channel,
+                         uint32_t const x, uint32_t const y) {
+    for (uint32_t i = 0; i < BLOCK_DIM; ++i) {
+        uint8_t *const row = planarRow(planes, channel, y + i) + x;
+        for (size_t j = 0; j < BLOCK_DIM; ++j) {
+            // Adding 0.5 and truncating rounds, the clamp keeps the truncation on non-negative values
+            float const sample = samples[i * BLOCK_DIM + j] + (SHIFT_CONST + 0.5f);
+            row[j] = (uint8_t) (sample < 0 ? 0 : sample > 255 ? 255 : sample);
+        }
+    }
+}
+
+void storeYCbCrBlock(const BlockYCbCr *const blockYCbCr, uint32_t const blockNumber, PlanarImage *const planes) {
+    uint32_t const xBlockCount = planes->width / BLOCK_DIM;
+    uint32_t const firstRow = blockNumber / xBlockCount * BLOCK_DIM;
+    uint32_t const xOffset = blockNumber % xBlockCount * BLOCK_DIM;
+    for (uint32_t c = 0; c < CHANNEL_COUNT; ++c) {
+        storeSamples(blockYCbCr->channels[c], planes, c, xOffset, firstRow);
+    }
+}
+
+void decodeMcuInto(const McuQuantized *const mcu, ChromaSampling const sampling, uint32_t const mcuNumber,
+                   const Dequantizer *const dequantizer, PlanarImage *const planes) {
+    uint32_t const xBlocks = mcuBlocksX(sampling);
+    uint32_t const yBlocks = mcuBlocksY(sampling);
+    uint32_t const xMcuCount = planes->width / (BLOCK_DIM * xBlocks);
+    uint32_t const xMcu = mcuNumber % xMcuCount;
+    uint32_t const yMcu = mcuNumber / xMcuCount;
+    ALIGNED(32) float dctBlock[BLOCK_SIZE];
+    ALIGNED(32) float samples[BLOCK_SIZE];
+    for (uint32_t b = 0; b < mcuBlockCount(sampling); ++b) {
+        uint32_t const luma = b < xBlocks * yBlocks;
+        const float *const steps = dequantizer->steps[luma ? QUANT_LUMA : QUANT_CHROMA];
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            dctBlock[i] = (float) mcu->blocks[b][i] * steps[i];
+        }
+        idctSeparable(dctBlock, 1, samples, 1);
+        if (luma) {
+            storeSamples(samples, planes, CHANNEL_Y, (xMcu * xBlocks + b % xBlocks) * BLOCK_DIM,
+                         (yMcu * yBlocks + b / xBlocks) * BLOCK_DIM);
+        } else {
+            storeSamples(samples, planes, b - xBlocks * yBlocks + CHANNEL_CB, xMcu * BLOCK_DIM, yMcu * BLOCK_DIM);
+        }
+    }
+}
+
+typedef struct {
+    const CoefficientStream *stream;
+    const Dequantizer *dequantizer;
+    PlanarImage *planes;
+    uint8_t *pixels;
+    size_t stride;
+} DecodeContext;
+
+static void decodeBlockRows(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                            uint32_t const end) {
+    const DecodeContext *const ctx = (const DecodeContext *) context;
+    (void) workerIndex;
+    uint32_t const xBlockCount = ctx->planes->width / BLOCK_DIM;
+    BlockYCbCr dctBlock, blockYCbCr;
+    for (uint32_t blockNumber = begin * xBlockCount; blockNumber < end * xBlockCount; ++blockNumber) {
+        dequantizeBlockInto(ctx->stream->blocks + blockNumber, ctx->dequantizer, &dctBlock);
+        idctOnBlockYCbCrInto(&dctBlock, idctSeparable, &blockYCbCr);
+        storeYCbCrBlock(&blockYCbCr, blockNumber, ctx->planes);
+    }
+}
+
+static void decodeMcuRows(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                          uint32_t const end) {
+    const DecodeContext *const ctx = (const DecodeContext *) context;
+    (void) workerIndex;
+    ChromaSampling const sampling = ctx->stream->sampling;
+    uint32_t const xMcuCount = ctx->planes->width / (BLOCK_DIM * mcuBlocksX(sampling));
+    for (uint32_t mcu = begin * xMcuCount; mcu < end * xMcuCount; ++mcu) {
+        decodeMcuInto(ctx->stream->mcus + mcu, sampling, mcu, ctx->dequantizer, ctx->planes);
+    }
+}
+
+static void convertRowsToRGB(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                             uint32_t const end) {
+    const DecodeContext *const ctx = (const DecodeContext *) context;
+    (void) workerIndex;
+    for (uint32_t row = begin; row < end; ++row) {
+        convertRowToRGB(planarRow(ctx->planes, CHANNEL_Y, row), planarRow(ctx->planes, CHANNEL_CB, row),
+                        planarRow(ctx->planes, CHANNEL_CR, row), ctx->pixels + row * ctx->stride,
+                        ctx->planes->width);
+    }
+}
+
+// Same with subsampled planes, Cb and Cr are interpolated to full resolution one row at a time
+static void convertSubsampledRowsToRGB(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                                       uint32_t const end) {
+    const DecodeContext *const ctx = (const DecodeContext *) context;
+    (void) workerIndex;
+    uint32_t const width = ctx->planes->width;
+    uint8_t *const chroma = (uint8_t *) malloc((size_t) width * 2);
+    if (chroma == NULL) {
+        perror("convertSubsampledRowsToRGB::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t row = begin; row < end; ++row) {
+        upsampleChromaRow(ctx->planes, ctx->stream->sampling, CHANNEL_CB, row, chroma);
+        upsampleChromaRow(ctx->planes, ctx->stream->sampling, CHANNEL_CR, row, chroma + width);
+        convertRowToRGB(planarRow(ctx->planes, CHANNEL_Y, row), chroma, chroma + width,
+                        ctx->pixels + row * ctx->stride, width);
+    }
+    free(chroma);
+}
+
+PPMImageRGB decodeStream(const CoefficientStream *const stream, ThreadPool *const pool) {
+    // Only whole blocks (or MCUs) were encoded
+    uint32_t const mcuWidth = BLOCK_DIM * mcuBlocksX(stream->sampling);
+    uint32_t const mcuHeight = BLOCK_DIM * mcuBlocksY(stream->sampling);
+    uint32_t const width = stream->width / mcuWidth * mcuWidth;
+    uint32_t const height = stream->height / mcuHeight * mcuHeight;
+    size_t const stride = (size_t) width * sizeof(PixelRGB);
+    // One spare byte keeps malloc from returning NULL for images smaller than a block
+    uint8_t *const pixels = (uint8_t *) malloc(stride * height + 1);
+    if (pixels == NULL) {
+        perror("decodeStream::malloc()");
+        exit(EXIT_FAILURE);
+    }
+
+    Dequantizer dequantizer;
+    initDequantizer(&dequantizer, stream->steps[QUANT_LUMA], stream->steps[QUANT_CHROMA]);
+    int const subsampled = stream->sampling != CHROMA_444;
+    PlanarImage planes = subsampled ? createSubsampledPlanarImage(width, height, stream->sampling)
+                                    : createPlanarImage(width, height, CHANNEL_COUNT);
+    DecodeContext context = {
+            .stream=stream, .dequantizer=&dequantizer, .planes=&planes, .pixels=pixels, .stride=stride};
+    ParallelForBody const decodeRows = subsampled ? decodeMcuRows : decodeBlockRows;
+    ParallelForBody const convertRows = subsampled ? convertSubsampledRowsToRGB : convertRowsToRGB;
+    if (pool != NULL) {
+        threadPoolParallelFor(pool, height / mcuHeight, 1, decodeRows, &context);
+        threadPoolParallelFor(pool, height, BLOCK_DIM, convertRows, &context);
+    } else {
+        decodeRows(&context, 0, 0, height / mcuHeight);
+        convertRows(&context, 0, 0, height);
+    }
+    freePlanarImage(&planes);
+
+    // The decoded pixels own their buffer the same way an unmapped file does
+    NetpbmImage const source = {
+            .type="P6", .width=width, .height=height, .maxValue=255, .channels=3, .stride=stride,
+            .pixels=pixels, .data=pixels, .dataSize=stride * height, .mapped=0};
+    PPMImageRGB imageRGB = {
+            .width=(uint16_t) width, .height=(uint16_t) height, .maxValue=255, .stride=stride,
+            .pixels=(const PixelRGB *) pixels, .source=source};
+    strcpy(imageRGB.type, "P6");
+    return imageRGB;
+}
+
+void writePPMImageRGB(const PPMImageRGB *const imageRGB, const char *const file) {
+    FILE *const fptr = fopen(file, "wb");
+    if (fptr == NULL) {
+        perror("writePPMImageRGB::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(fptr, "P6\n%u %u\n%u\n", imageRGB->width, imageRGB->height, imageRGB->maxValue);
+    const uint8_t *const pixels = (const uint8_t *) imageRGB->pixels;
+    for (uint32_t row = 0; row < imageRGB->height; ++row) {
+        fwrite(pixels + row * imageRGB->stride, sizeof(PixelRGB), imageRGB->width, fptr);
+    }
+    if (ferror(fptr)) {
+        perror("writePPMImageRGB::fwrite()");
+        exit(EXIT_FAILURE);
+    }
+    fclose(fptr);
+}
+
+double psnrOf(const PPMImageRGB *const reference, const PPMImageRGB *const imageRGB) {
+    uint32_t const width = reference->width < imageRGB->width ? reference->width : imageRGB->width;
+    uint32_t const height = reference->height < imageRGB->height ? reference->height : imageRGB->height;
+    uint64_t squaredError = 0;
+    for (uint32_t row = 0; row < height; ++row) {
+        const uint8_t *const a = (const uint8_t *) reference->pixels + row * reference->stride;
+        const uint8_t *const b = (const uint8_t *) imageRGB->pixels + row * imageRGB->stride;
+        for (size_t i = 0; i < (size_t) width * sizeof(PixelRGB); ++i) {
+            int32_t const difference = (int32_t) a[i] - (int32_t) b[i];
+            squaredError += (uint64_t) (difference * difference);
+        }
+    }
+    if (squaredError == 0) {
+        return INFINITY;
+    }
+    double const mse = (double) squaredError / ((double) width * height * sizeof(PixelRGB));
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,37 @@
+#ifndef DZ1_DECODER_H
+#define DZ1_DECODER_H
+
+#include <stdint.h>
+
+#include "encoder.h"
+#include "stream.h"
+
+// Steps of both tables as floats, so dequantisation is one multiply per coefficient.
+typedef struct {
+    ALIGNED(32) float steps[QUANT_TABLE_COUNT][BLOCK_SIZE];
+} Dequantizer;
+
+void initDequantizer(Dequantizer *dequantizer, const uint8_t *luma, const uint8_t *chroma);
+
+void dequantizeBlockInto(const BlockQuantized *quantizedBlock, const Dequantizer *dequantizer,
+                         BlockYCbCr *dctBlock);
+
+void idctOnBlockYCbCrInto(const BlockYCbCr *dctBlock, DctFunction idct, BlockYCbCr *blockYCbCr);
+
+// Undoes the level shift, rounds and clamps the samples and stores the block into the planes.
+void storeYCbCrBlock(const BlockYCbCr *blockYCbCr, uint32_t blockNumber, PlanarImage *planes);
+
+// Dequantizes and inverse transforms every block of one MCU and stores it into subsampled planes.
+void decodeMcuInto(const McuQuantized *mcu, ChromaSampling sampling, uint32_t mcuNumber,
+                   const Dequantizer *dequantizer, PlanarImage *planes);
+
+// Reconstructs the RGB image, on the pool when one is given. Release it with freePPMImageRGB().
+PPMImageRGB decodeStream(const CoefficientStream *stream, ThreadPool *pool);
+
+void writePPMImageRGB(const PPMImageRGB *imageRGB, const char *file);
+
+// Peak signal-to-noise ratio over every R, G and B sample the two images share, in dB. Identical
+// images give INFINITY.
+double psnrOf(const PPMImageRGB *reference, const PPMImageRGB *imageRGB);
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "color.h"
+#include "dct.h"
+#include "encoder.h"
+#include "netpbm.h"
+#include "quantize.h"
+
+// Everything the stages work on. Per-block stages walk the blocks of the image in raster order, one
+// block per operation, and fold something of every result into sink.
+typedef struct {
+    const char *file;
+    const uint8_t *fileData;
+    size_t fileSize;
+    PPMImageRGB imageRGB;
+    PlanarImage planes;
+    RowConverter convert;
+    DctFunction dct;
+    Quantizer quantizer;
+    BlockScratch scratch;
+    uint32_t blockCount, blockNumber;
+    uint64_t sink;
+} Dz1Bench;
+
+static uint32_t nextBlock(Dz1Bench *const bench) {
+    uint32_t const block = bench->blockNumber;
+    bench->blockNumber = block + 1 < bench->blockCount ? block + 1 : 0;
+    return block;
+}
+
+static void benchParseHeader(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        NetpbmImage image;
+        const char *error;
+        const uint8_t *const pixels = parseNetpbmHeader(bench->fileData, bench->fileSize, &image, &error);
+        bench->sink += (uint64_t) (pixels - bench->fileData) + image.width;
+    }
+}
+
+static void benchParseFile(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        PPMImageRGB imageRGB = parsePPMImageRGB(bench->file);
+        bench->sink += imageRGB.pixels[imageRGB.width * imageRGB.height / 2].g;
+        freePPMImageRGB(&imageRGB);
+    }
+}
+
+static void benchColorBlock(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        retrieveRGBBlockInto(&bench->imageRGB, nextBlock(bench), bench->scratch.rgb);
+        fromRGBToYCbCrInto(bench->scratch.rgb, &bench->scratch.yCbCr);
+        bench->sink += (uint64_t) bench->scratch.yCbCr.channels[CHANNEL_CB][BLOCK_SIZE - 1];
+    }
+}
+
+static void benchColorRows(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        convertRowsToYCbCr(&bench->imageRGB.pixels[0].r, bench->imageRGB.stride, &bench->planes, 0,
+                           bench->imageRGB.height, bench->convert);
+        bench->sink += planarRow(&bench->planes, CHANNEL_CR, bench->planes.height - 1)[0];
+    }
+}
+
+static void benchDct(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        dctOnBlockYCbCrInto(&bench->scratch.yCbCr, bench->dct, &bench->scratch.dct);
+        bench->sink += (uint64_t) bench->scratch.dct.channels[CHANNEL_Y][0];
+    }
+}
+
+static void benchQuantize(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        quantizeBlockInto(&bench->scratch.dct, &bench->quantizer, &bench->scratch.quantized);
+        bench->sink += (uint64_t) bench->scratch.quantized.channels[CHANNEL_Y][1];
+    }
+}
+
+static void benchEncodeBlock(void *const context, uint64_t const iterations) {
+    Dz1Bench *const bench = (Dz1Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        encodeBlock(&bench->imageRGB, &bench->planes, nextBlock(bench), bench->dct, &bench->quantizer,
+                    &bench->scratch);
+        bench->sink += (uint64_t) bench->scratch.quantized.channels[CHANNEL_Y][0];
+    }
+}
+
+// Writes a synthetic P6 image to a temporary file and returns its name, the caller unlinks it
+static char *writeSyntheticPPM(uint32_t const width, uint32_t const height) {
+    static char name[] = "/tmp/dz1-bench-XXXXXX";
+    int const fd = mkstemp(name);
+    FILE *const fptr = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (fptr == NULL) {
+        perror("writeSyntheticPPM::mkstemp()");
+        exit(EXIT_FAILURE);
+    }
+    size_t const stride = (size_t) width * 3;
+    uint8_t *const pixels = (uint8_t *) malloc(stride * height);
+    if (pixels == NULL) {
+        perror("writeSyntheticPPM::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    fillSyntheticImage(pixels, stride, width, height, 3, 1);
+    fprintf(fptr, "P6\n%u %u\n255\n", width, height);
+    fwrite(pixels, 1, stride * height, fptr);
+    fclose(fptr);
+    free(pixels);
+    return name;
+}
+
+int main(int argc, char *argv[]) {
+    BenchArgs args = parseBenchArgs(argc, argv, 1024, 1024);
+
+    Dz1Bench bench = {0};
+    bench.file = writeSyntheticPPM(args.width, args.height);
+    bench.imageRGB = parsePPMImageRGB(bench.file);
+    bench.fileData = (const uint8_t *) bench.imageRGB.source.data;
+    bench.fileSize = bench.imageRGB.source.dataSize;
+    bench.planes = convertImageToPlanes(&bench.imageRGB, selectRowConverter(COLOR_SCALAR), NULL);
+    bench.blockCount = blockCountOf(&bench.imageRGB);
+    initQuantizer(&bench.quantizer, lumaQuantValues, chromaQuantValues, selectQuantizer(QUANT_AUTO));
+    bench.dct = selectDct(DCT_DEFAULT);
+    uint64_t const pixelCount = (uint64_t) args.width * args.height;
+
+    BenchSuite suite;
+    initBenchSuite(&suite, &args.config);
+    runBenchmark(&suite, "parse/header", 1, benchParseHeader, &bench);
+    runBenchmark(&suite, "parse/ppm-file", pixelCount, benchParseFile, &bench);
+
+    runBenchmark(&suite, "color/block-float", BLOCK_SIZE, benchColorBlock, &bench);
+    ColorKernel const colorKernels[] = {COLOR_SCALAR, COLOR_SSSE3, COLOR_AVX2};
+    for (size_t i = 0; i < sizeof(colorKernels) / sizeof(colorKernels[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "color/rows-%s", colorKernelName(colorKernels[i]));
+        bench.convert = selectRowConverter(colorKernels[i]);
+        runBenchmark(&suite, name, pixelCount, benchColorRows, &bench);
+    }
+
+    // A block of real image content for the transforms, taken from the middle of the image
+    bench.blockNumber = bench.blockCount / 2;
+    retrieveRGBBlockInto(&bench.imageRGB, bench.blockNumber, bench.scratch.rgb);
+    fromRGBToYCbCrInto(bench.scratch.rgb, &bench.scratch.yCbCr);
+    shiftBlockYCbCr(&bench.scratch.yCbCr);
+    DctKind const dctKinds[] = {DCT_REFERENCE, DCT_SEPARABLE, DCT_AAN};
+    for (size_t i = 0; i < sizeof(dctKinds) / sizeof(dctKinds[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "dct/%s", dctName(dctKinds[i]));
+        bench.dct = selectDct(dctKinds[i]);
+        runBenchmark(&suite, name, BLOCK_SIZE, benchDct, &bench);
+    }
+    bench.dct = selectDct(DCT_DEFAULT);
+    dctOnBlockYCbCrInto(&bench.scratch.yCbCr, bench.dct, &bench.scratch.dct);
+
+    QuantKernel const quantKernels[] = {QUANT_SCALAR, QUANT_SSE41, QUANT_AVX2};
+    for (size_t i = 0; i < sizeof(quantKernels) / sizeof(quantKernels[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "quantize/%s", quantKernelName(quantKernels[i]));
+        bench.quantizer.quantize = selectQuantizer(quantKernels[i]);
+        runBenchmark(&suite, name, BLOCK_SIZE, benchQuantize, &bench);
+    }
+    bench.quantizer.quantize = selectQuantizer(QUANT_AUTO);
+
+    bench.blockNumber = 0;
+    runBenchmark(&suite, "pipeline/block", BLOCK_SIZE, benchEncodeBlock, &bench);
+
+    int const status = finishBenchSuite(&suite, "dz1", &args);
+    if (bench.sink == 0) {
+        fprintf(stderr, "Every stage produced zeros!\n");
+    }
+    freeBenchSuite(&suite);
+    freePlanarImage(&bench.planes);
+    freePPMImageRGB(&bench.imageRGB);
+    unlink(bench.file);
+    return status;
+}
@@ -0,0 +1,96 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "encoder.h"
+#include "options.h"
+#include "stream.h"
+#include "threadpool.h"
+
+static double secondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+void printUsage(const char *const program) {
+    fprintf(stderr, "Usage: %s [-t threads] [-r repeats] [-s source.ppm] stream output.ppm\n"
+                    "Program expects a coefficient stream written by dz1 in whole image mode (with any chroma "
+                    "sampling) and the output .ppm file! The stream is decoded 'repeats' times (default 1) and the decode throughput is "
+                    "reported; with a source image the PSNR against it is reported as well. Thread count 0 "
+                    "uses every CPU.\n", program);
+}
+
+int main(int32_t const argc, char *const argv[]) {
+    uint32_t threadCount = 1;
+    uint32_t repeats = 1;
+    const char *sourceFile = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "t:r:s:")) != -1) {
+        switch (option) {
+            case 't':
+                if (parseUint32Option(optarg, 0, THREAD_COUNT_MAX, &threadCount) != 0) {
+                    fprintf(stderr, "Thread count must be in [0, %u]!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                if (parseUint32Option(optarg, 1, INT32_MAX, &repeats) != 0) {
+                    fprintf(stderr, "Repeat count must be at least 1!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                sourceFile = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    CoefficientStream stream = readStream(argv[optind]);
+    ThreadPool *const pool = threadCount == 1 ? NULL : createThreadPool(threadCount);
+
+    // Every repeat decodes from scratch, only the last image is kept
+    PPMImageRGB imageRGB = {0};
+    double const start = secondsNow();
+    for (uint32_t r = 0; r < repeats; ++r) {
+        freePPMImageRGB(&imageRGB);
+        imageRGB = decodeStream(&stream, pool);
+    }
+    double const elapsed = (secondsNow() - start) / repeats;
+
+    double const megabytes = (double) imageRGB.width * imageRGB.height * sizeof(PixelRGB) / 1e6;
+    fprintf(stdout, "decode %ux%u: %.3f ms, %.1f MB/s\n", imageRGB.width, imageRGB.height, elapsed * 1e3,
+            megabytes / elapsed);
+
+    if (sourceFile != NULL) {
+        PPMImageRGB source = parsePPMImageRGB(sourceFile);
+        double const psnr = psnrOf(&source, &imageRGB);
+        if (isinf(psnr)) {
+            fprintf(stdout, "psnr: identical\n");
+        } else {
+            fprintf(stdout, "psnr: %.2f dB\n", psnr);
+        }
+        freePPMImageRGB(&source);
+    }
+
+    writePPMImageRGB(&imageRGB, argv[optind + 1]);
+
+    freePPMImageRGB(&imageRGB);
+    if (pool != NULL) {
+        destroyThreadPool(pool);
+    }
+    freeStream(&stream);
+    return EXIT_SUCCESS;
+}
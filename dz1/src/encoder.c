@@ -0,0 +1,441 @@
+#include "encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define Y_R_CONST 0.299
+#define Y_G_CONST 0.587
+#define Y_B_CONST 0.114
+
+#define Cb_R_CONST (-0.1687)
+#define Cb_G_CONST (-0.3313)
+#define Cb_B_CONST 0.5
+#define Cb_ADD_CONST 128
+
+#define Cr_R_CONST 0.5
+#define Cr_G_CONST (-0.4187)
+#define Cr_B_CONST (-0.0813)
+#define Cr_ADD_CONST 128
+
+#define SHIFT_CONST 128
+
+// Side of a square tile of blocks handed to one worker of the parallel encoder
+#define TILE_DIM 8
+
+TRACE_COUNTER(readCounter, "encode/read");
+TRACE_COUNTER(colorRowsCounter, "encode/color-rows");
+TRACE_COUNTER(fetchCounter, "encode/fetch");
+TRACE_COUNTER(shiftCounter, "encode/shift");
+TRACE_COUNTER(dctCounter, "encode/dct");
+TRACE_COUNTER(quantizeCounter, "encode/quantize");
+
+PPMImageRGB parsePPMImageRGB(const char *const file) {
+    return wrapPPMImageRGB(openNetpbmImage(file, "P6"), file);
+}
+
+PPMImageRGB wrapPPMImageRGB(NetpbmImage const source, const char *const name) {
+    if (source.width > UINT16_MAX || source.height > UINT16_MAX) {
+        fprintf(stderr, "wrapPPMImageRGB(): %s: %ux%u is too large!\n", name, source.width, source.height);
+        exit(EXIT_FAILURE);
+    }
+    PPMImageRGB imageRGB = {
+            .width=(uint16_t) source.width, .height=(uint16_t) source.height, .maxValue=(uint16_t) source.maxValue,
+            .stride=source.stride, .pixels=(const PixelRGB *) source.pixels, .source=source};
+    strcpy(imageRGB.type, source.type);
+    return imageRGB;
+}
+
+void freePPMImageRGB(PPMImageRGB *const imageRGB) {
+    closeNetpbmImage(&imageRGB->source);
+    imageRGB->pixels = NULL;
+}
+
+uint32_t blockCountOf(const PPMImageRGB *const imageRGB) {
+    return (uint32_t) (imageRGB->width / BLOCK_DIM) * (imageRGB->height / BLOCK_DIM);
+}
+
+uint32_t mcuCountOf(const PPMImageRGB *const imageRGB, ChromaSampling const sampling) {
+    return (uint32_t) (imageRGB->width / (BLOCK_DIM * mcuBlocksX(sampling))) *
+           (imageRGB->height / (BLOCK_DIM * mcuBlocksY(sampling)));
+}
+
+void retrieveRGBBlockInto(const PPMImageRGB *const imageRGB, uint32_t const blockNumber, PixelRGB *const blockRGB) {
+    const uint8_t *const pixels = (const uint8_t *) imageRGB->pixels;
+    uint32_t const xBlockCount = imageRGB->width / BLOCK_DIM;
+    size_t const yOffset = blockNumber / xBlockCount * BLOCK_DIM * imageRGB->stride;
+    uint32_t const xOffset = blockNumber % xBlockCount * BLOCK_DIM;
+    for (size_t i = 0, y = yOffset, counter = 0; i < BLOCK_DIM; ++i, y += imageRGB->stride) {
+        const PixelRGB *const row = (const PixelRGB *) (pixels + y);
+        for (size_t j = 0, x = xOffset; j < BLOCK_DIM; ++j, ++x) {
+            blockRGB[counter++] = row[x];
+        }
+    }
+}
+
+void fromRGBToYCbCrInto(const PixelRGB *const blockRGB, BlockYCbCr *const blockYCbCr) {
+    float *const yChannel = blockYCbCr->channels[CHANNEL_Y];
+    float *const cbChannel = blockYCbCr->channels[CHANNEL_CB];
+    float *const crChannel = blockYCbCr->channels[CHANNEL_CR];
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        PixelRGB const pixelRGB = blockRGB[i];
+        yChannel[i] = Y_R_CONST * pixelRGB.r + Y_G_CONST * pixelRGB.g + Y_B_CONST * pixelRGB.b;
+        cbChannel[i] = Cb_R_CONST * pixelRGB.r + Cb_G_CONST * pixelRGB.g + Cb_B_CONST * pixelRGB.b + Cb_ADD_CONST;
+        crChannel[i] = Cr_R_CONST * pixelRGB.r + Cr_G_CONST * pixelRGB.g + Cr_B_CONST * pixelRGB.b + Cr_ADD_CONST;
+    }
+}
+
+void retrieveYCbCrBlockInto(const PlanarImage *const planes, uint32_t const blockNumber,
+                            BlockYCbCr *const blockYCbCr) {
+    uint32_t const xBlockCount = planes->width / BLOCK_DIM;
+    uint32_t const firstRow = blockNumber / xBlockCount * BLOCK_DIM;
+    uint32_t const xOffset = blockNumber % xBlockCount * BLOCK_DIM;
+    for (uint32_t c = 0; c < CHANNEL_COUNT; ++c) {
+        float *const channel = blockYCbCr->channels[c];
+        for (uint32_t i = 0; i < BLOCK_DIM; ++i) {
+            const uint8_t *const row = planarRow(planes, c, firstRow + i) + xOffset;
+            for (size_t j = 0; j < BLOCK_DIM; ++j) {
+                channel[i * BLOCK_DIM + j] = row[j];
+            }
+        }
+    }
+}
+
+void shiftBlockYCbCr(BlockYCbCr *const blockYCbCr) {
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        float *const channel = blockYCbCr->channels[c];
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            channel[i] -= SHIFT_CONST;
+        }
+    }
+}
+
+void dctOnBlockYCbCrInto(const BlockYCbCr *const blockYCbCr, DctFunction const dct, BlockYCbCr *const dctBlock) {
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        dct(blockYCbCr->channels[c], 1, dctBlock->channels[c], 1);
+    }
+}
+
+void quantizeBlockInto(const BlockYCbCr *const block, const Quantizer *const quantizer,
+                       BlockQuantized *const quantizedBlock) {
+    for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+        const QuantTable *const table = &quantizer->tables[c == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA];
+        quantizer->quantize(block->channels[c], table, quantizedBlock->channels[c]);
+    }
+}
+
+typedef struct {
+    const PPMImageRGB *imageRGB;
+    PlanarImage *planes;
+    RowConverter convert;
+} ConvertRowsContext;
+
+static void convertRows(void *const context, uint32_t const workerIndex, uint32_t const begin, uint32_t const end) {
+    const ConvertRowsContext *const ctx = (const ConvertRowsContext *) context;
+    (void) workerIndex;
+    TRACE_BEGIN(start);
+    convertRowsToYCbCr((const uint8_t *) ctx->imageRGB->pixels, ctx->imageRGB->stride,
+                       ctx->planes, begin, end, ctx->convert);
+    TRACE_END(colorRowsCounter, start, (uint64_t) (end - begin) * ctx->imageRGB->width * 3, 0);
+}
+
+static void convertRowsIntoPlanes(const PPMImageRGB *const imageRGB, RowConverter const convert,
+                                  ThreadPool *const pool, PlanarImage *const planes) {
+    ConvertRowsContext context = {.imageRGB=imageRGB, .planes=planes, .convert=convert};
+    if (pool != NULL) {
+        threadPoolParallelFor(pool, imageRGB->height, BLOCK_DIM, convertRows, &context);
+    } else {
+        convertRows(&context, 0, 0, imageRGB->height);
+    }
+}
+
+PlanarImage convertImageToPlanes(const PPMImageRGB *const imageRGB, RowConverter const convert,
+                                 ThreadPool *const pool) {
+    PlanarImage planes = createPlanarImage(imageRGB->width, imageRGB->height, CHANNEL_COUNT);
+    convertRowsIntoPlanes(imageRGB, convert, pool, &planes);
+    return planes;
+}
+
+void encodeBlock(const PPMImageRGB *const imageRGB, const PlanarImage *const planes, uint32_t const blockNumber,
+                 DctFunction const dct, const Quantizer *const quantizer, BlockScratch *const scratch) {
+    TRACE_BEGIN(fetchStart);
+    if (planes != NULL) {
+        retrieveYCbCrBlockInto(planes, blockNumber, &scratch->yCbCr);
+    } else {
+        retrieveRGBBlockInto(imageRGB, blockNumber, scratch->rgb);
+        fromRGBToYCbCrInto(scratch->rgb, &scratch->yCbCr);
+    }
+    TRACE_END(fetchCounter, fetchStart, sizeof(scratch->rgb), 0);
+    TRACE_BEGIN(shiftStart);
+    shiftBlockYCbCr(&scratch->yCbCr);
+    TRACE_END(shiftCounter, shiftStart, sizeof(scratch->yCbCr), 0);
+    TRACE_BEGIN(dctStart);
+    dctOnBlockYCbCrInto(&scratch->yCbCr, dct, &scratch->dct);
+    TRACE_END(dctCounter, dctStart, sizeof(scratch->yCbCr), 0);
+    TRACE_BEGIN(quantizeStart);
+    quantizeBlockInto(&scratch->dct, quantizer, &scratch->quantized);
+    TRACE_END(quantizeCounter, quantizeStart, sizeof(scratch->dct), 0);
+}
+
+typedef struct {
+    const PPMImageRGB *imageRGB;
+    const PlanarImage *planes;
+    DctFunction dct;
+    const Quantizer *quantizer;
+    uint32_t xBlockCount, yBlockCount, xTileCount;
+    // One scratch per worker, nothing is shared between threads except the read-only image
+    BlockScratch *scratch;
+    BlockQuantized *blocks;
+} EncodeTilesContext;
+
+static void encodeTiles(void *const context, uint32_t const workerIndex, uint32_t const begin, uint32_t const end) {
+    const EncodeTilesContext *const ctx = (const EncodeTilesContext *) context;
+    BlockScratch *const scratch = ctx->scratch + workerIndex;
+    for (uint32_t tile = begin; tile < end; ++tile) {
+        uint32_t const yStart = tile / ctx->xTileCount * TILE_DIM;
+        uint32_t const xStart = tile % ctx->xTileCount * TILE_DIM;
+        uint32_t const yEnd = yStart + TILE_DIM < ctx->yBlockCount ? yStart + TILE_DIM : ctx->yBlockCount;
+        uint32_t const xEnd = xStart + TILE_DIM < ctx->xBlockCount ? xStart + TILE_DIM : ctx->xBlockCount;
+        for (uint32_t y = yStart; y < yEnd; ++y) {
+            for (uint32_t x = xStart; x < xEnd; ++x) {
+                uint32_t const blockNumber = y * ctx->xBlockCount + x;
+                encodeBlock(ctx->imageRGB, ctx->planes, blockNumber, ctx->dct, ctx->quantizer, scratch);
+                ctx->blocks[blockNumber] = scratch->quantized;
+            }
+        }
+    }
+}
+
+void encodeImageBlocks(const PPMImageRGB *const imageRGB, const PlanarImage *const planes, DctFunction const dct,
+                       const Quantizer *const quantizer, ThreadPool *const pool, BlockQuantized *const blocks) {
+    uint32_t const xBlockCount = imageRGB->width / BLOCK_DIM;
+    uint32_t const yBlockCount = imageRGB->height / BLOCK_DIM;
+    uint32_t const xTileCount = (xBlockCount + TILE_DIM - 1) / TILE_DIM;
+    uint32_t const yTileCount = (yBlockCount + TILE_DIM - 1) / TILE_DIM;
+    uint32_t const workerCount = pool != NULL ? threadPoolSize(pool) : 1;
+
+    BlockScratch *const scratch = (BlockScratch *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(BlockScratch) * workerCount);
+    EncodeTilesContext context = {
+            .imageRGB=imageRGB, .planes=planes, .dct=dct, .quantizer=quantizer,
+            .xBlockCount=xBlockCount, .yBlockCount=yBlockCount, .xTileCount=xTileCount,
+            .scratch=scratch, .blocks=blocks};
+    if (pool != NULL) {
+        threadPoolParallelFor(pool, xTileCount * yTileCount, 1, encodeTiles, &context);
+    } else {
+        encodeTiles(&context, 0, 0, xTileCount * yTileCount);
+    }
+    alignedFree(scratch);
+}
+
+typedef struct {
+    const PPMImageRGB *imageRGB;
+    PlanarImage *planes;
+    RowConverter convert;
+    ChromaSampling sampling;
+    ChromaFilter filter;
+    // Rows around imageRGB the filter may read, when it is a strip of a taller image
+    uint32_t rowsAbove, rowsBelow;
+} SubsampleRowsContext;
+
+static void subsampleRows(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                          uint32_t const end) {
+    const SubsampleRowsContext *const ctx = (const SubsampleRowsContext *) context;
+    (void) workerIndex;
+    TRACE_BEGIN(start);
+    convertStripSubsampled((const uint8_t *) ctx->imageRGB->pixels, ctx->imageRGB->stride, ctx->rowsAbove,
+                           ctx->rowsBelow, ctx->planes, ctx->sampling, ctx->filter, begin, end, ctx->convert);
+    TRACE_END(colorRowsCounter, start,
+              (uint64_t) (end - begin) * mcuBlocksY(ctx->sampling) * ctx->imageRGB->width * 3, 0);
+}
+
+static void subsampleRowsIntoPlanes(SubsampleRowsContext *const context, ThreadPool *const pool) {
+    if (pool != NULL) {
+        threadPoolParallelFor(pool, context->planes->chromaHeight, BLOCK_DIM, subsampleRows, context);
+    } else {
+        subsampleRows(context, 0, 0, context->planes->chromaHeight);
+    }
+}
+
+PlanarImage convertImageToSubsampledPlanes(const PPMImageRGB *const imageRGB, RowConverter const convert,
+                                           ChromaSampling const sampling, ChromaFilter const filter,
+                                           ThreadPool *const pool) {
+    PlanarImage planes = createSubsampledPlanarImage(imageRGB->width, imageRGB->height, sampling);
+    SubsampleRowsContext context = {
+            .imageRGB=imageRGB, .planes=&planes, .convert=convert, .sampling=sampling, .filter=filter,
+            .rowsAbove=0, .rowsBelow=0};
+    subsampleRowsIntoPlanes(&context, pool);
+    return planes;
+}
+
+// Reads one block of a plane starting at pixel (x, y) and level shifts it
+static void retrieveShiftedBlockInto(const PlanarImage *const planes, uint32_t const channel, uint32_t const x,
+                                     uint32_t const y, float *const block) {
+    for (uint32_t i = 0; i < BLOCK_DIM; ++i) {
+        const uint8_t *const row = planarRow(planes, channel, y + i) + x;
+        for (size_t j = 0; j < BLOCK_DIM; ++j) {
+            block[i * BLOCK_DIM + j] = (float) row[j] - SHIFT_CONST;
+        }
+    }
+}
+
+void encodeMcu(const PlanarImage *const planes, ChromaSampling const sampling, uint32_t const mcuNumber,
+               DctFunction const dct, const Quantizer *const quantizer, McuScratch *const scratch) {
+    uint32_t const xBlocks = mcuBlocksX(sampling);
+    uint32_t const yBlocks = mcuBlocksY(sampling);
+    uint32_t const xMcuCount = planes->width / (BLOCK_DIM * xBlocks);
+    uint32_t const xMcu = mcuNumber % xMcuCount;
+    uint32_t const yMcu = mcuNumber / xMcuCount;
+    for (uint32_t b = 0; b < mcuBlockCount(sampling); ++b) {
+        uint32_t const luma = b < xBlocks * yBlocks;
+        TRACE_BEGIN(fetchStart);
+        if (luma) {
+            retrieveShiftedBlockInto(planes, CHANNEL_Y, (xMcu * xBlocks + b % xBlocks) * BLOCK_DIM,
+                                     (yMcu * yBlocks + b / xBlocks) * BLOCK_DIM, scratch->samples);
+        } else {
+            retrieveShiftedBlockInto(planes, b - xBlocks * yBlocks + CHANNEL_CB, xMcu * BLOCK_DIM, yMcu * BLOCK_DIM,
+                                     scratch->samples);
+        }
+        TRACE_END(fetchCounter, fetchStart, BLOCK_SIZE, 0);
+        TRACE_BEGIN(dctStart);
+        dct(scratch->samples, 1, scratch->dct, 1);
+        TRACE_END(dctCounter, dctStart, sizeof(scratch->samples), 0);
+        TRACE_BEGIN(quantizeStart);
+        quantizer->quantize(scratch->dct, &quantizer->tables[luma ? QUANT_LUMA : QUANT_CHROMA],
+                            scratch->quantized.blocks[b]);
+        TRACE_END(quantizeCounter, quantizeStart, sizeof(scratch->dct), 0);
+    }
+}
+
+typedef struct {
+    const PlanarImage *planes;
+    ChromaSampling sampling;
+    DctFunction dct;
+    const Quantizer *quantizer;
+    McuScratch *scratch;
+    McuQuantized *mcus;
+} EncodeMcusContext;
+
+static void encodeMcuRange(void *const context, uint32_t const workerIndex, uint32_t const begin,
+                           uint32_t const end) {
+    const EncodeMcusContext *const ctx = (const EncodeMcusContext *) context;
+    McuScratch *const scratch = ctx->scratch + workerIndex;
+    for (uint32_t mcu = begin; mcu < end; ++mcu) {
+        encodeMcu(ctx->planes, ctx->sampling, mcu, ctx->dct, ctx->quantizer, scratch);
+        ctx->mcus[mcu] = scratch->quantized;
+    }
+}
+
+void encodeImageMcus(const PlanarImage *const planes, ChromaSampling const sampling, DctFunction const dct,
+                     const Quantizer *const quantizer, ThreadPool *const pool, McuQuantized *const mcus) {
+    uint32_t const xMcuCount = planes->width / (BLOCK_DIM * mcuBlocksX(sampling));
+    uint32_t const yMcuCount = planes->height / (BLOCK_DIM * mcuBlocksY(sampling));
+    uint32_t const workerCount = pool != NULL ? threadPoolSize(pool) : 1;
+
+    McuScratch *const scratch = (McuScratch *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(McuScratch) * workerCount);
+    EncodeMcusContext context = {
+            .planes=planes, .sampling=sampling, .dct=dct, .quantizer=quantizer, .scratch=scratch, .mcus=mcus};
+    // Runs of a few MCUs rather than MCU rows, so a strip one MCU row high still keeps every worker busy
+    if (pool != NULL) {
+        threadPoolParallelFor(pool, xMcuCount * yMcuCount, TILE_DIM, encodeMcuRange, &context);
+    } else {
+        encodeMcuRange(&context, 0, 0, xMcuCount * yMcuCount);
+    }
+    alignedFree(scratch);
+}
+
+StripEncoder openStripEncoder(const char *const file, const EncoderOptions *const options) {
+    StripEncoder encoder = {.reader=openNetpbmRowReader(file, "P6"), .options=options};
+    const NetpbmImage *const image = &encoder.reader.image;
+    if (image->width > UINT16_MAX || image->height > UINT16_MAX) {
+        fprintf(stderr, "openStripEncoder(): %s: %ux%u is too large!\n", encoder.reader.name, image->width,
+                image->height);
+        exit(EXIT_FAILURE);
+    }
+    ChromaSampling const sampling = options->sampling;
+    encoder.width = (uint16_t) image->width;
+    encoder.height = (uint16_t) image->height;
+    encoder.stripRows = BLOCK_DIM * mcuBlocksY(sampling);
+    encoder.stripCount = image->height / encoder.stripRows;
+    encoder.unitsPerStrip = image->width / (BLOCK_DIM * mcuBlocksX(sampling));
+    encoder.haloRows = sampling != CHROMA_444 ? haloRowsOf(sampling, options->chromaFilter) : 0;
+
+    size_t const stride = image->stride;
+    // One spare byte keeps malloc from returning NULL for images narrower than a pixel
+    encoder.window = (uint8_t *) malloc(stride * (encoder.stripRows + 2 * encoder.haloRows) + 1);
+    if (encoder.window == NULL) {
+        perror("openStripEncoder::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    encoder.strip = (PPMImageRGB) {
+            .width=encoder.width, .height=(uint16_t) encoder.stripRows, .maxValue=(uint16_t) image->maxValue,
+            .stride=stride, .pixels=(const PixelRGB *) (encoder.window + encoder.haloRows * stride)};
+    strcpy(encoder.strip.type, image->type);
+
+    if (sampling != CHROMA_444) {
+        encoder.planes = createSubsampledPlanarImage(encoder.width, encoder.stripRows, sampling);
+        encoder.mcus = (McuQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(McuQuantized) * encoder.unitsPerStrip);
+    } else {
+        if (options->rowConverter != NULL) {
+            encoder.planes = createPlanarImage(encoder.width, encoder.stripRows, CHANNEL_COUNT);
+        }
+        encoder.blocks = (BlockQuantized *) alignedAlloc(IMAGE_ALIGNMENT,
+                                                         sizeof(BlockQuantized) * encoder.unitsPerStrip);
+    }
+    return encoder;
+}
+
+// Fills the window for the next strip: the halo rows shared with the previous strip move up, the
+// rows after them are read from the file.
+static uint32_t readStripRows(StripEncoder *const encoder) {
+    TRACE_BEGIN(start);
+    size_t const stride = encoder->strip.stride;
+    uint32_t const halo = encoder->haloRows;
+    uint32_t const first = encoder->stripNumber * encoder->stripRows;
+    if (encoder->stripNumber > 0 && halo > 0) {
+        memmove(encoder->window, encoder->window + encoder->stripRows * stride, 2 * halo * stride);
+    }
+    // Window row i holds image row first - halo + i
+    uint32_t const rowsRead = encoder->reader.rowsRead;
+    uint32_t const end = first + encoder->stripRows + halo;
+    uint32_t const read = readNetpbmRows(&encoder->reader, encoder->window + (rowsRead + halo - first) * stride,
+                                         stride, end - rowsRead);
+    TRACE_END(readCounter, start, (uint64_t) read * stride, 0);
+    return rowsRead + read - (first + encoder->stripRows);
+}
+
+int encodeNextStrip(StripEncoder *const encoder, ThreadPool *const pool) {
+    if (encoder->stripNumber == encoder->stripCount) {
+        return 0;
+    }
+    const EncoderOptions *const options = encoder->options;
+    uint32_t const rowsBelow = readStripRows(encoder);
+    if (options->sampling != CHROMA_444) {
+        SubsampleRowsContext context = {
+                .imageRGB=&encoder->strip, .planes=&encoder->planes, .convert=options->rowConverter,
+                .sampling=options->sampling, .filter=options->chromaFilter,
+                .rowsAbove=encoder->stripNumber > 0 ? encoder->haloRows : 0, .rowsBelow=rowsBelow};
+        subsampleRowsIntoPlanes(&context, pool);
+        encodeImageMcus(&encoder->planes, options->sampling, options->dct, options->quantizer, pool, encoder->mcus);
+    } else {
+        if (options->rowConverter != NULL) {
+            convertRowsIntoPlanes(&encoder->strip, options->rowConverter, pool, &encoder->planes);
+        }
+        encodeImageBlocks(&encoder->strip, options->rowConverter != NULL ? &encoder->planes : NULL, options->dct,
+                          options->quantizer, pool, encoder->blocks);
+    }
+    ++encoder->stripNumber;
+    return 1;
+}
+
+void closeStripEncoder(StripEncoder *const encoder) {
+    closeNetpbmRowReader(&encoder->reader);
+    free(encoder->window);
+    encoder->window = NULL;
+    freePlanarImage(&encoder->planes);
+    alignedFree(encoder->blocks);
+    alignedFree(encoder->mcus);
+    encoder->blocks = NULL;
+    encoder->mcus = NULL;
+}
@@ -0,0 +1,175 @@
+#ifndef DZ1_ENCODER_H
+#define DZ1_ENCODER_H
+
+#include <stdint.h>
+
+#include "color.h"
+#include "dct.h"
+#include "image.h"
+#include "netpbm.h"
+#include "quantize.h"
+#include "threadpool.h"
+
+#define BLOCK_DIM DCT_DIM
+#define BLOCK_SIZE DCT_SIZE
+
+typedef struct {
+    uint8_t r, g, b;
+} PixelRGB;
+
+// View of a P6 image. The pixels are not copied, they point into the mapped file; row r starts
+// "stride" bytes after pixels.
+typedef struct {
+    char type[3];
+    uint16_t width, height, maxValue;
+    size_t stride;
+    const PixelRGB *pixels;
+    NetpbmImage source;
+} PPMImageRGB;
+
+// 8x8 block with every channel stored contiguously, so the DCT and quantization of a channel run
+// over one aligned array.
+typedef struct {
+    ALIGNED(32) float channels[CHANNEL_COUNT][BLOCK_SIZE];
+} BlockYCbCr;
+
+typedef struct {
+    ALIGNED(32) int16_t channels[CHANNEL_COUNT][BLOCK_SIZE];
+} BlockQuantized;
+
+// Most blocks an MCU has: 2x2 luma blocks with 4:2:0, and one Cb and one Cr block
+#define MCU_MAX_BLOCKS 6
+
+// Quantized blocks of one MCU: its luma blocks in raster order, then its Cb and its Cr block.
+typedef struct {
+    ALIGNED(32) int16_t blocks[MCU_MAX_BLOCKS][BLOCK_SIZE];
+} McuQuantized;
+
+static inline uint32_t mcuLumaBlockCount(ChromaSampling const sampling) {
+    return mcuBlocksX(sampling) * mcuBlocksY(sampling);
+}
+
+static inline uint32_t mcuBlockCount(ChromaSampling const sampling) {
+    return mcuLumaBlockCount(sampling) + 2;
+}
+
+// Scratch buffers for one block passing through the pipeline. Allocate one per encoding loop (or per
+// thread) and reuse it for every block, so the steady state does no heap allocation.
+typedef struct {
+    PixelRGB rgb[BLOCK_SIZE];
+    BlockYCbCr yCbCr;
+    BlockYCbCr dct;
+    BlockQuantized quantized;
+} BlockScratch;
+
+// Scratch buffers for one MCU, its blocks pass through them one after another.
+typedef struct {
+    ALIGNED(32) float samples[BLOCK_SIZE];
+    ALIGNED(32) float dct[BLOCK_SIZE];
+    McuQuantized quantized;
+} McuScratch;
+
+typedef struct {
+    DctFunction dct;
+    const Quantizer *quantizer;
+    // NULL keeps the per-block floating point colour conversion, otherwise whole rows are converted
+    // up front in fixed point with this kernel
+    RowConverter rowConverter;
+    // 0 means one thread per CPU
+    uint32_t threadCount;
+    // Anything but CHROMA_444 converts rows up front with rowConverter (which then may not be NULL),
+    // downsampling Cb and Cr with chromaFilter, and encodes MCUs instead of blocks
+    ChromaSampling sampling;
+    ChromaFilter chromaFilter;
+} EncoderOptions;
+
+PPMImageRGB parsePPMImageRGB(const char *file);
+
+// Takes over a P6 image read some other way, e.g. with readNetpbmFrame(). name is for messages.
+PPMImageRGB wrapPPMImageRGB(NetpbmImage source, const char *name);
+
+void freePPMImageRGB(PPMImageRGB *imageRGB);
+
+uint32_t blockCountOf(const PPMImageRGB *imageRGB);
+
+// Whole MCUs of the image, only these are encoded
+uint32_t mcuCountOf(const PPMImageRGB *imageRGB, ChromaSampling sampling);
+
+void retrieveRGBBlockInto(const PPMImageRGB *imageRGB, uint32_t blockNumber, PixelRGB *blockRGB);
+
+void fromRGBToYCbCrInto(const PixelRGB *blockRGB, BlockYCbCr *blockYCbCr);
+
+// Reads one block from planes produced by the fixed-point colour conversion.
+void retrieveYCbCrBlockInto(const PlanarImage *planes, uint32_t blockNumber, BlockYCbCr *blockYCbCr);
+
+void shiftBlockYCbCr(BlockYCbCr *blockYCbCr);
+
+void dctOnBlockYCbCrInto(const BlockYCbCr *blockYCbCr, DctFunction dct, BlockYCbCr *dctBlock);
+
+void quantizeBlockInto(const BlockYCbCr *block, const Quantizer *quantizer, BlockQuantized *quantizedBlock);
+
+// Converts the whole image into aligned Y, Cb and Cr planes with the given kernel, on the pool
+// when one is given.
+PlanarImage convertImageToPlanes(const PPMImageRGB *imageRGB, RowConverter convert, ThreadPool *pool);
+
+// Runs the whole pipeline for one block using only the buffers in scratch. Colour conversion reads
+// from planes when they were converted up front (planes != NULL), otherwise from the RGB image. The
+// result ends up in scratch->quantized. Built with MAS_TRACE, each of the four stages is a trace
+// counter of its own (encode/fetch, encode/shift, encode/dct and encode/quantize).
+void encodeBlock(const PPMImageRGB *imageRGB, const PlanarImage *planes, uint32_t blockNumber, DctFunction dct,
+                 const Quantizer *quantizer, BlockScratch *scratch);
+
+// Encodes every block into blocks[blockNumber]. With a pool, tiles of blocks are distributed over
+// its workers with work stealing; every block still lands in its own slot, so the result does not
+// depend on the number of threads or the schedule.
+void encodeImageBlocks(const PPMImageRGB *imageRGB, const PlanarImage *planes, DctFunction dct,
+                       const Quantizer *quantizer, ThreadPool *pool, BlockQuantized *blocks);
+
+// Converts the image into Y and subsampled Cb and Cr planes, on the pool when one is given.
+PlanarImage convertImageToSubsampledPlanes(const PPMImageRGB *imageRGB, RowConverter convert,
+                                           ChromaSampling sampling, ChromaFilter filter, ThreadPool *pool);
+
+// Level shifts, transforms and quantizes every block of one MCU of subsampled planes. The result
+// ends up in scratch->quantized.
+void encodeMcu(const PlanarImage *planes, ChromaSampling sampling, uint32_t mcuNumber, DctFunction dct,
+               const Quantizer *quantizer, McuScratch *scratch);
+
+// Encodes every MCU into mcus[mcuNumber], runs of MCUs in raster order spread over the workers of
+// the pool (which may be NULL). The result does not depend on the number of threads.
+void encodeImageMcus(const PlanarImage *planes, ChromaSampling sampling, DctFunction dct, const Quantizer *quantizer,
+                     ThreadPool *pool, McuQuantized *mcus);
+
+// Encoder for an image read one strip of whole block rows (MCU rows with subsampled chroma) at a
+// time, so memory stays O(width) however tall the image is. Every buffer is reused for every strip,
+// and the blocks come out exactly as encoding the whole image gives them.
+typedef struct {
+    NetpbmRowReader reader;
+    const EncoderOptions *options;
+    uint16_t width, height;
+    // Image rows per strip, whole strips of the image, and blocks (4:4:4) or MCUs per strip
+    uint32_t stripRows, stripCount, unitsPerStrip;
+    uint32_t stripNumber;
+    // RGB rows of the strip, with haloRows image rows above and below it for the chroma filter
+    uint32_t haloRows;
+    uint8_t *window;
+    // View of the strip rows of the window
+    PPMImageRGB strip;
+    // Planes of the strip, unless 4:4:4 is converted per block in floating point
+    PlanarImage planes;
+    // Result of the last strip: blocks with 4:4:4, MCUs otherwise
+    BlockQuantized *blocks;
+    McuQuantized *mcus;
+} StripEncoder;
+
+// Opens the P6 file (or stdin for "-") and allocates the buffers of one strip. options has to stay
+// valid until the encoder is closed; its threadCount is not used.
+StripEncoder openStripEncoder(const char *file, const EncoderOptions *options);
+
+// Reads, converts and encodes the next strip into encoder->blocks or encoder->mcus, on the pool
+// when one is given. Returns 0 once every whole strip has been encoded, the rows after the last
+// one are never read.
+int encodeNextStrip(StripEncoder *encoder, ThreadPool *pool);
+
+void closeStripEncoder(StripEncoder *encoder);
+
+#endif
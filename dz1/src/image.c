@@ -0,0 +1,62 @@
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+void *alignedAlloc(size_t const alignment, size_t const size) {
+#if defined(_WIN32)
+    void *const ptr = _aligned_malloc(size, alignment);
+#else
+    void *ptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        ptr = NULL;
+    }
+#endif
+    if (ptr == NULL) {
+        perror("alignedAlloc()");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void alignedFree(void *const ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+PlanarImage createPlanarImage(uint32_t const width, uint32_t const height, uint32_t const channelCount) {
+    PlanarImage image = {.width=width, .height=height, .chromaWidth=width, .chromaHeight=height,
+                         .channelCount=channelCount, .alignment=IMAGE_ALIGNMENT};
+    image.stride = ((size_t) width + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        image.planes[c] = (uint8_t *) alignedAlloc(IMAGE_ALIGNMENT, image.stride * height);
+    }
+    return image;
+}
+
+PlanarImage createSubsampledPlanarImage(uint32_t const width, uint32_t const height, ChromaSampling const sampling) {
+    PlanarImage image = {.width=width, .height=height, .chromaWidth=width / mcuBlocksX(sampling),
+                         .chromaHeight=height / mcuBlocksY(sampling), .channelCount=CHANNEL_COUNT,
+                         .alignment=IMAGE_ALIGNMENT};
+    // Chroma rows share the luma stride, planarRow() stays the same for every plane
+    image.stride = ((size_t) width + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    image.planes[CHANNEL_Y] = (uint8_t *) alignedAlloc(IMAGE_ALIGNMENT, image.stride * height);
+    for (uint32_t c = CHANNEL_CB; c < CHANNEL_COUNT; ++c) {
+        image.planes[c] = (uint8_t *) alignedAlloc(IMAGE_ALIGNMENT, image.stride * image.chromaHeight);
+    }
+    return image;
+}
+
+void freePlanarImage(PlanarImage *const image) {
+    for (uint32_t c = 0; c < image->channelCount; ++c) {
+        alignedFree(image->planes[c]);
+        image->planes[c] = NULL;
+    }
+}
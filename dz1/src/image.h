@@ -0,0 +1,68 @@
+#ifndef DZ1_IMAGE_H
+#define DZ1_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Alignment of every plane and of every row inside a plane. 64 bytes is a cache line and a multiple
+// of the widest vector register the kernels use.
+#define IMAGE_ALIGNMENT 64
+
+#if defined(_MSC_VER)
+#define ALIGNED(n) __declspec(align(n))
+#else
+#define ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
+typedef enum {
+    CHANNEL_Y,
+    CHANNEL_CB,
+    CHANNEL_CR,
+    CHANNEL_COUNT
+} Channel;
+
+// How much Cb and Cr are subsampled against Y. A minimum coded unit (MCU) covers one chroma block,
+// so 2x1 luma blocks with 4:2:2 and 2x2 with 4:2:0.
+typedef enum {
+    CHROMA_444,
+    CHROMA_422,
+    CHROMA_420
+} ChromaSampling;
+
+static inline uint32_t mcuBlocksX(ChromaSampling const sampling) {
+    return sampling == CHROMA_444 ? 1 : 2;
+}
+
+static inline uint32_t mcuBlocksY(ChromaSampling const sampling) {
+    return sampling == CHROMA_420 ? 2 : 1;
+}
+
+// Planar 8-bit image. Each channel lives in its own plane; rows of a plane start "stride" bytes
+// apart, and both the planes and the stride are multiples of "alignment". Planes other than the first
+// hold chromaWidth x chromaHeight samples, which is less than width x height when chroma is subsampled.
+typedef struct {
+    uint32_t width, height;
+    uint32_t chromaWidth, chromaHeight;
+    uint32_t channelCount;
+    size_t stride;
+    size_t alignment;
+    uint8_t *planes[CHANNEL_COUNT];
+} PlanarImage;
+
+void *alignedAlloc(size_t alignment, size_t size);
+
+void alignedFree(void *ptr);
+
+PlanarImage createPlanarImage(uint32_t width, uint32_t height, uint32_t channelCount);
+
+// Y, Cb and Cr planes with Cb and Cr at the resolution of the sampling (width and height are
+// divided by mcuBlocksX and mcuBlocksY, rounding down).
+PlanarImage createSubsampledPlanarImage(uint32_t width, uint32_t height, ChromaSampling sampling);
+
+void freePlanarImage(PlanarImage *image);
+
+static inline uint8_t *planarRow(const PlanarImage *const image, uint32_t const channel, uint32_t const row) {
+    return image->planes[channel] + (size_t) row * image->stride;
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "jpeg.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Entropy-coded bytes are handed to the file in chunks of at least this size
+#define JPEG_FLUSH_THRESHOLD (1 << 15)
+
+// Largest magnitudes baseline Huffman coding can represent
+#define JPEG_MAX_DC_DIFF 2047
+#define JPEG_MAX_AC 1023
+
+uint8_t const zigzagOrder[BLOCK_SIZE] = {
+        0, 1, 8, 16, 9, 2, 3, 10,
+        17, 24, 32, 25, 18, 11, 4, 5,
+        12, 19, 26, 33, 40, 48, 41, 34,
+        27, 20, 13, 6, 7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36,
+        29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46,
+        53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static uint8_t const dcSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static uint8_t const acLumaSymbols[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+};
+
+static uint8_t const acChromaSymbols[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+};
+
+HuffmanSpec const standardDcSpecs[QUANT_TABLE_COUNT] = {
+        {{0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0}, dcSymbols, 12},
+        {{0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0}, dcSymbols, 12}
+};
+
+HuffmanSpec const standardAcSpecs[QUANT_TABLE_COUNT] = {
+        {{0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d}, acLumaSymbols, 162},
+        {{0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77}, acChromaSymbols, 162}
+};
+
+void buildHuffmanCodes(const HuffmanSpec *const spec, HuffmanCodes *const codes) {
+    memset(codes, 0, sizeof(*codes));
+    uint32_t code = 0;
+    for (uint32_t length = 1, k = 0; length <= 16; ++length) {
+        for (uint32_t i = 0; i < spec->counts[length - 1]; ++i, ++k) {
+            codes->code[spec->symbols[k]] = (uint16_t) code++;
+            codes->length[spec->symbols[k]] = (uint8_t) length;
+        }
+        code <<= 1;
+    }
+}
+
+// Number of bits needed for |value|, the "SSSS" category of T.81 F.1.2.
+static inline uint32_t magnitudeCategory(uint32_t const magnitude) {
+#if defined(__GNUC__)
+    return magnitude == 0 ? 0 : 32 - (uint32_t) __builtin_clz(magnitude);
+#else
+    uint32_t category = 0;
+    for (uint32_t m = magnitude; m != 0; m >>= 1) {
+        ++category;
+    }
+    return category;
+#endif
+}
+
+// Category code followed by the magnitude bits, negative values as value - 1 in "category" bits.
+static inline void putCoefficient(BitWriter *const writer, const HuffmanCodes *const codes, uint32_t const runLength,
+                                  int32_t const value) {
+    uint32_t const magnitude = (uint32_t) (value < 0 ? -value : value);
+    uint32_t const category = magnitudeCategory(magnitude);
+    uint32_t const symbol = runLength << 4 | category;
+    putBits(writer, codes->code[symbol], codes->length[symbol]);
+    if (category != 0) {
+        uint32_t const bits = (uint32_t) (value < 0 ? value - 1 : value) & ((1u << category) - 1);
+        putBits(writer, bits, category);
+    }
+}
+
+static int32_t clampCoefficient(int32_t const value, int32_t const limit) {
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+static void encodeChannel(BitWriter *const writer, const int16_t *const coefficients, int16_t *const previousDc,
+                          const HuffmanCodes *const dc, const HuffmanCodes *const ac) {
+    int32_t const dcDiff = clampCoefficient(coefficients[0] - *previousDc, JPEG_MAX_DC_DIFF);
+    putCoefficient(writer, dc, 0, dcDiff);
+    *previousDc = (int16_t) (*previousDc + dcDiff);
+
+    uint32_t run = 0;
+    for (size_t k = 1; k < BLOCK_SIZE; ++k) {
+        int32_t const value = clampCoefficient(coefficients[zigzagOrder[k]], JPEG_MAX_AC);
+        if (value == 0) {
+            ++run;
+            continue;
+        }
+        // ZRL, sixteen zeros
+        while (run >= 16) {
+            putBits(writer, ac->code[0xF0], ac->length[0xF0]);
+            run -= 16;
+        }
+        putCoefficient(writer, ac, run, value);
+        run = 0;
+    }
+    if (run != 0) {
+        // EOB
+        putBits(writer, ac->code[0x00], ac->length[0x00]);
+    }
+}
+
+static void writeByte(FILE *const fptr, uint32_t const value) {
+    fputc((int) (value & 0xFF), fptr);
+}
+
+static void writeWord(FILE *const fptr, uint32_t const value) {
+    writeByte(fptr, value >> 8);
+    writeByte(fptr, value);
+}
+
+static void writeMarker(FILE *const fptr, uint32_t const marker, uint32_t const payloadLength) {
+    writeByte(fptr, 0xFF);
+    writeByte(fptr, marker);
+    // The length field counts itself
+    writeWord(fptr, payloadLength + 2);
+}
+
+static void writeHuffmanTable(FILE *const fptr, uint32_t const tableClass, uint32_t const id,
+                              const HuffmanSpec *const spec) {
+    writeMarker(fptr, 0xC4, 1 + 16 + spec->symbolCount);
+    writeByte(fptr, tableClass << 4 | id);
+    fwrite(spec->counts, 1, 16, fptr);
+    fwrite(spec->symbols, 1, spec->symbolCount, fptr);
+}
+
+void beginJpeg(JpegWriter *const jpeg, FILE *const fptr, uint16_t const width, uint16_t const height,
+               ChromaSampling const sampling, const Quantizer *const quantizer) {
+    // A frame of 0 lines or samples is not valid JFIF, so an image without a whole MCU has nothing to write
+    uint32_t const mcuWidth = BLOCK_DIM * mcuBlocksX(sampling);
+    uint32_t const mcuHeight = BLOCK_DIM * mcuBlocksY(sampling);
+    if (width < mcuWidth || height < mcuHeight) {
+        fprintf(stderr, "beginJpeg(): %ux%u image has no whole %ux%u MCU!\n", width, height, mcuWidth, mcuHeight);
+        exit(EXIT_FAILURE);
+    }
+    jpeg->fptr = fptr;
+    jpeg->sampling = sampling;
+    for (size_t t = 0; t < QUANT_TABLE_COUNT; ++t) {
+        buildHuffmanCodes(&standardDcSpecs[t], &jpeg->dc[t]);
+        buildHuffmanCodes(&standardAcSpecs[t], &jpeg->ac[t]);
+    }
+    memset(jpeg->previousDc, 0, sizeof(jpeg->previousDc));
+    initBitWriter(&jpeg->writer, 1);
+
+    // SOI and the JFIF APP0 segment: version 1.01, no density units, 1:1 aspect, no thumbnail
+    writeByte(fptr, 0xFF);
+    writeByte(fptr, 0xD8);
+    writeMarker(fptr, 0xE0, 14);
+    fwrite("JFIF", 1, 5, fptr);
+    writeWord(fptr, 0x0101);
+    writeByte(fptr, 0);
+    writeWord(fptr, 1);
+    writeWord(fptr, 1);
+    writeWord(fptr, 0);
+
+    // DQT, 8-bit steps in zigzag order
+    writeMarker(fptr, 0xDB, QUANT_TABLE_COUNT * (1 + BLOCK_SIZE));
+    for (uint32_t t = 0; t < QUANT_TABLE_COUNT; ++t) {
+        writeByte(fptr, t);
+        for (size_t k = 0; k < BLOCK_SIZE; ++k) {
+            writeByte(fptr, quantizer->tables[t].values[zigzagOrder[k]]);
+        }
+    }
+
+    // SOF0, three components. Y has the sampling factors of the MCU and uses table 0, Cb and Cr are
+    // sampled once per MCU and use table 1.
+    writeMarker(fptr, 0xC0, 6 + 3 * CHANNEL_COUNT);
+    writeByte(fptr, 8);
+    writeWord(fptr, height / mcuHeight * mcuHeight);
+    writeWord(fptr, width / mcuWidth * mcuWidth);
+    writeByte(fptr, CHANNEL_COUNT);
+    for (uint32_t c = 0; c < CHANNEL_COUNT; ++c) {
+        writeByte(fptr, c + 1);
+        writeByte(fptr, c == CHANNEL_Y ? mcuBlocksX(sampling) << 4 | mcuBlocksY(sampling) : 0x11);
+        writeByte(fptr, c == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA);
+    }
+
+    for (uint32_t t = 0; t < QUANT_TABLE_COUNT; ++t) {
+        writeHuffmanTable(fptr, 0, t, &standardDcSpecs[t]);
+        writeHuffmanTable(fptr, 1, t, &standardAcSpecs[t]);
+    }
+
+    // SOS, one interleaved scan over all coefficients
+    writeMarker(fptr, 0xDA, 1 + 2 * CHANNEL_COUNT + 3);
+    writeByte(fptr, CHANNEL_COUNT);
+    for (uint32_t c = 0; c < CHANNEL_COUNT; ++c) {
+        uint32_t const table = c == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA;
+        writeByte(fptr, c + 1);
+        writeByte(fptr, table << 4 | table);
+    }
+    writeByte(fptr, 0);
+    writeByte(fptr, BLOCK_SIZE - 1);
+    writeByte(fptr, 0);
+}
+
+static void flushJpeg(JpegWriter *const jpeg) {
+    if (jpeg->writer.size >= JPEG_FLUSH_THRESHOLD) {
+        fwrite(jpeg->writer.data, 1, jpeg->writer.size, jpeg->fptr);
+        clearBitWriterBuffer(&jpeg->writer);
+    }
+}
+
+void writeJpegBlock(JpegWriter *const jpeg, const BlockQuantized *const quantizedBlock) {
+    for (uint32_t c = 0; c < CHANNEL_COUNT; ++c) {
+        uint32_t const table = c == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA;
+        encodeChannel(&jpeg->writer, quantizedBlock->channels[c], &jpeg->previousDc[c], &jpeg->dc[table],
+                      &jpeg->ac[table]);
+    }
+    flushJpeg(jpeg);
+}
+
+void writeJpegMcu(JpegWriter *const jpeg, const McuQuantized *const mcu) {
+    uint32_t const lumaBlocks = mcuLumaBlockCount(jpeg->sampling);
+    for (uint32_t b = 0; b < mcuBlockCount(jpeg->sampling); ++b) {
+        uint32_t const channel = b < lumaBlocks ? CHANNEL_Y : b - lumaBlocks + CHANNEL_CB;
+        uint32_t const table = channel == CHANNEL_Y ? QUANT_LUMA : QUANT_CHROMA;
+        encodeChannel(&jpeg->writer, mcu->blocks[b], &jpeg->previousDc[channel], &jpeg->dc[table], &jpeg->ac[table]);
+    }
+    flushJpeg(jpeg);
+}
+
+void endJpeg(JpegWriter *const jpeg) {
+    alignBitWriter(&jpeg->writer, 1);
+    fwrite(jpeg->writer.data, 1, jpeg->writer.size, jpeg->fptr);
+    freeBitWriter(&jpeg->writer);
+    writeByte(jpeg->fptr, 0xFF);
+    writeByte(jpeg->fptr, 0xD9);
+}
@@ -0,0 +1,58 @@
+#ifndef DZ1_JPEG_H
+#define DZ1_JPEG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bitwriter.h"
+#include "encoder.h"
+
+// zigzagOrder[k] is the raster index of the k-th coefficient in zigzag order.
+extern uint8_t const zigzagOrder[BLOCK_SIZE];
+
+// Code and length of every symbol of one Huffman table, indexed by symbol.
+typedef struct {
+    uint16_t code[256];
+    uint8_t length[256];
+} HuffmanCodes;
+
+// Huffman table in the form it is stored in a DHT segment: the number of codes of every length
+// from 1 to 16 followed by the symbols in order of increasing code length.
+typedef struct {
+    uint8_t counts[16];
+    const uint8_t *symbols;
+    uint32_t symbolCount;
+} HuffmanSpec;
+
+// Typical tables from ITU T.81 Annex K.3, indexed by QUANT_LUMA / QUANT_CHROMA
+extern HuffmanSpec const standardDcSpecs[QUANT_TABLE_COUNT];
+extern HuffmanSpec const standardAcSpecs[QUANT_TABLE_COUNT];
+
+// Builds the code of every symbol the way T.81 Annex C does.
+void buildHuffmanCodes(const HuffmanSpec *spec, HuffmanCodes *codes);
+
+// Baseline JFIF encoder with one interleaved scan. Blocks (4:4:4) or MCUs (subsampled chroma) have
+// to be passed in raster order.
+typedef struct {
+    FILE *fptr;
+    ChromaSampling sampling;
+    HuffmanCodes dc[QUANT_TABLE_COUNT], ac[QUANT_TABLE_COUNT];
+    int16_t previousDc[CHANNEL_COUNT];
+    BitWriter writer;
+} JpegWriter;
+
+// Writes every marker up to and including the start of scan. Only whole MCUs are encoded, so the
+// frame is width and height rounded down to a multiple of the MCU size (BLOCK_DIM for 4:4:4). Exits on an
+// image smaller than one MCU, which would give an empty frame.
+void beginJpeg(JpegWriter *jpeg, FILE *fptr, uint16_t width, uint16_t height, ChromaSampling sampling,
+               const Quantizer *quantizer);
+
+// 4:4:4 only
+void writeJpegBlock(JpegWriter *jpeg, const BlockQuantized *quantizedBlock);
+
+void writeJpegMcu(JpegWriter *jpeg, const McuQuantized *mcu);
+
+// Flushes the entropy-coded data and writes the end of image marker.
+void endJpeg(JpegWriter *jpeg);
+
+#endif
@@ -0,0 +1,60 @@
+#include "output.h"
+
+#include <string.h>
+
+#include "stream.h"
+#include "trace.h"
+
+TRACE_COUNTER(writeCounter, "encode/write");
+
+int parseOutputFormat(const char *const name, OutputFormat *const format) {
+    if (strcmp(name, "masq") == 0) {
+        *format = OUTPUT_MASQ;
+    } else if (strcmp(name, "jpeg") == 0) {
+        *format = OUTPUT_JPEG;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *outputExtension(OutputFormat const format) {
+    return format == OUTPUT_JPEG ? ".jpg" : ".masq";
+}
+
+BlockOutput beginOutput(OutputFormat const format, FILE *const fptr, uint16_t const width, uint16_t const height,
+                        const EncoderOptions *const options, uint32_t const unitCount) {
+    BlockOutput output = {.format=format, .sampling=options->sampling, .fptr=fptr};
+    if (format == OUTPUT_JPEG) {
+        beginJpeg(&output.jpeg, fptr, width, height, options->sampling, options->quantizer);
+    } else {
+        writeStreamHeader(fptr, width, height, options->sampling, unitCount, options->quantizer);
+    }
+    return output;
+}
+
+void writeEncodedBlock(BlockOutput *const output, const BlockQuantized *const quantizedBlock) {
+    TRACE_BEGIN(start);
+    if (output->format == OUTPUT_JPEG) {
+        writeJpegBlock(&output->jpeg, quantizedBlock);
+    } else {
+        writeBlockToStream(quantizedBlock, output->fptr);
+    }
+    TRACE_END(writeCounter, start, sizeof(BlockQuantized), 0);
+}
+
+void writeEncodedMcu(BlockOutput *const output, const McuQuantized *const mcu) {
+    TRACE_BEGIN(start);
+    if (output->format == OUTPUT_JPEG) {
+        writeJpegMcu(&output->jpeg, mcu);
+    } else {
+        writeMcuToStream(mcu, output->sampling, output->fptr);
+    }
+    TRACE_END(writeCounter, start, mcuBlockCount(output->sampling) * BLOCK_SIZE * sizeof(int16_t), 0);
+}
+
+void endOutput(BlockOutput *const output) {
+    if (output->format == OUTPUT_JPEG) {
+        endJpeg(&output->jpeg);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef DZ1_OUTPUT_H
+#define DZ1_OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "encoder.h"
+#include "jpeg.h"
+
+typedef enum {
+    OUTPUT_MASQ,
+    OUTPUT_JPEG
+} OutputFormat;
+
+// Returns 0 and sets *format when name is "masq" or "jpeg".
+int parseOutputFormat(const char *name, OutputFormat *format);
+
+// File name extension of the format, with the dot
+const char *outputExtension(OutputFormat format);
+
+// Encoded blocks (or MCUs) on their way into a file, as a raw coefficient stream or a baseline JFIF
+// file. They have to be written in raster order.
+typedef struct {
+    OutputFormat format;
+    ChromaSampling sampling;
+    FILE *fptr;
+    JpegWriter jpeg;
+} BlockOutput;
+
+// Writes the JFIF markers or the stream header, unitCount is the number of blocks or MCUs.
+BlockOutput beginOutput(OutputFormat format, FILE *fptr, uint16_t width, uint16_t height,
+                        const EncoderOptions *options, uint32_t unitCount);
+
+// 4:4:4 only
+void writeEncodedBlock(BlockOutput *output, const BlockQuantized *quantizedBlock);
+
+void writeEncodedMcu(BlockOutput *output, const McuQuantized *mcu);
+
+// Finishes the file, fptr stays open.
+void endOutput(BlockOutput *output);
+
+#endif
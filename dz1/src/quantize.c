@@ -0,0 +1,217 @@
+#include "quantize.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUANT_HAS_X86 1
+#include <immintrin.h>
+#else
+#define QUANT_HAS_X86 0
+#endif
+
+uint8_t const lumaQuantValues[DCT_SIZE] = {
+        16, 11, 10, 16, 24, 40, 51, 61,
+        12, 12, 14, 19, 26, 58, 60, 55,
+        14, 13, 16, 24, 40, 57, 69, 56,
+        14, 17, 22, 29, 51, 87, 80, 62,
+        18, 22, 37, 56, 68, 109, 103, 77,
+        24, 35, 55, 64, 81, 104, 113, 92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103, 99
+};
+
+uint8_t const chromaQuantValues[DCT_SIZE] = {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99
+};
+
+void prepareQuantTable(const uint8_t *const values, QuantTable *const table) {
+    for (size_t i = 0; i < DCT_SIZE; ++i) {
+        uint32_t const step = values[i] != 0 ? values[i] : 1;
+        uint32_t const divisor = 2 * step;
+        table->values[i] = (uint8_t) step;
+        table->bias[i] = (int32_t) step;
+        table->multiplier[i] = ((1u << QUANT_SHIFT) + divisor - 1) / divisor;
+    }
+}
+
+void scaleQuantValues(const uint8_t *const base, uint32_t const quality, uint8_t *const scaled) {
+    uint32_t const clamped = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+    uint32_t const scale = clamped < 50 ? 5000 / clamped : 200 - 2 * clamped;
+    for (size_t i = 0; i < DCT_SIZE; ++i) {
+        uint32_t const step = (base[i] * scale + 50) / 100;
+        scaled[i] = (uint8_t) (step < 1 ? 1 : step > 255 ? 255 : step);
+    }
+}
+
+void readQuantValues(const char *const file, uint8_t *const luma, uint8_t *const chroma) {
+    FILE *const fptr = fopen(file, "r");
+    if (fptr == NULL) {
+        perror("readQuantValues::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < 2 * DCT_SIZE; ++i) {
+        unsigned int step;
+        if (fscanf(fptr, "%u", &step) != 1 || step < 1 || step > 255) {
+            fprintf(stderr, "readQuantValues(): %s: expected 128 steps in [1, 255]!\n", file);
+            exit(EXIT_FAILURE);
+        }
+        if (i < DCT_SIZE) {
+            luma[i] = (uint8_t) step;
+        } else {
+            chroma[i - DCT_SIZE] = (uint8_t) step;
+        }
+    }
+    fclose(fptr);
+}
+
+void initQuantizer(Quantizer *const quantizer, const uint8_t *const luma, const uint8_t *const chroma,
+                   QuantizeFunction const quantize) {
+    quantizer->quantize = quantize;
+    prepareQuantTable(luma, &quantizer->tables[QUANT_LUMA]);
+    prepareQuantTable(chroma, &quantizer->tables[QUANT_CHROMA]);
+}
+
+void quantizeScalar(const float *const coefficients, const QuantTable *const table, int16_t *const quantized) {
+    for (size_t i = 0; i < DCT_SIZE; ++i) {
+        float const x = coefficients[i];
+        float const doubled = 2 * fabsf(x);
+        // NaN compares false and ends up at the limit, like the SIMD minimum
+        float const clamped = doubled < QUANT_INPUT_LIMIT ? doubled : QUANT_INPUT_LIMIT;
+        uint32_t const numerator = (uint32_t) clamped + (uint32_t) table->bias[i];
+        int32_t const magnitude = (int32_t) ((numerator * table->multiplier[i]) >> QUANT_SHIFT);
+        quantized[i] = (int16_t) (x < 0 ? -magnitude : magnitude);
+    }
+}
+
+#if QUANT_HAS_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i quantize4SSE41(const float *const coefficients, const int32_t *const bias,
+                                     const uint32_t *const multiplier) {
+    __m128 const x = _mm_loadu_ps(coefficients);
+    __m128 const magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    __m128 const clamped = _mm_min_ps(_mm_add_ps(magnitude, magnitude), _mm_set1_ps(QUANT_INPUT_LIMIT));
+    __m128i const numerator = _mm_add_epi32(_mm_cvttps_epi32(clamped), _mm_load_si128((const __m128i *) bias));
+    __m128i const product = _mm_mullo_epi32(numerator, _mm_load_si128((const __m128i *) multiplier));
+    // Negates where x is negative, -0.0 and 0.0 both give a magnitude of 0 anyway
+    return _mm_sign_epi32(_mm_srli_epi32(product, QUANT_SHIFT), _mm_castps_si128(x));
+}
+
+__attribute__((target("sse4.1")))
+static void quantizeSSE41(const float *const coefficients, const QuantTable *const table, int16_t *const quantized) {
+    for (size_t i = 0; i < DCT_SIZE; i += 8) {
+        __m128i const low = quantize4SSE41(coefficients + i, table->bias + i, table->multiplier + i);
+        __m128i const high = quantize4SSE41(coefficients + i + 4, table->bias + i + 4, table->multiplier + i + 4);
+        _mm_storeu_si128((__m128i *) (quantized + i), _mm_packs_epi32(low, high));
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i quantize8AVX2(const float *const coefficients, const int32_t *const bias,
+                                    const uint32_t *const multiplier) {
+    __m256 const x = _mm256_loadu_ps(coefficients);
+    __m256 const magnitude = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+    __m256 const clamped = _mm256_min_ps(_mm256_add_ps(magnitude, magnitude), _mm256_set1_ps(QUANT_INPUT_LIMIT));
+    __m256i const numerator = _mm256_add_epi32(_mm256_cvttps_epi32(clamped),
+                                               _mm256_load_si256((const __m256i *) bias));
+    __m256i const product = _mm256_mullo_epi32(numerator, _mm256_load_si256((const __m256i *) multiplier));
+    return _mm256_sign_epi32(_mm256_srli_epi32(product, QUANT_SHIFT), _mm256_castps_si256(x));
+}
+
+__attribute__((target("avx2")))
+static void quantizeAVX2(const float *const coefficients, const QuantTable *const table, int16_t *const quantized) {
+    for (size_t i = 0; i < DCT_SIZE; i += 16) {
+        __m256i const low = quantize8AVX2(coefficients + i, table->bias + i, table->multiplier + i);
+        __m256i const high = quantize8AVX2(coefficients + i + 8, table->bias + i + 8, table->multiplier + i + 8);
+        // packs works per 128-bit lane, put the quadwords back in order
+        __m256i const packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+        _mm256_storeu_si256((__m256i *) (quantized + i), packed);
+    }
+}
+
+#endif
+
+QuantizeFunction selectQuantizer(QuantKernel const kernel) {
+#if QUANT_HAS_X86
+    __builtin_cpu_init();
+    int const hasAVX2 = __builtin_cpu_supports("avx2");
+    int const hasSSE41 = __builtin_cpu_supports("sse4.1");
+    switch (kernel) {
+        case QUANT_AUTO:
+            return hasAVX2 ? quantizeAVX2 : hasSSE41 ? quantizeSSE41 : quantizeScalar;
+        case QUANT_AVX2:
+            return hasAVX2 ? quantizeAVX2 : quantizeScalar;
+        case QUANT_SSE41:
+            return hasSSE41 ? quantizeSSE41 : quantizeScalar;
+        case QUANT_SCALAR:
+        default:
+            return quantizeScalar;
+    }
+#else
+    (void) kernel;
+    return quantizeScalar;
+#endif
+}
+
+const char *quantKernelName(QuantKernel const kernel) {
+    switch (kernel) {
+        case QUANT_SCALAR:
+            return "scalar";
+        case QUANT_SSE41:
+            return "sse4.1";
+        case QUANT_AVX2:
+            return "avx2";
+        case QUANT_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+uint64_t quantMismatchCount(QuantKernel const kernel) {
+    QuantizeFunction const quantize = selectQuantizer(kernel);
+    QuantTable table;
+    uint8_t values[DCT_SIZE];
+    ALIGNED(32) float coefficients[DCT_SIZE];
+    int16_t actual[DCT_SIZE];
+    uint32_t seed = 0x85EBCA6Bu;
+    uint64_t mismatches = 0;
+    for (uint32_t quality = 1; quality <= 100; ++quality) {
+        scaleQuantValues(quality % 2 == 0 ? lumaQuantValues : chromaQuantValues, quality, values);
+        prepareQuantTable(values, &table);
+        for (uint32_t trial = 0; trial < 64; ++trial) {
+            for (size_t i = 0; i < DCT_SIZE; ++i) {
+                seed = seed * 1664525u + 1013904223u;
+                float x;
+                if (trial % 2 == 0) {
+                    // Anywhere in the range of level-shifted 8-bit DCT coefficients
+                    x = ((float) (seed >> 8) / (float) (1u << 24) - 0.5f) * 2100.0f;
+                } else {
+                    // A rounding tie (k + 0.5) * q inside [-1024, 1024], or one of its float neighbours
+                    int32_t const kLimit = 1024 / values[i];
+                    int32_t const k = (int32_t) ((seed >> 16) % (uint32_t) (2 * kLimit)) - kLimit;
+                    float const tie = ((float) k + 0.5f) * (float) values[i];
+                    int32_t const neighbour = (int32_t) ((seed >> 4) % 3) - 1;
+                    x = neighbour == 0 ? tie : nextafterf(tie, neighbour < 0 ? -INFINITY : INFINITY);
+                }
+                coefficients[i] = x;
+            }
+            quantize(coefficients, &table, actual);
+            for (size_t i = 0; i < DCT_SIZE; ++i) {
+                int16_t const expected = (int16_t) round((double) coefficients[i] / (double) values[i]);
+                if (actual[i] != expected) {
+                    ++mismatches;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
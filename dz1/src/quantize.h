@@ -0,0 +1,77 @@
+#ifndef DZ1_QUANTIZE_H
+#define DZ1_QUANTIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dct.h"
+#include "image.h"
+
+// Quantisation without division. For a step q the quantised value of x is
+//   sign(x) * floor((floor(2|x|) + q) / 2q)
+// which is exactly round(x / q) with halves rounded away from zero, the same as the old
+// round((double) x / q). The division by 2q is a multiply by ceil(2^QUANT_SHIFT / 2q) and a right
+// shift, exact for every numerator below 2^12 and every step in [1, 255].
+#define QUANT_SHIFT 21
+// 2|x| is clamped to this before quantising, so numerators stay below 2^12. DCT coefficients of
+// 8-bit samples never come close (|x| <= 1024).
+#define QUANT_INPUT_LIMIT 3840.0f
+
+typedef enum {
+    QUANT_LUMA,
+    QUANT_CHROMA,
+    QUANT_TABLE_COUNT
+} QuantTableIndex;
+
+// Standard JPEG tables (ITU T.81 Annex K), in raster order
+extern uint8_t const lumaQuantValues[DCT_SIZE];
+extern uint8_t const chromaQuantValues[DCT_SIZE];
+
+// Reciprocal form of one table, built once by prepareQuantTable().
+typedef struct {
+    ALIGNED(32) int32_t bias[DCT_SIZE];
+    ALIGNED(32) uint32_t multiplier[DCT_SIZE];
+    uint8_t values[DCT_SIZE];
+} QuantTable;
+
+// Quantises the 64 coefficients of one channel.
+typedef void (*QuantizeFunction)(const float *coefficients, const QuantTable *table, int16_t *quantized);
+
+typedef enum {
+    QUANT_AUTO,
+    QUANT_SCALAR,
+    QUANT_SSE41,
+    QUANT_AVX2
+} QuantKernel;
+
+typedef struct {
+    QuantizeFunction quantize;
+    QuantTable tables[QUANT_TABLE_COUNT];
+} Quantizer;
+
+// Steps of 0 are raised to 1.
+void prepareQuantTable(const uint8_t *values, QuantTable *table);
+
+// libjpeg quality scaling: 50 keeps the base table, 1 is the coarsest and 100 makes every step 1.
+void scaleQuantValues(const uint8_t *base, uint32_t quality, uint8_t *scaled);
+
+// Reads 128 whitespace separated steps, the luma table followed by the chroma table, both in
+// raster order. Exits with a message when the file is malformed or a step is outside [1, 255].
+void readQuantValues(const char *file, uint8_t *luma, uint8_t *chroma);
+
+void initQuantizer(Quantizer *quantizer, const uint8_t *luma, const uint8_t *chroma, QuantizeFunction quantize);
+
+void quantizeScalar(const float *coefficients, const QuantTable *table, int16_t *quantized);
+
+// Returns the requested kernel, or for QUANT_AUTO the fastest one the CPU supports. Kernels the
+// CPU (or compiler) does not support fall back to the scalar one.
+QuantizeFunction selectQuantizer(QuantKernel kernel);
+
+const char *quantKernelName(QuantKernel kernel);
+
+// Quantises pseudo-random coefficients, exact rounding ties and their float neighbours with every
+// quality level and compares the kernel against round((double) x / q). Returns the number of
+// coefficients that differ.
+uint64_t quantMismatchCount(QuantKernel kernel);
+
+#endif
@@ -0,0 +1,131 @@
+#include "stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void writeUint16(FILE *const fptr, uint16_t const value) {
+    uint8_t const bytes[2] = {value & 0xFF, value >> 8};
+    fwrite(bytes, 1, sizeof(bytes), fptr);
+}
+
+static void writeUint32(FILE *const fptr, uint32_t const value) {
+    uint8_t const bytes[4] = {value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24};
+    fwrite(bytes, 1, sizeof(bytes), fptr);
+}
+
+void writeStreamHeader(FILE *const fptr, uint16_t const width, uint16_t const height, ChromaSampling const sampling,
+                       uint32_t const unitCount, const Quantizer *const quantizer) {
+    fwrite(sampling == CHROMA_444 ? STREAM_MAGIC : STREAM_MAGIC_SUBSAMPLED, 1, STREAM_MAGIC_LENGTH, fptr);
+    writeUint16(fptr, width);
+    writeUint16(fptr, height);
+    writeUint32(fptr, unitCount);
+    if (sampling != CHROMA_444) {
+        fputc((int) (mcuBlocksX(sampling) << 4 | mcuBlocksY(sampling)), fptr);
+    }
+    fwrite(quantizer->tables[QUANT_LUMA].values, 1, BLOCK_SIZE, fptr);
+    fwrite(quantizer->tables[QUANT_CHROMA].values, 1, BLOCK_SIZE, fptr);
+}
+
+void writeBlockToStream(const BlockQuantized *const quantizedBlock, FILE *const fptr) {
+    // The planar block layout already matches the stream layout, only the byte order is fixed here
+    uint8_t bytes[STREAM_BLOCK_BYTES];
+    const int16_t *const coefficients = &quantizedBlock->channels[0][0];
+    for (size_t i = 0; i < CHANNEL_COUNT * BLOCK_SIZE; ++i) {
+        uint16_t const value = (uint16_t) coefficients[i];
+        bytes[2 * i] = value & 0xFF;
+        bytes[2 * i + 1] = value >> 8;
+    }
+    fwrite(bytes, 1, sizeof(bytes), fptr);
+}
+
+void writeMcuToStream(const McuQuantized *const mcu, ChromaSampling const sampling, FILE *const fptr) {
+    uint8_t bytes[MCU_MAX_BLOCKS * BLOCK_SIZE * 2];
+    size_t const count = mcuBlockCount(sampling) * BLOCK_SIZE;
+    const int16_t *const coefficients = &mcu->blocks[0][0];
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t const value = (uint16_t) coefficients[i];
+        bytes[2 * i] = value & 0xFF;
+        bytes[2 * i + 1] = value >> 8;
+    }
+    fwrite(bytes, 1, count * 2, fptr);
+}
+
+static void readExactly(FILE *const fptr, void *const data, size_t const size, const char *const file) {
+    if (fread(data, 1, size, fptr) != size) {
+        fprintf(stderr, "readStream(): %s: stream is truncated!\n", file);
+        exit(EXIT_FAILURE);
+    }
+}
+
+CoefficientStream readStream(const char *const file) {
+    FILE *const fptr = fopen(file, "rb");
+    if (fptr == NULL) {
+        perror("readStream::fopen()");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t header[STREAM_MAGIC_LENGTH + 8];
+    readExactly(fptr, header, sizeof(header), file);
+    int const subsampled = memcmp(header, STREAM_MAGIC_SUBSAMPLED, STREAM_MAGIC_LENGTH) == 0;
+    if (!subsampled && memcmp(header, STREAM_MAGIC, STREAM_MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "readStream(): %s: not a coefficient stream!\n", file);
+        exit(EXIT_FAILURE);
+    }
+    const uint8_t *const fields = header + STREAM_MAGIC_LENGTH;
+    CoefficientStream stream = {
+            .width=(uint16_t) (fields[0] | fields[1] << 8),
+            .height=(uint16_t) (fields[2] | fields[3] << 8),
+            .sampling=CHROMA_444,
+            .blockCount=(uint32_t) fields[4] | (uint32_t) fields[5] << 8 | (uint32_t) fields[6] << 16 |
+                        (uint32_t) fields[7] << 24,
+            .blocks=NULL, .mcus=NULL};
+    if (subsampled) {
+        uint8_t factors;
+        readExactly(fptr, &factors, 1, file);
+        if (factors == 0x21) {
+            stream.sampling = CHROMA_422;
+        } else if (factors == 0x22) {
+            stream.sampling = CHROMA_420;
+        } else {
+            fprintf(stderr, "readStream(): %s: unsupported sampling factors %02x!\n", file, factors);
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint32_t const mcuWidth = BLOCK_DIM * mcuBlocksX(stream.sampling);
+    uint32_t const mcuHeight = BLOCK_DIM * mcuBlocksY(stream.sampling);
+    if (stream.blockCount != (uint32_t) (stream.width / mcuWidth) * (stream.height / mcuHeight)) {
+        fprintf(stderr, "readStream(): %s: block count does not match the image size!\n", file);
+        exit(EXIT_FAILURE);
+    }
+    readExactly(fptr, stream.steps, sizeof(stream.steps), file);
+
+    // Every block or MCU is read as the int16 coefficients of its blocks in order
+    size_t const unitBlocks = subsampled ? mcuBlockCount(stream.sampling) : CHANNEL_COUNT;
+    int16_t *coefficients;
+    if (subsampled) {
+        stream.mcus = (McuQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(McuQuantized) * stream.blockCount);
+    } else {
+        stream.blocks = (BlockQuantized *) alignedAlloc(IMAGE_ALIGNMENT, sizeof(BlockQuantized) * stream.blockCount);
+    }
+    uint8_t bytes[MCU_MAX_BLOCKS * BLOCK_SIZE * 2];
+    for (uint32_t b = 0; b < stream.blockCount; ++b) {
+        readExactly(fptr, bytes, unitBlocks * BLOCK_SIZE * 2, file);
+        coefficients = subsampled ? &stream.mcus[b].blocks[0][0] : &stream.blocks[b].channels[0][0];
+        for (size_t i = 0; i < unitBlocks * BLOCK_SIZE; ++i) {
+            coefficients[i] = (int16_t) (uint16_t) (bytes[2 * i] | bytes[2 * i + 1] << 8);
+        }
+    }
+    fclose(fptr);
+    return stream;
+}
+
+void freeStream(CoefficientStream *const stream) {
+    if (stream->blocks != NULL) {
+        alignedFree(stream->blocks);
+    }
+    if (stream->mcus != NULL) {
+        alignedFree(stream->mcus);
+    }
+    stream->blocks = NULL;
+    stream->mcus = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef DZ1_STREAM_H
+#define DZ1_STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "encoder.h"
+
+// Binary coefficient stream: magic, width, height, block count (little-endian), the luma and chroma
+// quantisation steps (BLOCK_SIZE bytes each, raster order), followed by every block in raster order
+// as BLOCK_SIZE Y, BLOCK_SIZE Cb and BLOCK_SIZE Cr little-endian int16 coefficients.
+//
+// Streams with subsampled chroma start with STREAM_MAGIC_SUBSAMPLED instead and have the MCU count
+// in place of the block count, followed by one byte with the luma blocks per MCU horizontally (high
+// nibble) and vertically (low nibble). Every MCU is then stored as its luma blocks in raster order,
+// its Cb and its Cr block.
+#define STREAM_MAGIC "MASQ"
+#define STREAM_MAGIC_SUBSAMPLED "MASC"
+#define STREAM_MAGIC_LENGTH 4
+#define STREAM_BLOCK_BYTES (CHANNEL_COUNT * BLOCK_SIZE * 2)
+
+// unitCount is the number of blocks, or of MCUs when chroma is subsampled
+void writeStreamHeader(FILE *fptr, uint16_t width, uint16_t height, ChromaSampling sampling, uint32_t unitCount,
+                       const Quantizer *quantizer);
+
+void writeBlockToStream(const BlockQuantized *quantizedBlock, FILE *fptr);
+
+void writeMcuToStream(const McuQuantized *mcu, ChromaSampling sampling, FILE *fptr);
+
+// Whole stream loaded back into memory, blocks (or MCUs) in raster order
+typedef struct {
+    uint16_t width, height;
+    ChromaSampling sampling;
+    // Blocks with 4:4:4, MCUs otherwise
+    uint32_t blockCount;
+    uint8_t steps[QUANT_TABLE_COUNT][BLOCK_SIZE];
+    // Only one of the two is set, depending on the sampling
+    BlockQuantized *blocks;
+    McuQuantized *mcus;
+} CoefficientStream;
+
+// Exits with a message when the file is not a complete stream.
+CoefficientStream readStream(const char *file);
+
+void freeStream(CoefficientStream *stream);
+
+#endif
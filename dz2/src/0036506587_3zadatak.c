@@ -2,92 +2,152 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define N_GROUPS 16
-
-typedef struct {
-    uint8_t val;
-} PixelGS8;
-
-typedef struct {
-    char type[3];
-    uint16_t width, height, maxVal;
-    PixelGS8 *data;
-} ImagePGM;
-
+#include "bitwriter.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "netpbm.h"
+#include "options.h"
+#include "threadpool.h"
 
-void skipComments(FILE *file) {
-    unsigned char c;
-    while ((c = getc(file)) == '#') {
-        while (getc(file) != '\n');
-    }
-    ungetc(c, file);
-}
+#define N_GROUPS 16
 
-ImagePGM readPGMImage(const char *pgmFile) {
-    FILE *file = fopen(pgmFile, "rb");
-    if (file == NULL) {
-        perror("readPGMImage()::fopen()");
+// Encodes the bins of every sample of one channel with the code and decodes them again with the
+// lookup table decoder. Returns 1 when every symbol came back.
+int roundTrip(const NetpbmImage *image, uint32_t channel, uint32_t binCount, const HuffmanCode *code) {
+    size_t count = (size_t) image->width * image->height;
+    uint8_t *symbols = (uint8_t *) malloc(count);
+    uint8_t *decoded = (uint8_t *) malloc(count);
+    if (symbols == NULL || decoded == NULL) {
+        perror("roundTrip::malloc()");
         exit(EXIT_FAILURE);
     }
-
-    skipComments(file);
-
-    char magicNumber[3];
-    if (fscanf(file, "%s\n", magicNumber) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing 'magic number' failed!\n");
-        exit(EXIT_FAILURE);
+    for (uint32_t i = 0; i < image->height; ++i) {
+        const uint8_t *row = image->pixels + i * image->stride;
+        for (uint32_t j = 0; j < image->width; ++j) {
+            uint32_t value = row[(size_t) j * image->channels + channel];
+            symbols[(size_t) i * image->width + j] = (uint8_t) (value * binCount / 256);
+        }
     }
 
-    skipComments(file);
-
-    uint16_t width;
-    if (fscanf(file, "%hu\n", &width) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing width failed!\n");
-        exit(EXIT_FAILURE);
-    }
+    BitWriter writer;
+    initBitWriter(&writer, 0);
+    encodeHuffmanSymbols(&writer, code, symbols, count);
+    alignBitWriter(&writer, 0);
+    HuffmanDecoder decoder;
+    buildHuffmanDecoder(&decoder, code);
+    int same = decodeHuffmanSymbols(&decoder, writer.data, writer.size, decoded, count) == count &&
+               memcmp(symbols, decoded, count) == 0;
+
+    freeBitWriter(&writer);
+    free(decoded);
+    free(symbols);
+    return same;
+}
 
-    skipComments(file);
+void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-b bins] [-t threads] [-H maxLength] [-v] [image.pgm|image.ppm]\n"
+                    "Prints the share of samples in each of 'bins' (default %d, at most %d) equal ranges of values, "
+                    "one line per bin with a column per channel. Images default to lenna.pgm. The histogram is "
+                    "counted on 'threads' threads (default 1, 0 uses every CPU); -v adds the entropy of every "
+                    "channel in bits per sample. With -H, prints the optimal canonical Huffman code of at most "
+                    "'maxLength' bits (at most %d) of every bin instead, one \"bin code\" line per occurring bin and "
+                    "a block per channel; -v then adds the bits per symbol against the entropy and checks that the image "
+                    "decodes back.\n", program, N_GROUPS, HISTOGRAM_MAX_BINS, HUFFMAN_MAX_LENGTH);
+}
 
-    uint16_t height;
-    if (fscanf(file, "%hu\n", &height) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing height failed!\n");
-        exit(EXIT_FAILURE);
+int main(int argc, char *argv[]) {
+    uint32_t binCount = N_GROUPS;
+    uint32_t threadCount = 1;
+    uint32_t maxCodeLength = 0;
+    int verbose = 0;
+    int option;
+    while ((option = getopt(argc, argv, "b:t:H:v")) != -1) {
+        switch (option) {
+            case 'b':
+                if (parseUint32Option(optarg, 1, HISTOGRAM_MAX_BINS, &binCount) != 0) {
+                    fprintf(stderr, "Bin count must be between 1 and %d!\n", HISTOGRAM_MAX_BINS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (parseUint32Option(optarg, 0, THREAD_COUNT_MAX, &threadCount) != 0) {
+                    fprintf(stderr, "Thread count must be between 0 and %d!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'H':
+                if (parseUint32Option(optarg, 1, HUFFMAN_MAX_LENGTH, &maxCodeLength) != 0) {
+                    fprintf(stderr, "Code length must be between 1 and %d!\n", HUFFMAN_MAX_LENGTH);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
     }
-
-    skipComments(file);
-
-    uint16_t maxVal;
-    if (fscanf(file, "%hu\n", &maxVal) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing maxVal failed!\n");
-        exit(EXIT_FAILURE);
+    if (argc - optind > 1) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
     }
 
-    uint32_t size = width * height;
-    PixelGS8 *data = (PixelGS8 *) malloc(sizeof(PixelGS8) * size);
-    if (fread(data, sizeof(PixelGS8), size, file) != size) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing data failed!\n");
-        exit(EXIT_FAILURE);
+    NetpbmImage image = openNetpbmImage(optind < argc ? argv[optind] : "lenna.pgm", NULL);
+    ThreadPool *pool = threadCount != 1 ? createThreadPool(threadCount) : NULL;
+    Histogram histogram;
+    initHistogram(&histogram, binCount, image.channels);
+    addHistogramImage(&histogram, &image, pool);
+
+    int status = EXIT_SUCCESS;
+    double size = (double) histogram.sampleCount;
+    for (uint32_t c = 0; maxCodeLength > 0 && c < histogram.channels; ++c) {
+        HuffmanCode code;
+        buildHuffmanCode(&code, histogram.counts[c], binCount, maxCodeLength);
+        if (histogram.channels > 1) {
+            fprintf(stdout, "# channel %u\n", c);
+        }
+        for (uint32_t i = 0; i < binCount; ++i) {
+            if (code.lengths[i] == 0) {
+                continue;
+            }
+            fprintf(stdout, "%u ", i);
+            for (uint32_t bit = code.lengths[i]; bit-- > 0;) {
+                fputc('0' + (int) (code.codes[i] >> bit & 1), stdout);
+            }
+            fprintf(stdout, "\n");
+        }
+        if (verbose) {
+            double bits = huffmanBitsPerSymbol(&code, histogram.counts[c]);
+            double entropy = histogramEntropy(&histogram, c);
+            int same = roundTrip(&image, c, binCount, &code);
+            fprintf(stdout, "channel %u: %.4f bits per symbol, entropy %.4f bits (+%.2f%%), longest code %u bits, "
+                            "round trip %s\n", c, bits, entropy, entropy > 0.0 ? 100.0 * (bits / entropy - 1.0) : 0.0,
+                    code.maxLength, same ? "OK" : "FAIL");
+            if (!same) {
+                status = EXIT_FAILURE;
+            }
+        }
     }
-
-    fclose(file);
-
-    ImagePGM image = {.width=width, .height=height, .maxVal=maxVal, .data=data};
-    strcpy(image.type, magicNumber);
-    return image;
-}
-
-
-int main(int argc, char *argv[]) {
-    ImagePGM image = readPGMImage(argc < 2 ? "lenna.pgm" : argv[1]);
-    uint32_t groups[N_GROUPS] = {0};
-    uint32_t size = image.width * image.height;
-    for (size_t i = 0; i < size; ++i) {
-        ++groups[(image.data[i].val >> 4) % N_GROUPS];
+    for (uint32_t i = 0; maxCodeLength == 0 && i < binCount; ++i) {
+        fprintf(stdout, "%u", i);
+        for (uint32_t c = 0; c < histogram.channels; ++c) {
+            fprintf(stdout, " %f", (double) histogram.counts[c][i] / size);
+        }
+        fprintf(stdout, "\n");
+    }
+    if (verbose && maxCodeLength == 0) {
+        for (uint32_t c = 0; c < histogram.channels; ++c) {
+            fprintf(stdout, "channel %u: entropy %.4f bits\n", c, histogramEntropy(&histogram, c));
+        }
     }
-    for (size_t i = 0; i < N_GROUPS; ++i) {
-        fprintf(stdout, "%zu %f\n", i, (double) groups[i] / size);
+
+    if (pool != NULL) {
+        destroyThreadPool(pool);
     }
-    free(image.data);
-    return EXIT_SUCCESS;
+    closeNetpbmImage(&image);
+    return status;
 }
@@ -1,170 +1,422 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <float.h>
+#include <time.h>
+#include <unistd.h>
 
-#define BLOCK_WIDTH 16
-#define BLOCK_HEIGHT 16
-#define BLOCK_SIZE (BLOCK_WIDTH * BLOCK_HEIGHT)
+#include "field.h"
+#include "motion.h"
+#include "options.h"
+#include "pgm.h"
+#include "sad.h"
+#include "sequence.h"
+#include "subpel.h"
+#include "threadpool.h"
+#include "trace.h"
 
 typedef struct {
-    uint8_t val;
-} PixelGS8;
+    SearchStats work;
+    uint32_t exactCount;
+    double distance;
+    double madIncrease;
+} ComparisonStats;
 
-typedef struct {
-    char type[3];
-    uint16_t width, height, maxVal;
-    PixelGS8 **data;
-} ImagePGM;
-
-typedef struct {
-    int32_t x;
-    int32_t y;
-    double mad;
-} Point;
+// Runs every search kind with the given range, pyramid levels, precision and early exits over the
+// whole frame and reports its cost and quality relative to full search at full resolution without
+// early exits. Rows are the candidate block rows summed per block, stopped the share of blocks the
+// good enough threshold ended early.
+void compareSearches(const ImagePGM *currentImg, const ImagePGM *previousImg, const SearchOptions *baseOptions,
+                     SearchScratch *scratch) {
+    uint32_t blockCount = blockCountOf(currentImg);
+    if (blockCount == 0) {
+        fprintf(stderr, "compareSearches(): image is smaller than one block!\n");
+        exit(EXIT_FAILURE);
+    }
+    SearchOptions fullOptions = *baseOptions;
+    fullOptions.kind = SEARCH_FULL;
+    fullOptions.levels = 1;
+    fullOptions.earlyExit = 0;
+    fullOptions.goodEnough = 0;
+    SearchStats fullWork;
+    MotionField fullField = computeMotionField(currentImg, previousImg, &fullOptions, scratch, &fullWork);
 
-void skipComments(FILE *file) {
-    unsigned char c;
-    while ((c = getc(file)) == '#') {
-        while (getc(file) != '\n');
+    fprintf(stdout, "%-10s %12s %8s %10s %8s %8s %9s %9s\n", "search", "evals/block", "speedup", "rows/block",
+            "stopped", "exact", "distance", "mad diff");
+    for (int k = 0; k < SEARCH_KIND_COUNT; ++k) {
+        SearchOptions options = *baseOptions;
+        options.kind = (SearchKind) k;
+        ComparisonStats stats = {0};
+        MotionField field = computeMotionField(currentImg, previousImg, &options, scratch, &stats.work);
+        for (uint32_t i = 0; i < blockCount; ++i) {
+            const Point *vector = &field.vectors[i];
+            const Point *full = &fullField.vectors[i];
+            int32_t dx = vector->x - full->x;
+            int32_t dy = vector->y - full->y;
+            stats.exactCount += dx == 0 && dy == 0;
+            stats.distance += sqrt((double) (dx * dx + dy * dy)) / field.unitsPerPixel;
+            stats.madIncrease += vector->mad - full->mad;
+        }
+        fprintf(stdout, "%-10s %12.1f %7.1fx %10.1f %7.1f%% %7.1f%% %9.3f %9.3f\n", searchKindName(options.kind),
+                (double) stats.work.evaluations / blockCount,
+                (double) fullWork.evaluations / stats.work.evaluations, (double) stats.work.rowsSummed / blockCount,
+                100.0 * stats.work.earlyStops / blockCount, 100.0 * stats.exactCount / blockCount,
+                stats.distance / blockCount, stats.madIncrease / blockCount);
+        freeMotionField(&field);
     }
-    ungetc(c, file);
+    freeMotionField(&fullField);
 }
 
-ImagePGM readPGMImage(const char *pgmFile) {
-    FILE *file = fopen(pgmFile, "rb");
-    if (file == NULL) {
-        perror("readPGMImage()::fopen()");
-        exit(EXIT_FAILURE);
-    }
+static double secondsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
 
-    skipComments(file);
+static void printFieldWork(uint32_t pairCount, uint32_t threadCount, double elapsed, const SearchStats *work) {
+    uint64_t rows = work->rowsSummed + work->rowsSkipped;
+    fprintf(stdout, "%u pairs, %u threads: %.3f ms, %llu evaluations, %.1f%% of rows skipped, %llu blocks stopped "
+                    "early\n", pairCount, threadCount, elapsed * 1e3, (unsigned long long) work->evaluations,
+            rows > 0 ? 100.0 * work->rowsSkipped / rows : 0.0, (unsigned long long) work->earlyStops);
+}
 
-    char magicNumber[3];
-    if (fscanf(file, "%s\n", magicNumber) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing 'magic number' failed!\n");
+// Writes the motion fields of consecutive pairs of frames given in display order
+void writeFields(char *const *files, uint32_t frameCount, const SearchOptions *options, uint32_t threadCount,
+                 int pinThreads, const char *fieldFile, FieldFormat fieldFormat, int verbose) {
+    ImagePGM *frames = (ImagePGM *) malloc(sizeof(ImagePGM) * frameCount);
+    MotionField *fields = (MotionField *) malloc(sizeof(MotionField) * (frameCount - 1));
+    if (frames == NULL || fields == NULL) {
+        perror("writeFields::malloc()");
         exit(EXIT_FAILURE);
     }
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        frames[i] = readPGMImage(files[i]);
+        if (frames[i].width != frames[0].width || frames[i].height != frames[0].height) {
+            fprintf(stderr, "writeFields(): %s: frame size differs from %s!\n", files[i], files[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    skipComments(file);
+    MotionEstimator estimator = createMotionEstimator(options, threadCount, pinThreads);
+    SearchStats work;
+    double start = secondsNow();
+    estimateMotionFields(&estimator, frames, frameCount, fields, &work);
+    double elapsed = secondsNow() - start;
+    writeMotionFields(fields, frameCount - 1, fieldFile, fieldFormat);
+    if (verbose) {
+        printFieldWork(frameCount - 1, estimator.workerCount, elapsed, &work);
+    }
 
-    uint16_t width;
-    if (fscanf(file, "%hu\n", &width) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing width failed!\n");
-        exit(EXIT_FAILURE);
+    freeMotionEstimator(&estimator);
+    for (uint32_t i = 0; i < frameCount - 1; ++i) {
+        freeMotionField(&fields[i]);
     }
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        freePGMImage(&frames[i]);
+    }
+    free(fields);
+    free(frames);
+}
 
-    skipComments(file);
+// Decoded frames kept in memory while streaming: previous, current and two read ahead
+#define SEQUENCE_SLOTS 4
 
-    uint16_t height;
-    if (fscanf(file, "%hu\n", &height) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing height failed!\n");
+// Writes the field of every consecutive pair of a streamed sequence as soon as it is computed.
+// Every frame is decoded and prepared once and serves as the current frame of one pair and the
+// previous frame of the next.
+void streamFields(const char *source, const SearchOptions *options, uint32_t threadCount, int pinThreads,
+                  const char *fieldFile, FieldFormat fieldFormat, int verbose) {
+    FrameSequence *sequence = openFrameSequence(source, SEQUENCE_SLOTS);
+    const ImagePGM *previousImg = nextSequenceFrame(sequence);
+    if (previousImg == NULL) {
+        fprintf(stderr, "streamFields(): %s: sequence has no frames!\n", source);
         exit(EXIT_FAILURE);
     }
+    MotionEstimator estimator = createMotionEstimator(options, threadCount, pinThreads);
+    FieldWriter writer = openFieldWriter(fieldFile, fieldFormat);
+    PreparedFrame previous = prepareFrame(previousImg, options, 1);
 
-    skipComments(file);
+    SearchStats work = {0};
+    double start = secondsNow();
+    const ImagePGM *currentImg;
+    while ((currentImg = nextSequenceFrame(sequence)) != NULL) {
+        if (currentImg->width != previousImg->width || currentImg->height != previousImg->height) {
+            fprintf(stderr, "streamFields(): %s: frame %u is %ux%u, the sequence is %ux%u!\n", source,
+                    writer.fieldCount + 1, currentImg->width, currentImg->height, previousImg->width,
+                    previousImg->height);
+            exit(EXIT_FAILURE);
+        }
+        PreparedFrame current = prepareFrame(currentImg, options, 1);
+        SearchStats pairWork;
+        MotionField field = estimatePreparedField(&estimator, &current, &previous, &pairWork);
+        writeFieldRecord(&writer, &field);
+        freeMotionField(&field);
+        addSearchStats(&work, &pairWork);
 
-    uint16_t maxVal;
-    if (fscanf(file, "%hu\n", &maxVal) != 1) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing maxVal failed!\n");
-        exit(EXIT_FAILURE);
+        releasePreparedFrame(&previous);
+        releaseSequenceFrame(sequence);
+        previous = current;
+        previousImg = currentImg;
     }
-
-    uint32_t size = width * height;
-    PixelGS8 *linearData = (PixelGS8 *) malloc(sizeof(PixelGS8) * size);
-    if (fread(linearData, sizeof(PixelGS8), size, file) != size) {
-        fprintf(stderr, "readPGMImage()::fscanf() - Parsing data failed!\n");
-        exit(EXIT_FAILURE);
+    double elapsed = secondsNow() - start;
+    if (verbose) {
+        printFieldWork(writer.fieldCount, estimator.workerCount, elapsed, &work);
     }
-    fclose(file);
 
-    PixelGS8 **matrixData = (PixelGS8 **) malloc(sizeof(PixelGS8 *) * height);
-    for (size_t i = 0; i < height; ++i) {
-        matrixData[i] = (PixelGS8 *) malloc(sizeof(PixelGS8) * width);
-        for (size_t j = 0; j < width; ++j) {
-            matrixData[i][j] = linearData[i * width + j];
+    releasePreparedFrame(&previous);
+    releaseSequenceFrame(sequence);
+    closeFieldWriter(&writer);
+    freeMotionEstimator(&estimator);
+    closeFrameSequence(sequence);
+}
+
+// Compares every SAD kernel with the scalar one
+int check(void) {
+    SadKernel kernels[] = {SAD_AUTO, SAD_SSE2, SAD_AVX2};
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        uint64_t mismatches = sadMismatchCount(kernels[i]);
+        fprintf(stdout, "sad %-8s %llu mismatches %s\n", sadKernelName(kernels[i]),
+                (unsigned long long) mismatches, mismatches == 0 ? "OK" : "FAIL");
+        if (mismatches != 0) {
+            status = EXIT_FAILURE;
         }
     }
-    free(linearData);
+    return status;
+}
 
-    ImagePGM image = {.width=width, .height=height, .maxVal=maxVal, .data=matrixData};
-    strcpy(image.type, magicNumber);
-    return image;
+void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-s full|tss|diamond|hexagon|predictive] [-k auto|scalar|sse2|avx2] [-r range] "
+                    "[-l levels] [-a int|half|quarter] [-e] [-g mad] [-v] blockIndex [current.pgm previous.pgm]\n"
+                    "       %s [-s kind] [-k kernel] [-r range] [-l levels] [-a precision] [-t threads] [-p] "
+                    "[-f csv|bin] [-j summary.json] [-T trace.json] [-v] -o field [current.pgm previous.pgm]\n"
+                    "       %s [-s kind] [-k kernel] [-r range] [-l levels] [-a precision] [-t threads] [-p] "
+                    "[-f csv|bin] [-v] -o field -S frame0.pgm frame1.pgm ...\n"
+                    "       %s [-s kind] [-k kernel] [-r range] [-l levels] [-a precision] [-t threads] [-p] "
+                    "[-f csv|bin] [-v] -o field -i directory|frames.pgm|-\n"
+                    "       %s [-k kernel] [-r range] [-l levels] [-a precision] [-e] [-g mad] -c "
+                    "[current.pgm previous.pgm]\n"
+                    "       %s --check\n"
+                    "Prints the motion vector of one 16x16 block (-v adds the number of SAD evaluations and the "
+                    "difference from full search), with -o writes the vectors of every block to a CSV (default) or "
+                    "binary file, or with -c compares every search over the whole frame. With -S the frames are a "
+                    "sequence in display order and a field is written for every consecutive pair; -i streams such a "
+                    "sequence from every .pgm file of a directory, a file of concatenated P5 images or stdin (-) "
+                    "with bounded memory. "
+                    "-k picks the SAD kernel (default auto, the fastest one the CPU supports). Offsets up to 'range' "
+                    "pixels (default 16) are searched; with 2 or 3 levels the search runs on a pyramid of halved "
+                    "images and is refined coarse to fine. With -a half or quarter, vectors are refined over "
+                    "interpolated planes of the previous frame and reported in fractions of a pixel. -e stops summing "
+                    "a candidate as soon as it cannot beat the best match and runs full search in a spiral from "
+                    "offset 0, which changes no result; -g stops a search once a block matches with a mad of at "
+                    "most 'mad'. Fields are "
+                    "computed on 'threads' threads (default 1, 0 uses every CPU), -p pins them to CPUs; the output does not "
+                    "depend on either. In builds with MAS_TRACE, -j writes the time, calls, SAD evaluations and bytes "
+                    "of every stage of the field modes as JSON and -T a Chrome trace of every call. "
+                    "Frames default to lenna1.pgm and lenna.pgm.\n",
+            program, program, program, program, program, program);
 }
 
-void freePGMImage(ImagePGM *img) {
-    for (size_t i = 0; i < img->height; ++i) {
-        free(img->data[i]);
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
     }
-    free(img->data);
-}
 
-double calculateMAD(ImagePGM *img1, uint32_t originX1, uint32_t originY1,
-                    ImagePGM *img2, uint32_t originX2, uint32_t originY2) {
-    double mad = 0.0;
-    for (size_t i = 0; i < BLOCK_HEIGHT; ++i) {
-        PixelGS8 *img1Row = img1->data[originY1 + i];
-        PixelGS8 *img2Row = img2->data[originY2 + i];
-        for (size_t j = 0; j < BLOCK_WIDTH; ++j) {
-            mad += abs(img1Row[originX1 + j].val - img2Row[originX2 + j].val);
+    SearchKind kind = SEARCH_FULL;
+    uint32_t range = SEARCH_RANGE;
+    uint32_t levels = 1;
+    SubpelPrecision precision = SUBPEL_NONE;
+    SadKernel sadKernel = SAD_AUTO;
+    const char *fieldFile = NULL;
+    FieldFormat fieldFormat = FIELD_CSV;
+    uint32_t threadCount = 1;
+    int pinThreads = 0;
+    int sequence = 0;
+    const char *streamSource = NULL;
+    int earlyExit = 0;
+    double goodEnoughMad = -1.0;
+    const char *summaryFile = NULL;
+    const char *chromeFile = NULL;
+    int compare = 0;
+    int verbose = 0;
+    int option;
+    while ((option = getopt(argc, argv, "s:k:r:l:a:eg:o:f:t:pSi:j:T:cv")) != -1) {
+        switch (option) {
+            case 's':
+                if (parseSearchKind(optarg, &kind) != 0) {
+                    fprintf(stderr, "Unknown search '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'k':
+                if (parseSadKernel(optarg, &sadKernel) != 0) {
+                    fprintf(stderr, "Unknown SAD kernel '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                if (parseUint32Option(optarg, 1, SEARCH_RANGE_MAX, &range) != 0) {
+                    fprintf(stderr, "Search range must be between 1 and %d!\n", SEARCH_RANGE_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if (parseUint32Option(optarg, 1, PYRAMID_MAX_LEVELS, &levels) != 0) {
+                    fprintf(stderr, "Pyramid levels must be between 1 and %d!\n", PYRAMID_MAX_LEVELS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'a':
+                if (parseSubpelPrecision(optarg, &precision) != 0) {
+                    fprintf(stderr, "Unknown precision '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'e':
+                earlyExit = 1;
+                break;
+            case 'g':
+                goodEnoughMad = atof(optarg);
+                if (goodEnoughMad < 0.0 || goodEnoughMad > 255.0) {
+                    fprintf(stderr, "Good enough mad must be between 0 and 255!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                fieldFile = optarg;
+                break;
+            case 'f':
+                if (parseFieldFormat(optarg, &fieldFormat) != 0) {
+                    fprintf(stderr, "Unknown field format '%s'!\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (parseUint32Option(optarg, 0, THREAD_COUNT_MAX, &threadCount) != 0) {
+                    fprintf(stderr, "Thread count must be between 0 and %d!\n", THREAD_COUNT_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p':
+                pinThreads = 1;
+                break;
+            case 'S':
+                sequence = 1;
+                break;
+            case 'i':
+                streamSource = optarg;
+                break;
+            case 'j':
+                summaryFile = optarg;
+                break;
+            case 'T':
+                chromeFile = optarg;
+                break;
+            case 'c':
+                compare = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
         }
     }
-    return mad / BLOCK_SIZE;
-}
+    SearchOptions options = makeSearchOptions(kind, (int32_t) range, levels, sadKernel);
+    options.subpel = precision;
+    options.earlyExit = earlyExit;
+    // A mad of at most goodEnoughMad is a SAD below the next integer above goodEnoughMad * BLOCK_SIZE
+    if (goodEnoughMad >= 0.0) {
+        options.goodEnough = (uint32_t) floor(goodEnoughMad * BLOCK_SIZE) + 1;
+    }
 
-Point findMovementVector(ImagePGM *currentImg, ImagePGM *previousImg, uint16_t blockIndex) {
-    Point vector;
-
-    uint16_t width = currentImg->width;
-    uint16_t height = currentImg->height;
-
-    uint32_t xBlockCount = width / BLOCK_WIDTH;
-    uint32_t yBlockCount = height / BLOCK_HEIGHT;
-    uint32_t currentImgOriginX = blockIndex % xBlockCount * BLOCK_WIDTH;
-    uint32_t currentImgOriginY = blockIndex / yBlockCount * BLOCK_HEIGHT;
-
-    int32_t previousImgOriginY = (int32_t) (currentImgOriginY - BLOCK_HEIGHT);
-    int32_t previousImgEndY = (int32_t) (currentImgOriginY + BLOCK_HEIGHT);
-    int32_t previousImgOriginX = (int32_t) (currentImgOriginX - BLOCK_WIDTH);
-    int32_t previousImgEndX = (int32_t) (currentImgOriginX + BLOCK_WIDTH);
-
-    double minMAD = DBL_MAX;
-    for (int32_t originY = previousImgOriginY; originY <= previousImgEndY; ++originY) {
-        if (originY < 0) continue;
-        if (originY + BLOCK_HEIGHT - 1 >= height) break;
-        for (int32_t originX = previousImgOriginX; originX <= previousImgEndX; ++originX) {
-            if (originX < 0) continue;
-            if (originX + BLOCK_WIDTH - 1 >= width) break;
-            double currentMAD = calculateMAD(currentImg, currentImgOriginX, currentImgOriginY,
-                                             previousImg, originX, originY);
-            if (currentMAD < minMAD) {
-                minMAD = currentMAD;
-                vector.x = originX - (int32_t) currentImgOriginX;
-                vector.y = originY - (int32_t) currentImgOriginY;
-                vector.mad = minMAD;
-            }
+    // Whole frame modes take no block index
+    int wholeFrame = compare || fieldFile != NULL;
+    int positional = argc - optind;
+    int fileIndex = wholeFrame ? optind : optind + 1;
+    if ((compare && fieldFile != NULL) || (sequence && (fieldFile == NULL || positional < 2)) ||
+        (streamSource != NULL && (fieldFile == NULL || sequence || positional != 0)) ||
+        (!wholeFrame && positional != 1 && positional != 3) ||
+        (wholeFrame && !sequence && positional != 0 && positional != 2)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (fieldFile != NULL) {
+        traceStart(summaryFile, chromeFile);
+        if (streamSource != NULL) {
+            streamFields(streamSource, &options, threadCount, pinThreads, fieldFile, fieldFormat, verbose);
+        } else if (sequence) {
+            writeFields(argv + optind, (uint32_t) positional, &options, threadCount, pinThreads, fieldFile,
+                        fieldFormat, verbose);
+        } else {
+            // A single pair is given as current, previous
+            char *pair[2] = {positional == 2 ? argv[optind + 1] : "lenna.pgm",
+                             positional == 2 ? argv[optind] : "lenna1.pgm"};
+            writeFields(pair, 2, &options, threadCount, pinThreads, fieldFile, fieldFormat, verbose);
         }
+        traceFinish();
+        return EXIT_SUCCESS;
     }
 
-    return vector;
-}
+    const char *currentFile = argc - fileIndex < 2 ? "lenna1.pgm" : argv[fileIndex];
+    const char *previousFile = argc - fileIndex < 2 ? "lenna.pgm" : argv[fileIndex + 1];
+    ImagePGM currentImg = readPGMImage(currentFile);
+    ImagePGM previousImg = readPGMImage(previousFile);
+    // The search window comes from the current frame but is read from the previous one
+    if (currentImg.width != previousImg.width || currentImg.height != previousImg.height) {
+        fprintf(stderr, "%s: frame size differs from %s!\n", previousFile, currentFile);
+        return EXIT_FAILURE;
+    }
 
-int main(int argc, char *argv[]) {
-    uint16_t blockIndex = atoi(argv[1]);
-    ImagePGM currentImg;
-    ImagePGM previousImg;
-    if (argc < 3) {
-        currentImg = readPGMImage("lenna1.pgm");
-        previousImg = readPGMImage("lenna.pgm");
+    SearchScratch scratch = createSearchScratch(options.range);
+    if (compare) {
+        compareSearches(&currentImg, &previousImg, &options, &scratch);
     } else {
-        currentImg = readPGMImage(argv[2]);
-        previousImg = readPGMImage(argv[3]);
+        uint32_t blockCount = blockCountOf(&currentImg);
+        uint32_t blockIndex;
+        if (blockCount == 0 || parseUint32Option(argv[optind], 0, blockCount - 1, &blockIndex) != 0) {
+            fprintf(stderr, "Block index %s is out of range, the image has %u blocks!\n", argv[optind], blockCount);
+            return EXIT_FAILURE;
+        }
+        Pyramid current = buildPyramid(&currentImg, options.levels);
+        Pyramid previous = buildPyramid(&previousImg, options.levels);
+        SearchStats work = {0};
+        Point vector = findMovementVectorPyramid(&current, &previous, blockIndex, &options, NULL, 0, &scratch, &work);
+        freePyramid(&previous);
+        freePyramid(&current);
+        double units = (double) options.subpel;
+        if (options.subpel > 1) {
+            SubpelPlanes planes = buildSubpelPlanes(&previousImg, precision);
+            vector = refineSubpel(&currentImg, &planes, blockIndex, vector, options.range, options.sad[SAD_16X16],
+                                  options.earlyExit ? options.sadBounded : NULL, &work);
+            freeSubpelPlanes(&planes);
+            fprintf(stdout, "%.2f,%.2f\n", vector.x / units, vector.y / units);
+        } else {
+            fprintf(stdout, "%d,%d\n", vector.x, vector.y);
+        }
+        if (verbose) {
+            SearchOptions fullOptions = options;
+            fullOptions.kind = SEARCH_FULL;
+            fullOptions.levels = 1;
+            fullOptions.earlyExit = 0;
+            fullOptions.goodEnough = 0;
+            SearchStats fullWork = {0};
+            Point full = findMovementVector(&currentImg, &previousImg, blockIndex, &fullOptions, NULL, 0, &scratch,
+                                            &fullWork);
+            fprintf(stdout, "%s: %llu evaluations, %llu rows summed, %llu skipped, %s, mad %.3f\n",
+                    searchKindName(options.kind), (unsigned long long) work.evaluations,
+                    (unsigned long long) work.rowsSummed, (unsigned long long) work.rowsSkipped,
+                    work.earlyStops > 0 ? "stopped early" : "searched to the end", vector.mad);
+            fprintf(stdout, "full: %d,%d, %llu evaluations, mad %.3f, distance %.3f\n", full.x, full.y,
+                    (unsigned long long) fullWork.evaluations, full.mad,
+                    hypot(vector.x / units - full.x, vector.y / units - full.y));
+        }
     }
 
-    Point vector = findMovementVector(&currentImg, &previousImg, blockIndex);
-    fprintf(stdout, "%d,%d\n", vector.x, vector.y);
-
+    freeSearchScratch(&scratch);
     freePGMImage(&currentImg);
     freePGMImage(&previousImg);
     return EXIT_SUCCESS;
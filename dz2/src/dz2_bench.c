@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bitwriter.h"
+#include "field.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "motion.h"
+#include "pgm.h"
+#include "sad.h"
+
+// Motion between the two synthetic frames
+#define SHIFT_X 3
+#define SHIFT_Y (-2)
+
+// Everything the stages work on. Per-block stages walk the blocks of the frame in raster order, one
+// block per operation, and fold something of every result into sink.
+typedef struct {
+    const char *file;
+    ImagePGM currentImg, previousImg;
+    // RGB version of the frame for the per-channel histogram
+    uint8_t *rgb;
+    SearchOptions options;
+    SearchScratch scratch;
+    SadFunction sad;
+    uint32_t blockCount, blockNumber;
+    uint32_t binCount;
+    uint8_t *symbols;
+    size_t symbolCount;
+    HuffmanCode code;
+    HuffmanDecoder decoder;
+    BitWriter writer;
+    // The symbols coded once up front, what the decode stage reads whatever else runs
+    BitWriter encoded;
+    uint64_t sink;
+} Dz2Bench;
+
+static uint32_t nextBlock(Dz2Bench *bench) {
+    uint32_t block = bench->blockNumber;
+    bench->blockNumber = block + 1 < bench->blockCount ? block + 1 : 0;
+    return block;
+}
+
+static void benchParseFile(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        ImagePGM img = readPGMImage(bench->file);
+        bench->sink += pgmRow(&img, img.height / 2)[img.width / 2].val;
+        freePGMImage(&img);
+    }
+}
+
+static void benchSad(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    const ImagePGM *current = &bench->currentImg;
+    uint32_t xBlockCount = current->width / BLOCK_WIDTH;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        uint32_t block = nextBlock(bench);
+        uint32_t x = block % xBlockCount * BLOCK_WIDTH;
+        uint32_t y = block / xBlockCount * BLOCK_HEIGHT;
+        const uint8_t *pixels = &pgmRow(current, y)[x].val;
+        const uint8_t *reference = &pgmRow(&bench->previousImg, y)[x].val;
+        bench->sink += bench->sad(pixels, current->stride, reference, bench->previousImg.stride);
+    }
+}
+
+static void benchSearch(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        Point vector = findMovementVector(&bench->currentImg, &bench->previousImg, nextBlock(bench), &bench->options,
+                                          NULL, 0, &bench->scratch, NULL);
+        bench->sink += (uint64_t) (vector.x + 2 * vector.y);
+    }
+}
+
+static void benchField(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        MotionField field = computeMotionField(&bench->currentImg, &bench->previousImg, &bench->options,
+                                               &bench->scratch, NULL);
+        bench->sink += (uint64_t) field.vectors[0].x;
+        freeMotionField(&field);
+    }
+}
+
+static void benchHistogram(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        Histogram histogram;
+        initHistogram(&histogram, bench->binCount, 1);
+        addHistogramSamples(&histogram, &pgmRow(&bench->currentImg, 0)->val, bench->currentImg.stride,
+                            bench->currentImg.width, bench->currentImg.height, NULL);
+        bench->sink += histogram.counts[0][bench->binCount / 2];
+    }
+}
+
+static void benchHistogramRGB(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        Histogram histogram;
+        initHistogram(&histogram, HISTOGRAM_MAX_BINS, 3);
+        addHistogramSamples(&histogram, bench->rgb, (size_t) bench->currentImg.width * 3, bench->currentImg.width,
+                            bench->currentImg.height, NULL);
+        bench->sink += histogram.counts[2][128];
+    }
+}
+
+static void benchHuffmanEncode(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        clearBitWriterBuffer(&bench->writer);
+        encodeHuffmanSymbols(&bench->writer, &bench->code, bench->symbols, bench->symbolCount);
+        alignBitWriter(&bench->writer, 0);
+        bench->sink += bench->writer.size;
+    }
+}
+
+static void benchHuffmanDecode(void *context, uint64_t iterations) {
+    Dz2Bench *bench = (Dz2Bench *) context;
+    uint8_t *decoded = (uint8_t *) malloc(bench->symbolCount);
+    if (decoded == NULL) {
+        perror("benchHuffmanDecode::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < iterations; ++i) {
+        bench->sink += decodeHuffmanSymbols(&bench->decoder, bench->encoded.data, bench->encoded.size, decoded,
+                                            bench->symbolCount);
+    }
+    free(decoded);
+}
+
+// Writes two frames cut from one synthetic image SHIFT_X, SHIFT_Y apart into a temporary file of
+// concatenated P5 images and returns its name, the caller unlinks it
+static char *writeSyntheticFrames(uint32_t width, uint32_t height) {
+    static char name[] = "/tmp/dz2-bench-XXXXXX";
+    int fd = mkstemp(name);
+    FILE *fptr = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (fptr == NULL) {
+        perror("writeSyntheticFrames::mkstemp()");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t margin = 8;
+    size_t stride = width + 2 * margin;
+    uint8_t *pixels = (uint8_t *) malloc(stride * (height + 2 * margin));
+    if (pixels == NULL) {
+        perror("writeSyntheticFrames::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    fillSyntheticImage(pixels, stride, width + 2 * margin, height + 2 * margin, 1, 2);
+    uint32_t origins[2][2] = {{margin, margin}, {margin + SHIFT_X, margin + SHIFT_Y}};
+    for (int f = 0; f < 2; ++f) {
+        fprintf(fptr, "P5\n%u %u\n255\n", width, height);
+        for (uint32_t y = 0; y < height; ++y) {
+            fwrite(pixels + (origins[f][1] + y) * stride + origins[f][0], 1, width, fptr);
+        }
+    }
+    fclose(fptr);
+    free(pixels);
+    return name;
+}
+
+int main(int argc, char *argv[]) {
+    BenchArgs args = parseBenchArgs(argc, argv, 1024, 1024);
+
+    Dz2Bench bench = {0};
+    bench.file = writeSyntheticFrames(args.width, args.height);
+    FILE *fptr = fopen(bench.file, "rb");
+    if (fptr == NULL || !readPGMFrame(fptr, bench.file, &bench.currentImg) ||
+        !readPGMFrame(fptr, bench.file, &bench.previousImg)) {
+        fprintf(stderr, "%s: synthetic frames could not be read back!\n", bench.file);
+        return EXIT_FAILURE;
+    }
+    fclose(fptr);
+    bench.blockCount = blockCountOf(&bench.currentImg);
+    bench.scratch = createSearchScratch(SEARCH_RANGE);
+    uint64_t pixelCount = (uint64_t) args.width * args.height;
+
+    BenchSuite suite;
+    initBenchSuite(&suite, &args.config);
+    runBenchmark(&suite, "parse/pgm-file", pixelCount, benchParseFile, &bench);
+
+    SadKernel sadKernels[] = {SAD_SCALAR, SAD_SSE2, SAD_AVX2};
+    for (size_t i = 0; i < sizeof(sadKernels) / sizeof(sadKernels[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "sad/16x16-%s", sadKernelName(sadKernels[i]));
+        bench.sad = selectSad(sadKernels[i], SAD_16X16);
+        runBenchmark(&suite, name, BLOCK_SIZE, benchSad, &bench);
+    }
+
+    for (int k = 0; k < SEARCH_KIND_COUNT; ++k) {
+        char name[64];
+        snprintf(name, sizeof(name), "search/%s", searchKindName((SearchKind) k));
+        bench.options = makeSearchOptions((SearchKind) k, SEARCH_RANGE, 1, SAD_AUTO);
+        bench.blockNumber = 0;
+        runBenchmark(&suite, name, 1, benchSearch, &bench);
+    }
+    bench.options = makeSearchOptions(SEARCH_FULL, SEARCH_RANGE, 1, SAD_AUTO);
+    bench.options.earlyExit = 1;
+    runBenchmark(&suite, "search/full-early-exit", 1, benchSearch, &bench);
+    bench.options = makeSearchOptions(SEARCH_PREDICTIVE, SEARCH_RANGE, 1, SAD_AUTO);
+    runBenchmark(&suite, "field/predictive", bench.blockCount, benchField, &bench);
+
+    uint32_t binCounts[] = {16, 256};
+    for (size_t i = 0; i < sizeof(binCounts) / sizeof(binCounts[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "histogram/gray-%u", binCounts[i]);
+        bench.binCount = binCounts[i];
+        runBenchmark(&suite, name, pixelCount, benchHistogram, &bench);
+    }
+    bench.rgb = (uint8_t *) malloc(pixelCount * 3);
+    if (bench.rgb == NULL) {
+        perror("main::malloc()");
+        return EXIT_FAILURE;
+    }
+    fillSyntheticImage(bench.rgb, (size_t) args.width * 3, args.width, args.height, 3, 3);
+    runBenchmark(&suite, "histogram/rgb-256", pixelCount, benchHistogramRGB, &bench);
+
+    // 16-bin symbols of the current frame, coded with the code built from their own histogram
+    Histogram histogram;
+    initHistogram(&histogram, 16, 1);
+    addHistogramSamples(&histogram, &pgmRow(&bench.currentImg, 0)->val, bench.currentImg.stride, args.width,
+                        args.height, NULL);
+    buildHuffmanCode(&bench.code, histogram.counts[0], 16, 16);
+    buildHuffmanDecoder(&bench.decoder, &bench.code);
+    bench.symbolCount = (size_t) pixelCount;
+    bench.symbols = (uint8_t *) malloc(bench.symbolCount);
+    if (bench.symbols == NULL) {
+        perror("main::malloc()");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t y = 0; y < args.height; ++y) {
+        for (uint32_t x = 0; x < args.width; ++x) {
+            bench.symbols[(size_t) y * args.width + x] = (uint8_t) (pgmRow(&bench.currentImg, y)[x].val >> 4);
+        }
+    }
+    initBitWriter(&bench.writer, 0);
+    initBitWriter(&bench.encoded, 0);
+    encodeHuffmanSymbols(&bench.encoded, &bench.code, bench.symbols, bench.symbolCount);
+    alignBitWriter(&bench.encoded, 0);
+    runBenchmark(&suite, "huffman/encode", bench.symbolCount, benchHuffmanEncode, &bench);
+    runBenchmark(&suite, "huffman/decode", bench.symbolCount, benchHuffmanDecode, &bench);
+
+    int status = finishBenchSuite(&suite, "dz2", &args);
+    if (bench.sink == 0) {
+        fprintf(stderr, "Every stage produced zeros!\n");
+    }
+    freeBenchSuite(&suite);
+    freeBitWriter(&bench.encoded);
+    freeBitWriter(&bench.writer);
+    free(bench.symbols);
+    free(bench.rgb);
+    freeSearchScratch(&bench.scratch);
+    freePGMImage(&bench.previousImg);
+    freePGMImage(&bench.currentImg);
+    unlink(bench.file);
+    return status;
+}
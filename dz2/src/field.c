@@ -0,0 +1,386 @@
+#include "field.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+TRACE_COUNTER(prepareCounter, "motion/prepare");
+TRACE_COUNTER(searchCounter, "motion/search");
+TRACE_COUNTER(subpelCounter, "motion/subpel");
+
+static uint32_t levelsOf(const SearchOptions *options) {
+    return options->levels > 0 ? options->levels : 1;
+}
+
+static uint32_t unitsOf(const SearchOptions *options) {
+    return options->subpel > 0 ? options->subpel : SUBPEL_NONE;
+}
+
+PreparedFrame prepareFrame(const ImagePGM *img, const SearchOptions *options, int isReference) {
+    TRACE_BEGIN(start);
+    PreparedFrame frame = {.pyramid=buildPyramid(img, levelsOf(options))};
+    if (isReference && unitsOf(options) > 1) {
+        frame.subpel = buildSubpelPlanes(img, (SubpelPrecision) unitsOf(options));
+    }
+    TRACE_END(prepareCounter, start, (uint64_t) img->width * img->height, 0);
+    return frame;
+}
+
+void releasePreparedFrame(PreparedFrame *frame) {
+    freeSubpelPlanes(&frame->subpel);
+    freePyramid(&frame->pyramid);
+}
+
+static MotionField allocateMotionField(const ImagePGM *currentImg, uint32_t unitsPerPixel) {
+    MotionField field = {.xBlockCount=currentImg->width / BLOCK_WIDTH, .yBlockCount=currentImg->height / BLOCK_HEIGHT,
+                         .unitsPerPixel=unitsPerPixel};
+    uint32_t blockCount = field.xBlockCount * field.yBlockCount;
+    field.vectors = (Point *) malloc(sizeof(Point) * (blockCount > 0 ? blockCount : 1));
+    if (field.vectors == NULL) {
+        perror("allocateMotionField::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    return field;
+}
+
+// Rounds a vector component in fractional units to the nearest pixel
+static int32_t toPixels(int32_t value, int32_t units) {
+    return value >= 0 ? (value + units / 2) / units : -((-value + units / 2) / units);
+}
+
+// Searches block blockIndex, with the predictors taken from the already computed part of the field
+// when withPredictors is set. The work done is added to *stats, and traced as SAD evaluations (the
+// items) and rows of both blocks summed (the bytes).
+static void computeBlock(MotionField *field, const PreparedFrame *current, const PreparedFrame *previous,
+                         const SearchOptions *options, SearchScratch *scratch, uint32_t blockIndex, int withPredictors,
+                         SearchStats *stats) {
+    Point predictors[MAX_PREDICTORS];
+    uint32_t predictorCount = withPredictors ? collectPredictors(field->vectors, field->xBlockCount, blockIndex,
+                                                                 predictors) : 0;
+    int32_t units = (int32_t) field->unitsPerPixel;
+    for (uint32_t i = 0; units > 1 && i < predictorCount; ++i) {
+        predictors[i].x = toPixels(predictors[i].x, units);
+        predictors[i].y = toPixels(predictors[i].y, units);
+    }
+    TRACE_VALUE(searchEvaluations, stats->evaluations);
+    TRACE_VALUE(searchRows, stats->rowsSummed);
+    TRACE_BEGIN(searchStart);
+    Point vector = findMovementVectorPyramid(&current->pyramid, &previous->pyramid, blockIndex, options, predictors,
+                                             predictorCount, scratch, stats);
+    TRACE_END(searchCounter, searchStart, (stats->rowsSummed - searchRows) * BLOCK_WIDTH * 2,
+              stats->evaluations - searchEvaluations);
+    if (units > 1) {
+        TRACE_VALUE(subpelEvaluations, stats->evaluations);
+        TRACE_VALUE(subpelRows, stats->rowsSummed);
+        TRACE_BEGIN(subpelStart);
+        vector = refineSubpel(&current->pyramid.levels[0], &previous->subpel, blockIndex, vector, options->range,
+                              options->sad[SAD_16X16], options->earlyExit ? options->sadBounded : NULL, stats);
+        TRACE_END(subpelCounter, subpelStart, (stats->rowsSummed - subpelRows) * BLOCK_WIDTH * 2,
+                  stats->evaluations - subpelEvaluations);
+    }
+    field->vectors[blockIndex] = vector;
+}
+
+static MotionField computePreparedField(const PreparedFrame *current, const PreparedFrame *previous,
+                                        const SearchOptions *options, SearchScratch *scratch, SearchStats *stats) {
+    MotionField field = allocateMotionField(&current->pyramid.levels[0], unitsOf(options));
+    uint32_t blockCount = field.xBlockCount * field.yBlockCount;
+    SearchStats total = {0};
+    for (uint32_t i = 0; i < blockCount; ++i) {
+        computeBlock(&field, current, previous, options, scratch, i, 1, &total);
+    }
+    if (stats != NULL) {
+        *stats = total;
+    }
+    return field;
+}
+
+MotionField computeMotionField(const ImagePGM *currentImg, const ImagePGM *previousImg, const SearchOptions *options,
+                               SearchScratch *scratch, SearchStats *stats) {
+    PreparedFrame current = prepareFrame(currentImg, options, 0);
+    PreparedFrame previous = prepareFrame(previousImg, options, 1);
+    MotionField field = computePreparedField(&current, &previous, options, scratch, stats);
+    releasePreparedFrame(&previous);
+    releasePreparedFrame(&current);
+    return field;
+}
+
+void freeMotionField(MotionField *field) {
+    free(field->vectors);
+    field->vectors = NULL;
+}
+
+MotionEstimator createMotionEstimator(const SearchOptions *options, uint32_t threadCount, int pinThreads) {
+    MotionEstimator estimator = {.options=*options, .pool=NULL, .workerCount=1};
+    if (threadCount != 1) {
+        estimator.pool = createThreadPool(threadCount);
+        estimator.workerCount = threadPoolSize(estimator.pool);
+        if (pinThreads && pinThreadPool(estimator.pool) != 0) {
+            fprintf(stderr, "createMotionEstimator(): threads could not be pinned, continuing unpinned.\n");
+        }
+    }
+    estimator.scratches = (SearchScratch *) malloc(sizeof(SearchScratch) * estimator.workerCount);
+    estimator.workerStats = (SearchStats *) malloc(sizeof(SearchStats) * estimator.workerCount);
+    if (estimator.scratches == NULL || estimator.workerStats == NULL) {
+        perror("createMotionEstimator::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < estimator.workerCount; ++i) {
+        estimator.scratches[i] = createSearchScratch(options->range);
+    }
+    return estimator;
+}
+
+void freeMotionEstimator(MotionEstimator *estimator) {
+    for (uint32_t i = 0; i < estimator->workerCount; ++i) {
+        freeSearchScratch(&estimator->scratches[i]);
+    }
+    free(estimator->scratches);
+    free(estimator->workerStats);
+    estimator->scratches = NULL;
+    estimator->workerStats = NULL;
+    if (estimator->pool != NULL) {
+        destroyThreadPool(estimator->pool);
+        estimator->pool = NULL;
+    }
+}
+
+typedef struct {
+    MotionEstimator *estimator;
+    const PreparedFrame *current, *previous;
+    MotionField *field;
+    // Wavefront only: the anti-diagonal being computed and its first block row
+    uint32_t diagonal;
+    uint32_t firstRow;
+    // Pairs only
+    const ImagePGM *frames;
+    uint32_t frameCount;
+    PreparedFrame *prepared;
+    MotionField *fields;
+} FieldContext;
+
+static void estimateRows(void *context, uint32_t workerIndex, uint32_t begin, uint32_t end) {
+    FieldContext *ctx = (FieldContext *) context;
+    MotionEstimator *estimator = ctx->estimator;
+    uint32_t xBlockCount = ctx->field->xBlockCount;
+    for (uint32_t row = begin; row < end; ++row) {
+        for (uint32_t x = 0; x < xBlockCount; ++x) {
+            computeBlock(ctx->field, ctx->current, ctx->previous, &estimator->options,
+                         &estimator->scratches[workerIndex], row * xBlockCount + x, 0,
+                         &estimator->workerStats[workerIndex]);
+        }
+    }
+}
+
+// Items are the block rows crossing the current anti-diagonal, starting at firstRow
+static void estimateDiagonal(void *context, uint32_t workerIndex, uint32_t begin, uint32_t end) {
+    FieldContext *ctx = (FieldContext *) context;
+    MotionEstimator *estimator = ctx->estimator;
+    for (uint32_t i = begin; i < end; ++i) {
+        uint32_t row = ctx->firstRow + i;
+        uint32_t x = ctx->diagonal - 2 * row;
+        computeBlock(ctx->field, ctx->current, ctx->previous, &estimator->options, &estimator->scratches[workerIndex],
+                     row * ctx->field->xBlockCount + x, 1, &estimator->workerStats[workerIndex]);
+    }
+}
+
+static void estimatePairs(void *context, uint32_t workerIndex, uint32_t begin, uint32_t end) {
+    FieldContext *ctx = (FieldContext *) context;
+    MotionEstimator *estimator = ctx->estimator;
+    for (uint32_t i = begin; i < end; ++i) {
+        SearchStats stats;
+        ctx->fields[i] = computePreparedField(&ctx->prepared[i + 1], &ctx->prepared[i], &estimator->options,
+                                              &estimator->scratches[workerIndex], &stats);
+        addSearchStats(&estimator->workerStats[workerIndex], &stats);
+    }
+}
+
+// The last frame is never the previous frame of a pair
+static void prepareFrames(void *context, uint32_t workerIndex, uint32_t begin, uint32_t end) {
+    (void) workerIndex;
+    FieldContext *ctx = (FieldContext *) context;
+    for (uint32_t i = begin; i < end; ++i) {
+        ctx->prepared[i] = prepareFrame(&ctx->frames[i], &ctx->estimator->options, i + 1 < ctx->frameCount);
+    }
+}
+
+static SearchStats sumWorkerStats(const MotionEstimator *estimator) {
+    SearchStats total = {0};
+    for (uint32_t i = 0; i < estimator->workerCount; ++i) {
+        addSearchStats(&total, &estimator->workerStats[i]);
+    }
+    return total;
+}
+
+MotionField estimatePreparedField(MotionEstimator *estimator, const PreparedFrame *current,
+                                  const PreparedFrame *previous, SearchStats *stats) {
+    if (estimator->pool == NULL) {
+        return computePreparedField(current, previous, &estimator->options, &estimator->scratches[0], stats);
+    }
+
+    MotionField field = allocateMotionField(&current->pyramid.levels[0], unitsOf(&estimator->options));
+    memset(estimator->workerStats, 0, sizeof(SearchStats) * estimator->workerCount);
+    FieldContext context = {.estimator=estimator, .current=current, .previous=previous, .field=&field};
+    if (estimator->options.kind != SEARCH_PREDICTIVE) {
+        threadPoolParallelFor(estimator->pool, field.yBlockCount, 1, estimateRows, &context);
+    } else if (field.xBlockCount > 0 && field.yBlockCount > 0) {
+        // Block (x, y) waits for (x - 1, y) and (x + 1, y - 1) on the previous diagonal and (x, y - 1)
+        // two diagonals back, so every block of one diagonal can run at once
+        uint32_t lastDiagonal = field.xBlockCount - 1 + 2 * (field.yBlockCount - 1);
+        for (uint32_t diagonal = 0; diagonal <= lastDiagonal; ++diagonal) {
+            uint32_t firstRow = diagonal < field.xBlockCount ? 0 : (diagonal - field.xBlockCount + 2) / 2;
+            uint32_t lastRow = diagonal / 2 < field.yBlockCount - 1 ? diagonal / 2 : field.yBlockCount - 1;
+            if (firstRow > lastRow) {
+                continue;
+            }
+            context.diagonal = diagonal;
+            context.firstRow = firstRow;
+            threadPoolParallelFor(estimator->pool, lastRow - firstRow + 1, 1, estimateDiagonal, &context);
+        }
+    }
+    if (stats != NULL) {
+        *stats = sumWorkerStats(estimator);
+    }
+    return field;
+}
+
+MotionField estimateMotionField(MotionEstimator *estimator, const ImagePGM *currentImg, const ImagePGM *previousImg,
+                                SearchStats *stats) {
+    PreparedFrame current = prepareFrame(currentImg, &estimator->options, 0);
+    PreparedFrame previous = prepareFrame(previousImg, &estimator->options, 1);
+    MotionField field = estimatePreparedField(estimator, &current, &previous, stats);
+    releasePreparedFrame(&previous);
+    releasePreparedFrame(&current);
+    return field;
+}
+
+void estimateMotionFields(MotionEstimator *estimator, const ImagePGM *frames, uint32_t frameCount,
+                          MotionField *fields, SearchStats *stats) {
+    uint32_t pairCount = frameCount > 1 ? frameCount - 1 : 0;
+    SearchStats total = {0};
+    if (pairCount == 0) {
+        if (stats != NULL) {
+            *stats = total;
+        }
+        return;
+    }
+
+    // Every frame but the first and the last is part of two pairs, it is prepared once
+    PreparedFrame *prepared = (PreparedFrame *) malloc(sizeof(PreparedFrame) * frameCount);
+    if (prepared == NULL) {
+        perror("estimateMotionFields::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    FieldContext context = {.estimator=estimator, .frames=frames, .frameCount=frameCount, .prepared=prepared,
+                            .fields=fields};
+    if (estimator->pool != NULL) {
+        threadPoolParallelFor(estimator->pool, frameCount, 1, prepareFrames, &context);
+    } else {
+        prepareFrames(&context, 0, 0, frameCount);
+    }
+
+    if (estimator->pool != NULL && pairCount >= estimator->workerCount) {
+        memset(estimator->workerStats, 0, sizeof(SearchStats) * estimator->workerCount);
+        threadPoolParallelFor(estimator->pool, pairCount, 1, estimatePairs, &context);
+        total = sumWorkerStats(estimator);
+    } else {
+        for (uint32_t i = 0; i < pairCount; ++i) {
+            SearchStats pairStats;
+            fields[i] = estimatePreparedField(estimator, &prepared[i + 1], &prepared[i], &pairStats);
+            addSearchStats(&total, &pairStats);
+        }
+    }
+
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        releasePreparedFrame(&prepared[i]);
+    }
+    free(prepared);
+    if (stats != NULL) {
+        *stats = total;
+    }
+}
+
+int parseFieldFormat(const char *name, FieldFormat *format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = FIELD_CSV;
+        return 0;
+    }
+    if (strcmp(name, "bin") == 0) {
+        *format = FIELD_BINARY;
+        return 0;
+    }
+    return -1;
+}
+
+static void writeUint16(FILE *fptr, uint16_t value) {
+    uint8_t bytes[2] = {value & 0xFF, value >> 8};
+    fwrite(bytes, 1, sizeof(bytes), fptr);
+}
+
+static void writeBinaryField(const MotionField *field, FILE *fptr) {
+    fwrite(FIELD_MAGIC, 1, FIELD_MAGIC_LENGTH, fptr);
+    writeUint16(fptr, (uint16_t) field->xBlockCount);
+    writeUint16(fptr, (uint16_t) field->yBlockCount);
+    uint8_t layout[3] = {BLOCK_WIDTH, BLOCK_HEIGHT, (uint8_t) field->unitsPerPixel};
+    fwrite(layout, 1, sizeof(layout), fptr);
+    uint32_t blockCount = field->xBlockCount * field->yBlockCount;
+    for (uint32_t i = 0; i < blockCount; ++i) {
+        writeUint16(fptr, (uint16_t) (int16_t) field->vectors[i].x);
+        writeUint16(fptr, (uint16_t) (int16_t) field->vectors[i].y);
+    }
+}
+
+static void writeCsvField(const MotionField *field, uint32_t pair, FILE *fptr) {
+    for (uint32_t by = 0; by < field->yBlockCount; ++by) {
+        for (uint32_t bx = 0; bx < field->xBlockCount; ++bx) {
+            const Point *vector = &field->vectors[by * field->xBlockCount + bx];
+            if (field->unitsPerPixel > 1) {
+                double units = (double) field->unitsPerPixel;
+                fprintf(fptr, "%u,%u,%u,%.2f,%.2f,%.3f\n", pair, bx, by, vector->x / units, vector->y / units,
+                        vector->mad);
+            } else {
+                fprintf(fptr, "%u,%u,%u,%d,%d,%.3f\n", pair, bx, by, vector->x, vector->y, vector->mad);
+            }
+        }
+    }
+}
+
+FieldWriter openFieldWriter(const char *file, FieldFormat format) {
+    FieldWriter writer = {.format=format, .fieldCount=0};
+    writer.fptr = fopen(file, format == FIELD_BINARY ? "wb" : "w");
+    if (writer.fptr == NULL) {
+        perror("openFieldWriter::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    if (format == FIELD_CSV) {
+        fprintf(writer.fptr, "pair,blockX,blockY,x,y,mad\n");
+    }
+    return writer;
+}
+
+void writeFieldRecord(FieldWriter *writer, const MotionField *field) {
+    if (writer->format == FIELD_BINARY) {
+        writeBinaryField(field, writer->fptr);
+    } else {
+        writeCsvField(field, writer->fieldCount, writer->fptr);
+    }
+    ++writer->fieldCount;
+}
+
+void closeFieldWriter(FieldWriter *writer) {
+    if (fclose(writer->fptr) != 0) {
+        perror("closeFieldWriter::fclose()");
+        exit(EXIT_FAILURE);
+    }
+    writer->fptr = NULL;
+}
+
+void writeMotionFields(const MotionField *fields, uint32_t fieldCount, const char *file, FieldFormat format) {
+    FieldWriter writer = openFieldWriter(file, format);
+    for (uint32_t i = 0; i < fieldCount; ++i) {
+        writeFieldRecord(&writer, &fields[i]);
+    }
+    closeFieldWriter(&writer);
+}
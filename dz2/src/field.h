@@ -0,0 +1,106 @@
+#ifndef DZ2_FIELD_H
+#define DZ2_FIELD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "motion.h"
+#include "pgm.h"
+#include "pyramid.h"
+#include "subpel.h"
+#include "threadpool.h"
+
+// Binary field: magic, uint16 LE xBlockCount and yBlockCount, uint8 block width, block height and
+// vector units per pixel, then an int16 LE x and y for every block in raster order.
+#define FIELD_MAGIC "MVEC"
+#define FIELD_MAGIC_LENGTH 4
+
+typedef enum {
+    FIELD_CSV,
+    FIELD_BINARY
+} FieldFormat;
+
+// Motion vectors of every block of a frame in raster order, in 1 / unitsPerPixel pixels
+typedef struct {
+    uint32_t xBlockCount;
+    uint32_t yBlockCount;
+    uint32_t unitsPerPixel;
+    Point *vectors;
+} MotionField;
+
+// Runs the search (and the sub-pixel refinement, if any) for every block of currentImg. Blocks are
+// visited row by row, so the part of previousImg a block row searches (its own rows plus the range
+// above and below) stays in cache while the row is processed and predictive search can use the
+// vectors of already processed neighbours. Interpolated planes are built once for the previous
+// frame. The work done over all blocks is stored in *stats when it is not NULL.
+MotionField computeMotionField(const ImagePGM *currentImg, const ImagePGM *previousImg, const SearchOptions *options,
+                               SearchScratch *scratch, SearchStats *stats);
+
+void freeMotionField(MotionField *field);
+
+// What the searches need of a frame: its pyramid and, as the previous frame of a pair with
+// sub-pixel refinement, its interpolated planes. Both point into (or were built from) the image,
+// which has to outlive them.
+typedef struct {
+    Pyramid pyramid;
+    SubpelPlanes subpel;
+} PreparedFrame;
+
+// Interpolated planes are only built when isReference is set and options ask for sub-pixel vectors.
+PreparedFrame prepareFrame(const ImagePGM *img, const SearchOptions *options, int isReference);
+
+void releasePreparedFrame(PreparedFrame *frame);
+
+// Computes motion fields on a thread pool. Every worker has its own scratch, and the output is
+// identical to computeMotionField() whatever the thread count.
+typedef struct {
+    SearchOptions options;
+    // NULL when running on the calling thread only
+    ThreadPool *pool;
+    uint32_t workerCount;
+    SearchScratch *scratches;
+    SearchStats *workerStats;
+} MotionEstimator;
+
+// A threadCount of 0 uses every CPU. With pinThreads set, workers are pinned to CPUs (see pinThreadPool()).
+MotionEstimator createMotionEstimator(const SearchOptions *options, uint32_t threadCount, int pinThreads);
+
+void freeMotionEstimator(MotionEstimator *estimator);
+
+// Block rows are spread over the workers. Predictive search needs the left, top and top-right
+// vectors first, so it instead runs as a wavefront over the anti-diagonals x + 2y of the block grid.
+MotionField estimateMotionField(MotionEstimator *estimator, const ImagePGM *currentImg, const ImagePGM *previousImg,
+                                SearchStats *stats);
+
+// estimateMotionField() for frames that are already prepared, e.g. when every frame of a stream is
+// the current frame of one pair and the previous frame of the next.
+MotionField estimatePreparedField(MotionEstimator *estimator, const PreparedFrame *current,
+                                  const PreparedFrame *previous, SearchStats *stats);
+
+// Fields of the frame pairs (frames[i + 1], frames[i]) of a sequence in display order, stored in
+// fields[i]. With at least as many pairs as workers whole pairs run concurrently, one per worker,
+// otherwise the pairs run one after another, each spread over all workers.
+void estimateMotionFields(MotionEstimator *estimator, const ImagePGM *frames, uint32_t frameCount,
+                          MotionField *fields, SearchStats *stats);
+
+// Returns 0 and sets *format when name is "csv" or "bin".
+int parseFieldFormat(const char *name, FieldFormat *format);
+
+// Writes fields one after another as they are computed. CSV has a header line and one
+// "pair,blockX,blockY,x,y,mad" line per block with x and y in pixels, binary files hold one complete
+// field record per pair.
+typedef struct {
+    FILE *fptr;
+    FieldFormat format;
+    uint32_t fieldCount;
+} FieldWriter;
+
+FieldWriter openFieldWriter(const char *file, FieldFormat format);
+
+void writeFieldRecord(FieldWriter *writer, const MotionField *field);
+
+void closeFieldWriter(FieldWriter *writer);
+
+void writeMotionFields(const MotionField *fields, uint32_t fieldCount, const char *file, FieldFormat format);
+
+#endif
@@ -0,0 +1,387 @@
+#include "motion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Offsets around the current centre, visited in this order
+static const int32_t largeDiamond[8][2] = {{0, -2}, {-1, -1}, {1, -1}, {-2, 0}, {2, 0}, {-1, 1}, {1, 1}, {0, 2}};
+static const int32_t largeHexagon[6][2] = {{-1, -2}, {1, -2}, {-2, 0}, {2, 0}, {-1, 2}, {1, 2}};
+static const int32_t smallDiamond[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
+
+// One block being matched
+typedef struct {
+    // The block and the co-located position in the previous image
+    const uint8_t *block, *reference;
+    size_t blockStride, referenceStride;
+    uint32_t dim;
+    SadFunction sad;
+    // Used instead of sad when set
+    SadBoundedFunction sadBounded;
+    // Offsets that stay inside the search range and the image
+    int32_t minX, maxX, minY, maxY;
+    SearchScratch *scratch;
+    int32_t bestX, bestY;
+    uint32_t bestSad;
+    // Ties go to the offset first in raster order instead of the one evaluated first
+    int rasterTies;
+    // Nothing more is evaluated once stopped is set, which happens when bestSad drops below goodEnough
+    uint32_t goodEnough;
+    int stopped;
+    SearchStats stats;
+} BlockSearch;
+
+SearchScratch createSearchScratch(int32_t range) {
+    uint32_t side = 2 * (uint32_t) range + 1;
+    SearchScratch scratch = {.range=range, .generation=0};
+    scratch.stamps = (uint32_t *) calloc((size_t) side * side, sizeof(uint32_t));
+    if (scratch.stamps == NULL) {
+        perror("createSearchScratch::calloc()");
+        exit(EXIT_FAILURE);
+    }
+    return scratch;
+}
+
+void freeSearchScratch(SearchScratch *scratch) {
+    free(scratch->stamps);
+    scratch->stamps = NULL;
+}
+
+const char *searchKindName(SearchKind kind) {
+    switch (kind) {
+        case SEARCH_THREE_STEP:
+            return "tss";
+        case SEARCH_DIAMOND:
+            return "diamond";
+        case SEARCH_HEXAGON:
+            return "hexagon";
+        case SEARCH_PREDICTIVE:
+            return "predictive";
+        case SEARCH_FULL:
+        default:
+            return "full";
+    }
+}
+
+int parseSearchKind(const char *name, SearchKind *kind) {
+    for (int k = 0; k < SEARCH_KIND_COUNT; ++k) {
+        if (strcmp(name, searchKindName((SearchKind) k)) == 0) {
+            *kind = (SearchKind) k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+SearchOptions makeSearchOptions(SearchKind kind, int32_t range, uint32_t levels, SadKernel kernel) {
+    SearchOptions options = {.kind=kind, .range=range, .levels=levels, .subpel=1, .earlyExit=0, .goodEnough=0};
+    for (int i = 0; i < SAD_SIZE_COUNT; ++i) {
+        options.sad[i] = selectSad(kernel, (SadSize) i);
+    }
+    options.sadBounded = selectSadBounded(kernel);
+    return options;
+}
+
+void addSearchStats(SearchStats *total, const SearchStats *stats) {
+    total->evaluations += stats->evaluations;
+    total->rowsSummed += stats->rowsSummed;
+    total->rowsSkipped += stats->rowsSkipped;
+    total->earlyStops += stats->earlyStops;
+}
+
+uint32_t blockCountOf(const ImagePGM *img) {
+    return (uint32_t) (img->width / BLOCK_WIDTH) * (img->height / BLOCK_HEIGHT);
+}
+
+// Evaluates offset (x, y) unless the search stopped, it is out of bounds or it was already evaluated
+// for this block. Returns 1 when it became the new best match.
+static int tryOffset(BlockSearch *search, int32_t x, int32_t y) {
+    if (search->stopped || x < search->minX || x > search->maxX || y < search->minY || y > search->maxY) {
+        return 0;
+    }
+    SearchScratch *scratch = search->scratch;
+    size_t side = 2 * (size_t) scratch->range + 1;
+    uint32_t *stamp = &scratch->stamps[(size_t) (y + scratch->range) * side + (size_t) (x + scratch->range)];
+    if (*stamp == scratch->generation) {
+        return 0;
+    }
+    *stamp = scratch->generation;
+
+    // A candidate has to get below bound to win, so summing it can stop once it reaches the bound
+    uint32_t bound = search->bestSad;
+    if (search->rasterTies && bound != UINT32_MAX &&
+        (y < search->bestY || (y == search->bestY && x < search->bestX))) {
+        ++bound;
+    }
+
+    ++search->stats.evaluations;
+    const uint8_t *candidate = search->reference + (ptrdiff_t) y * (ptrdiff_t) search->referenceStride + x;
+    uint32_t sad;
+    uint32_t rows = search->dim;
+    if (search->sadBounded != NULL) {
+        sad = search->sadBounded(search->block, search->blockStride, candidate, search->referenceStride, bound, &rows);
+    } else {
+        sad = search->sad(search->block, search->blockStride, candidate, search->referenceStride);
+    }
+    search->stats.rowsSummed += rows;
+    search->stats.rowsSkipped += search->dim - rows;
+    if (sad < bound) {
+        search->bestX = x;
+        search->bestY = y;
+        search->bestSad = sad;
+        if (sad < search->goodEnough) {
+            search->stopped = 1;
+            search->stats.earlyStops = 1;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Evaluates the pattern around the current best match once. Returns 1 when the best match moved.
+static int tryPattern(BlockSearch *search, const int32_t (*pattern)[2], size_t patternSize) {
+    int32_t centerX = search->bestX;
+    int32_t centerY = search->bestY;
+    int moved = 0;
+    for (size_t i = 0; i < patternSize; ++i) {
+        moved |= tryOffset(search, centerX + pattern[i][0], centerY + pattern[i][1]);
+    }
+    return moved;
+}
+
+// Rings of growing distance around offset 0, so good matches of small motion come first and tighten
+// the bound of partial distortion elimination. Ties are resolved as in raster order.
+static void spiralSearch(BlockSearch *search) {
+    search->rasterTies = 1;
+    tryOffset(search, 0, 0);
+    int32_t rings = -search->minX;
+    rings = search->maxX > rings ? search->maxX : rings;
+    rings = -search->minY > rings ? -search->minY : rings;
+    rings = search->maxY > rings ? search->maxY : rings;
+    for (int32_t r = 1; r <= rings && !search->stopped; ++r) {
+        for (int32_t x = -r; x <= r; ++x) {
+            tryOffset(search, x, -r);
+        }
+        for (int32_t y = -r + 1; y < r; ++y) {
+            tryOffset(search, -r, y);
+            tryOffset(search, r, y);
+        }
+        for (int32_t x = -r; x <= r; ++x) {
+            tryOffset(search, x, r);
+        }
+    }
+}
+
+static void fullSearch(BlockSearch *search) {
+    for (int32_t y = search->minY; y <= search->maxY; ++y) {
+        for (int32_t x = search->minX; x <= search->maxX; ++x) {
+            tryOffset(search, x, y);
+        }
+    }
+}
+
+static void threeStepSearch(BlockSearch *search, int32_t range) {
+    // Steps halve down to 1 and add up to just under the range: 8, 4, 2, 1 for a range of 16
+    int32_t step = 1;
+    while (step * 2 <= (range + 1) / 2) {
+        step *= 2;
+    }
+    tryOffset(search, 0, 0);
+    for (; step >= 1; step /= 2) {
+        int32_t centerX = search->bestX;
+        int32_t centerY = search->bestY;
+        for (int32_t dy = -1; dy <= 1; ++dy) {
+            for (int32_t dx = -1; dx <= 1; ++dx) {
+                tryOffset(search, centerX + dx * step, centerY + dy * step);
+            }
+        }
+    }
+}
+
+// Large pattern until the centre stays the best match, then one pass of the small diamond.
+static void patternSearch(BlockSearch *search, const int32_t (*pattern)[2], size_t patternSize) {
+    tryOffset(search, 0, 0);
+    while (tryPattern(search, pattern, patternSize));
+    tryPattern(search, smallDiamond, 4);
+}
+
+static void predictiveSearch(BlockSearch *search, const Point *predictors, uint32_t predictorCount) {
+    tryOffset(search, 0, 0);
+    for (uint32_t i = 0; i < predictorCount; ++i) {
+        tryOffset(search, predictors[i].x, predictors[i].y);
+    }
+    // Motion is usually close to one of the predictors, so small steps are enough from there
+    while (tryPattern(search, smallDiamond, 4));
+}
+
+// Prepares the search of the dim x dim block at (originX, originY) within range of offset 0,
+// starting a new generation of scratch stamps.
+static void beginBlockSearch(BlockSearch *search, const ImagePGM *currentImg, const ImagePGM *previousImg,
+                             uint32_t originX, uint32_t originY, uint32_t dim, int32_t range, SadFunction sad,
+                             SearchScratch *scratch) {
+    // Offsets that keep the matched block inside the previous image, limited to the search range
+    int32_t minX = -(int32_t) originX, maxX = (int32_t) (currentImg->width - dim - originX);
+    int32_t minY = -(int32_t) originY, maxY = (int32_t) (currentImg->height - dim - originY);
+    *search = (BlockSearch) {
+            .block=&pgmRow(currentImg, originY)[originX].val, .blockStride=currentImg->stride,
+            .reference=&pgmRow(previousImg, originY)[originX].val, .referenceStride=previousImg->stride,
+            .dim=dim, .sad=sad, .sadBounded=NULL,
+            .minX=minX > -range ? minX : -range, .maxX=maxX < range ? maxX : range,
+            .minY=minY > -range ? minY : -range, .maxY=maxY < range ? maxY : range,
+            .scratch=scratch, .bestX=0, .bestY=0, .bestSad=UINT32_MAX, .rasterTies=0, .goodEnough=0, .stopped=0,
+            .stats={0}};
+
+    // A new generation invalidates every stamp at once, only a wrap-around needs a real clear
+    if (++scratch->generation == 0) {
+        size_t side = 2 * (size_t) scratch->range + 1;
+        memset(scratch->stamps, 0, side * side * sizeof(uint32_t));
+        scratch->generation = 1;
+    }
+}
+
+static void runSearch(BlockSearch *search, SearchKind kind, int32_t range, const Point *predictors,
+                      uint32_t predictorCount, int spiral) {
+    switch (kind) {
+        case SEARCH_THREE_STEP:
+            threeStepSearch(search, range);
+            break;
+        case SEARCH_DIAMOND:
+            patternSearch(search, largeDiamond, 8);
+            break;
+        case SEARCH_HEXAGON:
+            patternSearch(search, largeHexagon, 6);
+            break;
+        case SEARCH_PREDICTIVE:
+            predictiveSearch(search, predictors, predictorCount);
+            break;
+        case SEARCH_FULL:
+        default:
+            if (spiral) {
+                spiralSearch(search);
+            } else {
+                fullSearch(search);
+            }
+            break;
+    }
+}
+
+static int32_t clamp(int32_t value, int32_t min, int32_t max) {
+    return value < min ? min : value > max ? max : value;
+}
+
+// Applies the early exits of options to a search of the full resolution level
+static void enableEarlyExits(BlockSearch *search, const SearchOptions *options) {
+    if (options->earlyExit) {
+        search->sadBounded = options->sadBounded;
+    }
+    search->goodEnough = options->goodEnough;
+}
+
+Point findMovementVectorPyramid(const Pyramid *current, const Pyramid *previous, uint32_t blockIndex,
+                                const SearchOptions *options, const Point *predictors, uint32_t predictorCount,
+                                SearchScratch *scratch, SearchStats *stats) {
+    if (options->range > scratch->range) {
+        fprintf(stderr, "findMovementVectorPyramid(): search range %d exceeds the scratch range %d!\n",
+                options->range, scratch->range);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t levels = options->levels > 0 ? options->levels : 1;
+    if (levels > current->levelCount || levels > previous->levelCount) {
+        fprintf(stderr, "findMovementVectorPyramid(): %u levels requested, the pyramids have %u and %u!\n", levels,
+                current->levelCount, previous->levelCount);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t xBlockCount = current->levels[0].width / BLOCK_WIDTH;
+    uint32_t originX = blockIndex % xBlockCount * BLOCK_WIDTH;
+    uint32_t originY = blockIndex / xBlockCount * BLOCK_HEIGHT;
+
+    // Coarsest level: the actual search over the scaled down range
+    uint32_t level = levels - 1;
+    int32_t scale = 1 << level;
+    int32_t coarseRange = (options->range + scale - 1) / scale;
+    Point coarsePredictors[MAX_PREDICTORS];
+    uint32_t coarseCount = predictorCount < MAX_PREDICTORS ? predictorCount : MAX_PREDICTORS;
+    for (uint32_t i = 0; i < coarseCount; ++i) {
+        coarsePredictors[i] = (Point) {.x=predictors[i].x / scale, .y=predictors[i].y / scale, .mad=0.0};
+    }
+    BlockSearch search;
+    beginBlockSearch(&search, &current->levels[level], &previous->levels[level], originX >> level, originY >> level,
+                     BLOCK_WIDTH >> level, coarseRange, options->sad[level], scratch);
+    if (level == 0) {
+        enableEarlyExits(&search, options);
+    }
+    runSearch(&search, options->kind, coarseRange, level == 0 ? predictors : coarsePredictors,
+              level == 0 ? predictorCount : coarseCount, level == 0 && options->earlyExit);
+    SearchStats total = search.stats;
+
+    // Finer levels: double the vector and refine it within one pixel
+    while (level-- > 0) {
+        scale = 1 << level;
+        int32_t levelRange = (options->range + scale - 1) / scale;
+        int32_t x = 2 * search.bestX;
+        int32_t y = 2 * search.bestY;
+        beginBlockSearch(&search, &current->levels[level], &previous->levels[level], originX >> level,
+                         originY >> level, BLOCK_WIDTH >> level, levelRange, options->sad[level], scratch);
+        if (level == 0) {
+            enableEarlyExits(&search, options);
+        }
+        // Rounding the range up per level can put the doubled vector one step outside the window
+        x = clamp(x, search.minX, search.maxX);
+        y = clamp(y, search.minY, search.maxY);
+        for (int32_t dy = -1; dy <= 1; ++dy) {
+            for (int32_t dx = -1; dx <= 1; ++dx) {
+                tryOffset(&search, x + dx, y + dy);
+            }
+        }
+        addSearchStats(&total, &search.stats);
+    }
+
+    if (stats != NULL) {
+        addSearchStats(stats, &total);
+    }
+    Point vector = {.x=search.bestX, .y=search.bestY, .mad=(double) search.bestSad / BLOCK_SIZE};
+    return vector;
+}
+
+Point findMovementVector(const ImagePGM *currentImg, const ImagePGM *previousImg, uint32_t blockIndex,
+                         const SearchOptions *options, const Point *predictors, uint32_t predictorCount,
+                         SearchScratch *scratch, SearchStats *stats) {
+    // Single level pyramids only point at the images, nothing is built or has to be freed
+    Pyramid current = {.levelCount=1, .levels={*currentImg}};
+    Pyramid previous = {.levelCount=1, .levels={*previousImg}};
+    SearchOptions singleLevel = *options;
+    singleLevel.levels = 1;
+    return findMovementVectorPyramid(&current, &previous, blockIndex, &singleLevel, predictors, predictorCount,
+                                     scratch, stats);
+}
+
+static int32_t median3(int32_t a, int32_t b, int32_t c) {
+    if (a > b) {
+        int32_t t = a;
+        a = b;
+        b = t;
+    }
+    return c < a ? a : c > b ? b : c;
+}
+
+uint32_t collectPredictors(const Point *field, uint32_t xBlockCount, uint32_t blockIndex, Point *predictors) {
+    uint32_t x = blockIndex % xBlockCount;
+    uint32_t y = blockIndex / xBlockCount;
+    uint32_t count = 0;
+    if (x > 0) {
+        predictors[count++] = field[blockIndex - 1];
+    }
+    if (y > 0) {
+        predictors[count++] = field[blockIndex - xBlockCount];
+        if (x + 1 < xBlockCount) {
+            predictors[count++] = field[blockIndex - xBlockCount + 1];
+        }
+    }
+    if (count == 3) {
+        Point median = {.x=median3(predictors[0].x, predictors[1].x, predictors[2].x),
+                        .y=median3(predictors[0].y, predictors[1].y, predictors[2].y), .mad=0.0};
+        predictors[count++] = median;
+    }
+    return count;
+}
@@ -0,0 +1,114 @@
+#ifndef DZ2_MOTION_H
+#define DZ2_MOTION_H
+
+#include <stdint.h>
+
+#include "pgm.h"
+#include "pyramid.h"
+#include "sad.h"
+
+#define BLOCK_WIDTH 16
+#define BLOCK_HEIGHT 16
+#define BLOCK_SIZE (BLOCK_WIDTH * BLOCK_HEIGHT)
+
+// Most predictors collectPredictors() can return
+#define MAX_PREDICTORS 4
+
+// Default largest offset searched in each direction
+#define SEARCH_RANGE 16
+
+// Largest range the command line accepts, the search scratch keeps a stamp for every offset
+#define SEARCH_RANGE_MAX 1024
+
+// Searches compare integer SADs, mad is only derived from the best one for reporting
+typedef struct {
+    int32_t x;
+    int32_t y;
+    double mad;
+} Point;
+
+typedef enum {
+    SEARCH_FULL,
+    SEARCH_THREE_STEP,
+    SEARCH_DIAMOND,
+    SEARCH_HEXAGON,
+    SEARCH_PREDICTIVE,
+    SEARCH_KIND_COUNT
+} SearchKind;
+
+typedef struct {
+    SearchKind kind;
+    int32_t range;
+    // Pyramid levels searched, 1 searches the full resolution image only
+    uint32_t levels;
+    // Vector units per pixel (a SubpelPrecision), 1 leaves vectors at whole pixels
+    uint32_t subpel;
+    // Kernels from selectSad() indexed by SadSize, pyramid level i uses sad[i]
+    SadFunction sad[SAD_SIZE_COUNT];
+    // With earlyExit set, full resolution candidates are summed by sadBounded, which gives up as soon
+    // as a candidate cannot beat the best match (partial distortion elimination), and full search
+    // visits its window in a spiral out of offset 0. Both leave the results unchanged.
+    int earlyExit;
+    SadBoundedFunction sadBounded;
+    // The full resolution search stops as soon as the best SAD drops below goodEnough, 0 disables it
+    uint32_t goodEnough;
+} SearchOptions;
+
+// Options at whole pixel precision with the kernels for every block size picked by selectSad() and
+// selectSadBounded(), without early exits
+SearchOptions makeSearchOptions(SearchKind kind, int32_t range, uint32_t levels, SadKernel kernel);
+
+// Work done by searches, summed over blocks
+typedef struct {
+    uint64_t evaluations;
+    // Candidate block rows summed, and rows partial distortion elimination left out
+    uint64_t rowsSummed;
+    uint64_t rowsSkipped;
+    // Searches stopped by the good enough threshold
+    uint64_t earlyStops;
+} SearchStats;
+
+void addSearchStats(SearchStats *total, const SearchStats *stats);
+
+// Per-thread memory of a search. Candidates are stamped with the number of the search that
+// evaluated them, so no offset is evaluated twice and nothing has to be cleared between blocks.
+typedef struct {
+    int32_t range;
+    uint32_t generation;
+    uint32_t *stamps;
+} SearchScratch;
+
+SearchScratch createSearchScratch(int32_t range);
+
+void freeSearchScratch(SearchScratch *scratch);
+
+const char *searchKindName(SearchKind kind);
+
+// Returns 0 and sets *kind when name is one of "full", "tss", "diamond", "hexagon" or "predictive".
+int parseSearchKind(const char *name, SearchKind *kind);
+
+uint32_t blockCountOf(const ImagePGM *img);
+
+// Finds the offset into previousImg that best matches block blockIndex of currentImg (blocks in
+// raster order). Only offsets within options->range that keep the block inside the image are
+// candidates; ties go to the candidate evaluated first. Predictive search starts from the given
+// predictors (usually the vectors of already processed neighbours), the other kinds ignore them.
+// The work done is added to *stats when it is not NULL.
+Point findMovementVector(const ImagePGM *currentImg, const ImagePGM *previousImg, uint32_t blockIndex,
+                         const SearchOptions *options, const Point *predictors, uint32_t predictorCount,
+                         SearchScratch *scratch, SearchStats *stats);
+
+// Coarse to fine version of findMovementVector() over pyramids of options->levels levels. The
+// search kind runs at the coarsest level with the range scaled down to it, then every finer
+// level doubles the vector and tries the 3x3 offsets around it. Predictors are scaled down to the
+// coarsest level. With one level this is exactly findMovementVector(). Early exits only apply to
+// the full resolution level.
+Point findMovementVectorPyramid(const Pyramid *current, const Pyramid *previous, uint32_t blockIndex,
+                                const SearchOptions *options, const Point *predictors, uint32_t predictorCount,
+                                SearchScratch *scratch, SearchStats *stats);
+
+// Vectors of the left, top and top-right neighbours of a block and their component-wise median,
+// taken from a field of already computed vectors in raster order. Returns how many were written.
+uint32_t collectPredictors(const Point *field, uint32_t xBlockCount, uint32_t blockIndex, Point *predictors);
+
+#endif
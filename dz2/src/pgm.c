@@ -0,0 +1,35 @@
+#include "pgm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ImagePGM imageOf(const NetpbmImage *source, const char *pgmFile) {
+    if (source->width > UINT16_MAX || source->height > UINT16_MAX) {
+        fprintf(stderr, "readPGMImage(): %s: %ux%u is too large!\n", pgmFile, source->width, source->height);
+        exit(EXIT_FAILURE);
+    }
+    ImagePGM image = {.width=(uint16_t) source->width, .height=(uint16_t) source->height,
+                      .maxVal=(uint16_t) source->maxValue, .stride=source->stride,
+                      .data=(const PixelGS8 *) source->pixels, .source=*source};
+    strcpy(image.type, source->type);
+    return image;
+}
+
+ImagePGM readPGMImage(const char *pgmFile) {
+    NetpbmImage source = openNetpbmImage(pgmFile, "P5");
+    return imageOf(&source, pgmFile);
+}
+
+int readPGMFrame(FILE *fptr, const char *name, ImagePGM *img) {
+    if (readNetpbmFrame(fptr, name, "P5", &img->source) == 0) {
+        return 0;
+    }
+    *img = imageOf(&img->source, name);
+    return 1;
+}
+
+void freePGMImage(ImagePGM *img) {
+    closeNetpbmImage(&img->source);
+    img->data = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef DZ2_PGM_H
+#define DZ2_PGM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "netpbm.h"
+
+typedef struct {
+    uint8_t val;
+} PixelGS8;
+
+// Pixels point into the mapped file, row r starts "stride" bytes after data
+typedef struct {
+    char type[3];
+    uint16_t width, height, maxVal;
+    size_t stride;
+    const PixelGS8 *data;
+    NetpbmImage source;
+} ImagePGM;
+
+ImagePGM readPGMImage(const char *pgmFile);
+
+// Reads the next frame of a stream of concatenated P5 images into img, reusing the pixel buffer
+// img->source owns from the previous call (img has to be zero-initialised before the first one).
+// Returns 1 when a frame was read, 0 at the end of the stream. freePGMImage() releases the buffer.
+int readPGMFrame(FILE *fptr, const char *name, ImagePGM *img);
+
+void freePGMImage(ImagePGM *img);
+
+static inline const PixelGS8 *pgmRow(const ImagePGM *img, uint32_t row) {
+    return img->data + row * img->stride;
+}
+
+#endif
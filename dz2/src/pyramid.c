@@ -0,0 +1,54 @@
+#include "pyramid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ImagePGM halveImage(const ImagePGM *img) {
+    uint16_t width = img->width / 2;
+    uint16_t height = img->height / 2;
+    size_t size = (size_t) width * height;
+    uint8_t *pixels = (uint8_t *) malloc(size > 0 ? size : 1);
+    if (pixels == NULL) {
+        perror("halveImage::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t *top = &pgmRow(img, 2 * y)->val;
+        const uint8_t *bottom = &pgmRow(img, 2 * y + 1)->val;
+        uint8_t *out = pixels + (size_t) y * width;
+        for (uint32_t x = 0; x < width; ++x) {
+            out[x] = (uint8_t) ((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+        }
+    }
+
+    // The level owns its pixels the way a loaded image owns an unmapped file
+    ImagePGM half = {.width=width, .height=height, .maxVal=img->maxVal, .stride=width,
+                     .data=(const PixelGS8 *) pixels};
+    strcpy(half.type, img->type);
+    half.source.data = pixels;
+    half.source.dataSize = size;
+    half.source.pixels = pixels;
+    half.source.mapped = 0;
+    return half;
+}
+
+Pyramid buildPyramid(const ImagePGM *img, uint32_t levelCount) {
+    if (levelCount < 1 || levelCount > PYRAMID_MAX_LEVELS) {
+        fprintf(stderr, "buildPyramid(): level count %u is not between 1 and %d!\n", levelCount, PYRAMID_MAX_LEVELS);
+        exit(EXIT_FAILURE);
+    }
+    Pyramid pyramid = {.levelCount=levelCount};
+    pyramid.levels[0] = *img;
+    for (uint32_t i = 1; i < levelCount; ++i) {
+        pyramid.levels[i] = halveImage(&pyramid.levels[i - 1]);
+    }
+    return pyramid;
+}
+
+void freePyramid(Pyramid *pyramid) {
+    for (uint32_t i = 1; i < pyramid->levelCount; ++i) {
+        freePGMImage(&pyramid->levels[i]);
+    }
+    pyramid->levelCount = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef DZ2_PYRAMID_H
+#define DZ2_PYRAMID_H
+
+#include <stdint.h>
+
+#include "pgm.h"
+
+// Level i searches blocks of BLOCK_WIDTH >> i pixels, down to 4x4 at the coarsest level
+#define PYRAMID_MAX_LEVELS 3
+
+// Level 0 is the image itself (not owned), every further level halves the previous one in both
+// directions by averaging 2x2 pixels. An odd last row or column is dropped.
+typedef struct {
+    uint32_t levelCount;
+    ImagePGM levels[PYRAMID_MAX_LEVELS];
+} Pyramid;
+
+// levelCount must be between 1 and PYRAMID_MAX_LEVELS; level 0 keeps pointing into img.
+Pyramid buildPyramid(const ImagePGM *img, uint32_t levelCount);
+
+void freePyramid(Pyramid *pyramid);
+
+#endif
@@ -0,0 +1,345 @@
+#include "sad.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAD_HAS_X86 1
+#include <immintrin.h>
+#else
+#define SAD_HAS_X86 0
+#endif
+
+static inline uint32_t sadScalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride, uint32_t dim) {
+    uint32_t sad = 0;
+    for (uint32_t i = 0; i < dim; ++i, a += aStride, b += bStride) {
+        for (uint32_t j = 0; j < dim; ++j) {
+            sad += (uint32_t) abs(a[j] - b[j]);
+        }
+    }
+    return sad;
+}
+
+static uint32_t sad16x16Scalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    return sadScalar(a, aStride, b, bStride, 16);
+}
+
+static uint32_t sad8x8Scalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    return sadScalar(a, aStride, b, bStride, 8);
+}
+
+static uint32_t sad4x4Scalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    return sadScalar(a, aStride, b, bStride, 4);
+}
+
+static uint32_t sad16x16BoundedScalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                                      uint32_t bound, uint32_t *rows) {
+    uint32_t sad = 0;
+    for (uint32_t i = 0; i < 16; ++i, a += aStride, b += bStride) {
+        for (uint32_t j = 0; j < 16; ++j) {
+            sad += (uint32_t) abs(a[j] - b[j]);
+        }
+        if (sad >= bound) {
+            *rows = i + 1;
+            return sad;
+        }
+    }
+    *rows = 16;
+    return sad;
+}
+
+#if SAD_HAS_X86
+
+// psadbw leaves two 16-bit partial sums in the low halves of the two quadwords
+__attribute__((target("sse2")))
+static inline uint32_t sumQuadwords(__m128i sums) {
+    return (uint32_t) (_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+}
+
+// Blocks may start anywhere, so every load is unaligned. Unaligned loads on aligned data are free.
+__attribute__((target("sse2")))
+static uint32_t sad16x16SSE2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    __m128i sums = _mm_setzero_si128();
+    for (uint32_t i = 0; i < 16; ++i, a += aStride, b += bStride) {
+        __m128i rowA = _mm_loadu_si128((const __m128i *) a);
+        __m128i rowB = _mm_loadu_si128((const __m128i *) b);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(rowA, rowB));
+    }
+    return sumQuadwords(sums);
+}
+
+// The bound is checked every four rows, reducing the sums more often costs more than it saves
+__attribute__((target("sse2")))
+static uint32_t sad16x16BoundedSSE2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                                    uint32_t bound, uint32_t *rows) {
+    __m128i sums = _mm_setzero_si128();
+    for (uint32_t i = 0; i < 16; i += 4) {
+        for (uint32_t r = 0; r < 4; ++r, a += aStride, b += bStride) {
+            __m128i rowA = _mm_loadu_si128((const __m128i *) a);
+            __m128i rowB = _mm_loadu_si128((const __m128i *) b);
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(rowA, rowB));
+        }
+        uint32_t sad = sumQuadwords(sums);
+        if (sad >= bound) {
+            *rows = i + 4;
+            return sad;
+        }
+    }
+    *rows = 16;
+    return sumQuadwords(sums);
+}
+
+// Two 8-pixel rows per register
+__attribute__((target("sse2")))
+static uint32_t sad8x8SSE2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    __m128i sums = _mm_setzero_si128();
+    for (uint32_t i = 0; i < 8; i += 2, a += 2 * aStride, b += 2 * bStride) {
+        __m128i rowsA = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) a),
+                                           _mm_loadl_epi64((const __m128i *) (a + aStride)));
+        __m128i rowsB = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) b),
+                                           _mm_loadl_epi64((const __m128i *) (b + bStride)));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(rowsA, rowsB));
+    }
+    return sumQuadwords(sums);
+}
+
+// The whole 4x4 block fits one register, a single psadbw
+__attribute__((target("sse2")))
+static uint32_t sad4x4SSE2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    int32_t rowsA[4], rowsB[4];
+    for (uint32_t i = 0; i < 4; ++i) {
+        memcpy(&rowsA[i], a + i * aStride, 4);
+        memcpy(&rowsB[i], b + i * bStride, 4);
+    }
+    __m128i blockA = _mm_setr_epi32(rowsA[0], rowsA[1], rowsA[2], rowsA[3]);
+    __m128i blockB = _mm_setr_epi32(rowsB[0], rowsB[1], rowsB[2], rowsB[3]);
+    return sumQuadwords(_mm_sad_epu8(blockA, blockB));
+}
+
+// Two 16-pixel rows per register
+__attribute__((target("avx2")))
+static uint32_t sad16x16AVX2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    __m256i sums = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < 16; i += 2, a += 2 * aStride, b += 2 * bStride) {
+        __m256i rowsA = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) a)),
+                                                _mm_loadu_si128((const __m128i *) (a + aStride)), 1);
+        __m256i rowsB = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) b)),
+                                                _mm_loadu_si128((const __m128i *) (b + bStride)), 1);
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(rowsA, rowsB));
+    }
+    __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return sumQuadwords(halves);
+}
+
+__attribute__((target("avx2")))
+static uint32_t sad16x16BoundedAVX2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                                    uint32_t bound, uint32_t *rows) {
+    __m256i sums = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < 16; i += 4) {
+        for (uint32_t r = 0; r < 4; r += 2, a += 2 * aStride, b += 2 * bStride) {
+            __m256i rowsA = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) a)),
+                                                    _mm_loadu_si128((const __m128i *) (a + aStride)), 1);
+            __m256i rowsB = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) b)),
+                                                    _mm_loadu_si128((const __m128i *) (b + bStride)), 1);
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(rowsA, rowsB));
+        }
+        uint32_t sad = sumQuadwords(_mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1)));
+        if (sad >= bound) {
+            *rows = i + 4;
+            return sad;
+        }
+    }
+    *rows = 16;
+    return sumQuadwords(_mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1)));
+}
+
+// Four 8-pixel rows per register
+__attribute__((target("avx2")))
+static uint32_t sad8x8AVX2(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride) {
+    __m256i sums = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < 8; i += 4, a += 4 * aStride, b += 4 * bStride) {
+        int64_t rowsA[4], rowsB[4];
+        for (uint32_t r = 0; r < 4; ++r) {
+            memcpy(&rowsA[r], a + r * aStride, 8);
+            memcpy(&rowsB[r], b + r * bStride, 8);
+        }
+        __m256i blockA = _mm256_setr_epi64x(rowsA[0], rowsA[1], rowsA[2], rowsA[3]);
+        __m256i blockB = _mm256_setr_epi64x(rowsB[0], rowsB[1], rowsB[2], rowsB[3]);
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(blockA, blockB));
+    }
+    __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return sumQuadwords(halves);
+}
+
+#endif
+
+uint32_t sadBlockDim(SadSize size) {
+    switch (size) {
+        case SAD_8X8:
+            return 8;
+        case SAD_4X4:
+            return 4;
+        case SAD_16X16:
+        default:
+            return 16;
+    }
+}
+
+static SadFunction scalarSad(SadSize size) {
+    switch (size) {
+        case SAD_8X8:
+            return sad8x8Scalar;
+        case SAD_4X4:
+            return sad4x4Scalar;
+        case SAD_16X16:
+        default:
+            return sad16x16Scalar;
+    }
+}
+
+#if SAD_HAS_X86
+
+static SadFunction sse2Sad(SadSize size) {
+    switch (size) {
+        case SAD_8X8:
+            return sad8x8SSE2;
+        case SAD_4X4:
+            return sad4x4SSE2;
+        case SAD_16X16:
+        default:
+            return sad16x16SSE2;
+    }
+}
+
+// A 4x4 block already is a single SSE2 instruction, AVX2 has nothing to add there
+static SadFunction avx2Sad(SadSize size) {
+    switch (size) {
+        case SAD_8X8:
+            return sad8x8AVX2;
+        case SAD_4X4:
+            return sad4x4SSE2;
+        case SAD_16X16:
+        default:
+            return sad16x16AVX2;
+    }
+}
+
+#endif
+
+SadFunction selectSad(SadKernel kernel, SadSize size) {
+#if SAD_HAS_X86
+    __builtin_cpu_init();
+    int hasAVX2 = __builtin_cpu_supports("avx2");
+    int hasSSE2 = __builtin_cpu_supports("sse2");
+    switch (kernel) {
+        case SAD_AUTO:
+            return hasAVX2 ? avx2Sad(size) : hasSSE2 ? sse2Sad(size) : scalarSad(size);
+        case SAD_AVX2:
+            return hasAVX2 ? avx2Sad(size) : scalarSad(size);
+        case SAD_SSE2:
+            return hasSSE2 ? sse2Sad(size) : scalarSad(size);
+        case SAD_SCALAR:
+        default:
+            return scalarSad(size);
+    }
+#else
+    (void) kernel;
+    return scalarSad(size);
+#endif
+}
+
+SadBoundedFunction selectSadBounded(SadKernel kernel) {
+#if SAD_HAS_X86
+    __builtin_cpu_init();
+    int hasAVX2 = __builtin_cpu_supports("avx2");
+    int hasSSE2 = __builtin_cpu_supports("sse2");
+    switch (kernel) {
+        case SAD_AUTO:
+            return hasAVX2 ? sad16x16BoundedAVX2 : hasSSE2 ? sad16x16BoundedSSE2 : sad16x16BoundedScalar;
+        case SAD_AVX2:
+            return hasAVX2 ? sad16x16BoundedAVX2 : sad16x16BoundedScalar;
+        case SAD_SSE2:
+            return hasSSE2 ? sad16x16BoundedSSE2 : sad16x16BoundedScalar;
+        case SAD_SCALAR:
+        default:
+            return sad16x16BoundedScalar;
+    }
+#else
+    (void) kernel;
+    return sad16x16BoundedScalar;
+#endif
+}
+
+const char *sadKernelName(SadKernel kernel) {
+    switch (kernel) {
+        case SAD_SCALAR:
+            return "scalar";
+        case SAD_SSE2:
+            return "sse2";
+        case SAD_AVX2:
+            return "avx2";
+        case SAD_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+int parseSadKernel(const char *name, SadKernel *kernel) {
+    SadKernel kernels[] = {SAD_AUTO, SAD_SCALAR, SAD_SSE2, SAD_AVX2};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        if (strcmp(name, sadKernelName(kernels[i])) == 0) {
+            *kernel = kernels[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint64_t sadMismatchCount(SadKernel kernel) {
+    // Two 40x40 planes, blocks are taken at every alignment and with odd strides
+    enum {
+        PLANE_DIM = 40
+    };
+    uint8_t a[PLANE_DIM * PLANE_DIM], b[PLANE_DIM * PLANE_DIM];
+    uint32_t seed = 0x1B873593u;
+    uint64_t mismatches = 0;
+    for (uint32_t trial = 0; trial < 64; ++trial) {
+        for (size_t i = 0; i < sizeof(a); ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            a[i] = (uint8_t) (seed >> 24);
+            b[i] = (uint8_t) (seed >> 16);
+        }
+        // The largest possible differences
+        if (trial == 0) {
+            memset(a, 0, sizeof(a));
+            memset(b, 255, sizeof(b));
+        }
+        for (int s = 0; s < SAD_SIZE_COUNT; ++s) {
+            SadFunction expected = scalarSad((SadSize) s);
+            SadFunction actual = selectSad(kernel, (SadSize) s);
+            uint32_t dim = sadBlockDim((SadSize) s);
+            // The reference block starts one pixel further on and is the last to leave the plane
+            for (uint32_t offset = 0; offset < 2 * PLANE_DIM && offset + 1 + dim * PLANE_DIM <= sizeof(b);
+                 offset += 3) {
+                size_t stride = PLANE_DIM - trial % 2;
+                if (expected(a + offset, stride, b + offset + 1, PLANE_DIM) !=
+                    actual(a + offset, stride, b + offset + 1, PLANE_DIM)) {
+                    ++mismatches;
+                }
+            }
+        }
+
+        // Below the bound the result is exact, from the bound on it only has to reach it
+        SadBoundedFunction bounded = selectSadBounded(kernel);
+        uint32_t exact = sad16x16Scalar(a + trial, PLANE_DIM, b, PLANE_DIM);
+        uint32_t bounds[] = {0, 1, exact / 4, exact / 2, exact, exact + 1, UINT32_MAX};
+        for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i) {
+            uint32_t rows;
+            uint32_t sad = bounded(a + trial, PLANE_DIM, b, PLANE_DIM, bounds[i], &rows);
+            if (exact < bounds[i] ? sad != exact || rows != 16 : sad < bounds[i] || sad > exact || rows > 16) {
+                ++mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
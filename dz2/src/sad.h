@@ -0,0 +1,50 @@
+#ifndef DZ2_SAD_H
+#define DZ2_SAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sum of absolute differences between two square blocks of 8-bit samples, rows "stride" bytes apart.
+typedef uint32_t (*SadFunction)(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride);
+
+// 16x16 SAD that gives up once the partial sum reaches bound: returns the exact SAD when it is
+// below bound, otherwise some value >= bound. *rows receives the number of rows summed, kernels
+// check the bound every one to four rows.
+typedef uint32_t (*SadBoundedFunction)(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                                       uint32_t bound, uint32_t *rows);
+
+typedef enum {
+    SAD_16X16,
+    SAD_8X8,
+    SAD_4X4,
+    SAD_SIZE_COUNT
+} SadSize;
+
+typedef enum {
+    SAD_AUTO,
+    SAD_SCALAR,
+    SAD_SSE2,
+    SAD_AVX2
+} SadKernel;
+
+// Side of the blocks a SadSize covers.
+uint32_t sadBlockDim(SadSize size);
+
+// Returns the requested kernel for the block size, or for SAD_AUTO the fastest one the CPU
+// supports. Kernels the CPU (or compiler) does not support fall back to the scalar one.
+SadFunction selectSad(SadKernel kernel, SadSize size);
+
+// Bounded 16x16 kernel, selected like selectSad().
+SadBoundedFunction selectSadBounded(SadKernel kernel);
+
+const char *sadKernelName(SadKernel kernel);
+
+// Returns 0 and sets *kernel when name is one of "auto", "scalar", "sse2" or "avx2".
+int parseSadKernel(const char *name, SadKernel *kernel);
+
+// Runs the selected kernel and the scalar kernel of every block size on pseudo-random blocks
+// (including all-0 against all-255) and returns the number of results that differ. The bounded
+// kernel is checked against the scalar one for a range of bounds.
+uint64_t sadMismatchCount(SadKernel kernel);
+
+#endif
@@ -0,0 +1,227 @@
+#include "sequence.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+TRACE_COUNTER(readCounter, "sequence/read");
+TRACE_COUNTER(waitCounter, "sequence/wait");
+
+struct FrameSequence {
+    // Directory sources: the file names in order; otherwise a single stream
+    char *directory;
+    char **files;
+    uint32_t fileCount;
+    FILE *stream;
+    const char *streamName;
+
+    // Frame i lives in slot i % slotCount. The reader may fill a slot once the frame that used it
+    // before has been released.
+    ImagePGM *slots;
+    uint32_t slotCount;
+    uint64_t produced, consumed, released;
+    int finished, stopping;
+
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t frameReady;
+    pthread_cond_t slotFree;
+};
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static int hasPgmSuffix(const char *name) {
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".pgm") == 0;
+}
+
+static void listDirectory(FrameSequence *sequence, DIR *dir) {
+    uint32_t capacity = 64;
+    sequence->files = (char **) malloc(sizeof(char *) * capacity);
+    if (sequence->files == NULL) {
+        perror("listDirectory::malloc()");
+        exit(EXIT_FAILURE);
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!hasPgmSuffix(entry->d_name)) {
+            continue;
+        }
+        if (sequence->fileCount == capacity) {
+            capacity *= 2;
+            sequence->files = (char **) realloc(sequence->files, sizeof(char *) * capacity);
+            if (sequence->files == NULL) {
+                perror("listDirectory::realloc()");
+                exit(EXIT_FAILURE);
+            }
+        }
+        size_t length = strlen(sequence->directory) + strlen(entry->d_name) + 2;
+        char *path = (char *) malloc(length);
+        if (path == NULL) {
+            perror("listDirectory::malloc()");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(path, length, "%s/%s", sequence->directory, entry->d_name);
+        sequence->files[sequence->fileCount++] = path;
+    }
+    qsort(sequence->files, sequence->fileCount, sizeof(char *), compareNames);
+}
+
+// Decodes frame index into its slot. Returns 0 once the sequence has no more frames.
+static int readFrame(FrameSequence *sequence, uint64_t index, ImagePGM *slot) {
+    if (sequence->files == NULL) {
+        return readPGMFrame(sequence->stream, sequence->streamName, slot);
+    }
+    if (index >= sequence->fileCount) {
+        return 0;
+    }
+    const char *file = sequence->files[index];
+    FILE *fptr = fopen(file, "rb");
+    if (fptr == NULL) {
+        perror("readFrame::fopen()");
+        exit(EXIT_FAILURE);
+    }
+    if (readPGMFrame(fptr, file, slot) == 0) {
+        fprintf(stderr, "readFrame(): %s: no image in file!\n", file);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fptr);
+    return 1;
+}
+
+static void *readerMain(void *arg) {
+    FrameSequence *sequence = (FrameSequence *) arg;
+    for (;;) {
+        pthread_mutex_lock(&sequence->lock);
+        while (!sequence->stopping && sequence->produced - sequence->released == sequence->slotCount) {
+            pthread_cond_wait(&sequence->slotFree, &sequence->lock);
+        }
+        uint64_t index = sequence->produced;
+        int stopping = sequence->stopping;
+        pthread_mutex_unlock(&sequence->lock);
+        if (stopping) {
+            break;
+        }
+
+        // The slot is out of the consumer's hands, so it is filled without holding the lock
+        ImagePGM *slot = &sequence->slots[index % sequence->slotCount];
+        TRACE_BEGIN(start);
+        int read = readFrame(sequence, index, slot);
+        TRACE_END(readCounter, start, read ? (uint64_t) slot->width * slot->height : 0, 0);
+
+        pthread_mutex_lock(&sequence->lock);
+        if (read) {
+            ++sequence->produced;
+        } else {
+            sequence->finished = 1;
+        }
+        pthread_cond_signal(&sequence->frameReady);
+        pthread_mutex_unlock(&sequence->lock);
+        if (!read) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+FrameSequence *openFrameSequence(const char *source, uint32_t slotCount) {
+    FrameSequence *sequence = (FrameSequence *) calloc(1, sizeof(FrameSequence));
+    if (sequence == NULL) {
+        perror("openFrameSequence::calloc()");
+        exit(EXIT_FAILURE);
+    }
+    sequence->slotCount = slotCount < SEQUENCE_MIN_SLOTS ? SEQUENCE_MIN_SLOTS : slotCount;
+    sequence->slots = (ImagePGM *) calloc(sequence->slotCount, sizeof(ImagePGM));
+    if (sequence->slots == NULL) {
+        perror("openFrameSequence::calloc()");
+        exit(EXIT_FAILURE);
+    }
+
+    DIR *dir;
+    if (strcmp(source, "-") == 0) {
+        sequence->stream = stdin;
+        sequence->streamName = "stdin";
+    } else if ((dir = opendir(source)) != NULL) {
+        sequence->directory = strdup(source);
+        listDirectory(sequence, dir);
+        closedir(dir);
+    } else {
+        sequence->stream = fopen(source, "rb");
+        if (sequence->stream == NULL) {
+            perror("openFrameSequence::fopen()");
+            exit(EXIT_FAILURE);
+        }
+        sequence->streamName = source;
+    }
+
+    pthread_mutex_init(&sequence->lock, NULL);
+    pthread_cond_init(&sequence->frameReady, NULL);
+    pthread_cond_init(&sequence->slotFree, NULL);
+    if (pthread_create(&sequence->reader, NULL, readerMain, sequence) != 0) {
+        perror("openFrameSequence::pthread_create()");
+        exit(EXIT_FAILURE);
+    }
+    return sequence;
+}
+
+const ImagePGM *nextSequenceFrame(FrameSequence *sequence) {
+    pthread_mutex_lock(&sequence->lock);
+    if (sequence->consumed - sequence->released == sequence->slotCount - 1) {
+        pthread_mutex_unlock(&sequence->lock);
+        fprintf(stderr, "nextSequenceFrame(): %u frames are already held!\n", sequence->slotCount - 1);
+        exit(EXIT_FAILURE);
+    }
+    // Time the consumer spends waiting for the reader
+    TRACE_BEGIN(start);
+    while (sequence->consumed == sequence->produced && !sequence->finished) {
+        pthread_cond_wait(&sequence->frameReady, &sequence->lock);
+    }
+    TRACE_END(waitCounter, start, 0, 0);
+    const ImagePGM *frame = NULL;
+    if (sequence->consumed < sequence->produced) {
+        frame = &sequence->slots[sequence->consumed % sequence->slotCount];
+        ++sequence->consumed;
+    }
+    pthread_mutex_unlock(&sequence->lock);
+    return frame;
+}
+
+void releaseSequenceFrame(FrameSequence *sequence) {
+    pthread_mutex_lock(&sequence->lock);
+    if (sequence->released < sequence->consumed) {
+        ++sequence->released;
+        pthread_cond_signal(&sequence->slotFree);
+    }
+    pthread_mutex_unlock(&sequence->lock);
+}
+
+void closeFrameSequence(FrameSequence *sequence) {
+    pthread_mutex_lock(&sequence->lock);
+    sequence->stopping = 1;
+    pthread_cond_signal(&sequence->slotFree);
+    pthread_mutex_unlock(&sequence->lock);
+    pthread_join(sequence->reader, NULL);
+
+    pthread_cond_destroy(&sequence->slotFree);
+    pthread_cond_destroy(&sequence->frameReady);
+    pthread_mutex_destroy(&sequence->lock);
+    for (uint32_t i = 0; i < sequence->slotCount; ++i) {
+        freePGMImage(&sequence->slots[i]);
+    }
+    free(sequence->slots);
+    if (sequence->stream != NULL && sequence->stream != stdin) {
+        fclose(sequence->stream);
+    }
+    for (uint32_t i = 0; i < sequence->fileCount; ++i) {
+        free(sequence->files[i]);
+    }
+    free(sequence->files);
+    free(sequence->directory);
+    free(sequence);
+}
@@ -0,0 +1,30 @@
+#ifndef DZ2_SEQUENCE_H
+#define DZ2_SEQUENCE_H
+
+#include <stdint.h>
+
+#include "pgm.h"
+
+// Fewest slots a sequence works with: the previous frame, the current one and one being read
+#define SEQUENCE_MIN_SLOTS 3
+
+typedef struct FrameSequence FrameSequence;
+
+// Opens a sequence of P5 frames: every .pgm file of a directory in name order, a file of
+// concatenated images, or stdin for "-". A reader thread decodes frames into a fixed ring of
+// slotCount buffers ahead of the consumer, so reading the next frame overlaps with work on the
+// current one and memory stays bounded however long the sequence is.
+FrameSequence *openFrameSequence(const char *source, uint32_t slotCount);
+
+// Returns the next frame in order, or NULL at the end of the sequence. The frame stays valid until
+// it is released; at most slotCount - 1 frames can be held at once.
+const ImagePGM *nextSequenceFrame(FrameSequence *sequence);
+
+// Hands the oldest held frame's slot back to the reader. Frames are released in the order they
+// were returned.
+void releaseSequenceFrame(FrameSequence *sequence);
+
+// Stops the reader (even mid-sequence) and frees every slot.
+void closeFrameSequence(FrameSequence *sequence);
+
+#endif
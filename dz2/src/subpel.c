@@ -0,0 +1,137 @@
+#include "subpel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int parseSubpelPrecision(const char *name, SubpelPrecision *precision) {
+    if (strcmp(name, "int") == 0) {
+        *precision = SUBPEL_NONE;
+    } else if (strcmp(name, "half") == 0) {
+        *precision = SUBPEL_HALF;
+    } else if (strcmp(name, "quarter") == 0) {
+        *precision = SUBPEL_QUARTER;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+SubpelPlanes buildSubpelPlanes(const ImagePGM *img, SubpelPrecision precision) {
+    uint32_t units = (uint32_t) precision;
+    SubpelPlanes planes = {.units=units, .width=img->width, .height=img->height, .stride=img->width};
+    size_t planeSize = (size_t) img->width * img->height;
+    uint32_t lastX = img->width > 0 ? img->width - 1u : 0;
+    uint32_t lastY = img->height > 0 ? img->height - 1u : 0;
+    for (uint32_t fy = 0; fy < units; ++fy) {
+        for (uint32_t fx = 0; fx < units; ++fx) {
+            uint8_t *plane = (uint8_t *) malloc(planeSize > 0 ? planeSize : 1);
+            if (plane == NULL) {
+                perror("buildSubpelPlanes::malloc()");
+                exit(EXIT_FAILURE);
+            }
+            planes.planes[fy * units + fx] = plane;
+
+            // Weights of the four surrounding pixels, in 1 / units^2
+            uint32_t w00 = (units - fx) * (units - fy), w01 = fx * (units - fy);
+            uint32_t w10 = (units - fx) * fy, w11 = fx * fy;
+            uint32_t half = units * units / 2;
+            for (uint32_t y = 0; y < img->height; ++y) {
+                const uint8_t *top = &pgmRow(img, y)->val;
+                const uint8_t *bottom = &pgmRow(img, y < lastY ? y + 1 : lastY)->val;
+                uint8_t *out = plane + (size_t) y * planes.stride;
+                for (uint32_t x = 0; x < img->width; ++x) {
+                    uint32_t right = x < lastX ? x + 1 : lastX;
+                    uint32_t sum = w00 * top[x] + w01 * top[right] + w10 * bottom[x] + w11 * bottom[right];
+                    out[x] = (uint8_t) ((sum + half) / (units * units));
+                }
+            }
+        }
+    }
+    return planes;
+}
+
+void freeSubpelPlanes(SubpelPlanes *planes) {
+    for (uint32_t i = 0; i < SUBPEL_MAX_PHASES; ++i) {
+        free(planes->planes[i]);
+        planes->planes[i] = NULL;
+    }
+    planes->units = 0;
+}
+
+// One block being refined, positions are in fractional units
+typedef struct {
+    const SubpelPlanes *reference;
+    const uint8_t *block;
+    size_t blockStride;
+    SadFunction sad;
+    SadBoundedFunction sadBounded;
+    int32_t originX, originY;
+    int32_t limit, maxX, maxY;
+    int32_t bestX, bestY;
+    uint32_t bestSad;
+    SearchStats stats;
+} SubpelSearch;
+
+static void trySubpelOffset(SubpelSearch *search, int32_t x, int32_t y) {
+    int32_t positionX = search->originX + x;
+    int32_t positionY = search->originY + y;
+    if (x < -search->limit || x > search->limit || y < -search->limit || y > search->limit ||
+        positionX < 0 || positionX > search->maxX || positionY < 0 || positionY > search->maxY) {
+        return;
+    }
+    const SubpelPlanes *reference = search->reference;
+    uint32_t units = reference->units;
+    const uint8_t *plane = reference->planes[(uint32_t) positionY % units * units + (uint32_t) positionX % units];
+    const uint8_t *candidate = plane + (size_t) ((uint32_t) positionY / units) * reference->stride +
+                               (uint32_t) positionX / units;
+    ++search->stats.evaluations;
+    uint32_t sad;
+    uint32_t rows = BLOCK_HEIGHT;
+    if (search->sadBounded != NULL) {
+        sad = search->sadBounded(search->block, search->blockStride, candidate, reference->stride, search->bestSad,
+                                 &rows);
+    } else {
+        sad = search->sad(search->block, search->blockStride, candidate, reference->stride);
+    }
+    search->stats.rowsSummed += rows;
+    search->stats.rowsSkipped += BLOCK_HEIGHT - rows;
+    if (sad < search->bestSad) {
+        search->bestX = x;
+        search->bestY = y;
+        search->bestSad = sad;
+    }
+}
+
+Point refineSubpel(const ImagePGM *currentImg, const SubpelPlanes *reference, uint32_t blockIndex, Point vector,
+                   int32_t range, SadFunction sad, SadBoundedFunction sadBounded, SearchStats *stats) {
+    int32_t units = (int32_t) reference->units;
+    uint32_t xBlockCount = currentImg->width / BLOCK_WIDTH;
+    uint32_t originX = blockIndex % xBlockCount * BLOCK_WIDTH;
+    uint32_t originY = blockIndex / xBlockCount * BLOCK_HEIGHT;
+    SubpelSearch search = {
+            .reference=reference, .block=&pgmRow(currentImg, originY)[originX].val,
+            .blockStride=currentImg->stride, .sad=sad, .sadBounded=sadBounded,
+            .originX=(int32_t) originX * units, .originY=(int32_t) originY * units, .limit=range * units,
+            .maxX=(reference->width - BLOCK_WIDTH) * units, .maxY=(reference->height - BLOCK_HEIGHT) * units,
+            .bestX=vector.x * units, .bestY=vector.y * units, .bestSad=UINT32_MAX, .stats={0}};
+
+    trySubpelOffset(&search, search.bestX, search.bestY);
+    for (int32_t step = units / 2; step >= 1; step /= 2) {
+        int32_t centerX = search.bestX;
+        int32_t centerY = search.bestY;
+        for (int32_t dy = -step; dy <= step; dy += step) {
+            for (int32_t dx = -step; dx <= step; dx += step) {
+                if (dx != 0 || dy != 0) {
+                    trySubpelOffset(&search, centerX + dx, centerY + dy);
+                }
+            }
+        }
+    }
+
+    if (stats != NULL) {
+        addSearchStats(stats, &search.stats);
+    }
+    Point refined = {.x=search.bestX, .y=search.bestY, .mad=(double) search.bestSad / BLOCK_SIZE};
+    return refined;
+}
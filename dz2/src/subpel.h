@@ -0,0 +1,43 @@
+#ifndef DZ2_SUBPEL_H
+#define DZ2_SUBPEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "motion.h"
+#include "pgm.h"
+
+// Vector units per pixel
+typedef enum {
+    SUBPEL_NONE = 1,
+    SUBPEL_HALF = 2,
+    SUBPEL_QUARTER = 4
+} SubpelPrecision;
+
+#define SUBPEL_MAX_PHASES (SUBPEL_QUARTER * SUBPEL_QUARTER)
+
+// The reference image sampled at every fractional phase, so a fractional candidate costs one SAD
+// like an integer one. planes[fy * units + fx] holds the samples at (x + fx / units, y + fy / units),
+// bilinearly interpolated; samples past the last row or column repeat the edge.
+typedef struct {
+    uint32_t units;
+    uint16_t width, height;
+    size_t stride;
+    uint8_t *planes[SUBPEL_MAX_PHASES];
+} SubpelPlanes;
+
+// Returns 0 and sets *precision when name is "int", "half" or "quarter".
+int parseSubpelPrecision(const char *name, SubpelPrecision *precision);
+
+SubpelPlanes buildSubpelPlanes(const ImagePGM *img, SubpelPrecision precision);
+
+void freeSubpelPlanes(SubpelPlanes *planes);
+
+// Refines an integer vector of block blockIndex: the 8 neighbours at half a pixel, then (for
+// quarter precision) at a quarter pixel around the best so far. Candidates stay within range pixels
+// and inside the image. Candidates are summed by sadBounded unless it is NULL. Returns the vector in
+// units of reference->units and its mad; the work done is added to *stats when it is not NULL.
+Point refineSubpel(const ImagePGM *currentImg, const SubpelPlanes *reference, uint32_t blockIndex, Point vector,
+                   int32_t range, SadFunction sad, SadBoundedFunction sadBounded, SearchStats *stats);
+
+#endif
@@ -123,25 +123,32 @@ PPMImageRGB parsePPMImageRGB(const char* const file) {
 	return (PPMImageRGB) { .type = magicNumber, .width = width, .height = height, .maxValue = maxValue, .pixels = pixels };
 }
 
-PixelRGB* retrieveRGBBlock(
+void retrieveRGBBlockInto(
 	const PPMImageRGB* const imageRGB,
 	uint32_t const blockNumber,
 	uint32_t const xBlockCount,
-	uint32_t const yBlockCount) {
+	PixelRGB* const blockRGB) {
 	const PixelRGB* const pixels = imageRGB->pixels;
-	PixelRGB* const blockRGB = (PixelRGB*)malloc(sizeof(PixelRGB) * BLOCK_SIZE);
-	uint32_t const yOffset = blockNumber / yBlockCount * BLOCK_DIM * imageRGB->width;
+	uint32_t const yOffset = blockNumber / xBlockCount * BLOCK_DIM * imageRGB->width;
 	uint32_t const xOffset = blockNumber % xBlockCount * BLOCK_DIM;
 	for (size_t i = 0, y = yOffset, counter = 0; i < BLOCK_DIM; ++i, y += imageRGB->width) {
 		for (size_t j = 0, x = xOffset; j < BLOCK_DIM; ++j, ++x) {
 			blockRGB[counter++] = pixels[y + x];
 		}
 	}
+}
+
+PixelRGB* retrieveRGBBlock(
+	const PPMImageRGB* const imageRGB,
+	uint32_t const blockNumber,
+	uint32_t const xBlockCount,
+	uint32_t const yBlockCount) {
+	PixelRGB* const blockRGB = (PixelRGB*)malloc(sizeof(PixelRGB) * BLOCK_SIZE);
+	retrieveRGBBlockInto(imageRGB, blockNumber, xBlockCount, blockRGB);
 	return blockRGB;
 }
 
-PixelYCbCr* fromRGBToYCbCr(const PixelRGB* const blockRGB) {
-	PixelYCbCr* const blockYCbCr = (PixelYCbCr*)malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
+void fromRGBToYCbCrInto(const PixelRGB* const blockRGB, PixelYCbCr* const blockYCbCr) {
 	for (size_t i = 0; i < BLOCK_SIZE; ++i) {
 		PixelRGB const pixelRGB = blockRGB[i];
 		float const y = Y_R_CONST * pixelRGB.r + Y_G_CONST * pixelRGB.g + Y_B_CONST * pixelRGB.b;
@@ -149,6 +156,11 @@ PixelYCbCr* fromRGBToYCbCr(const PixelRGB* const blockRGB) {
 		float const cr = Cr_R_CONST * pixelRGB.r + Cr_G_CONST * pixelRGB.g + Cr_B_CONST * pixelRGB.b + Cr_ADD_CONST;
 		blockYCbCr[i] = (PixelYCbCr){ .y = y, .cb = cb, .cr = cr };
 	}
+}
+
+PixelYCbCr* fromRGBToYCbCr(const PixelRGB* const blockRGB) {
+	PixelYCbCr* const blockYCbCr = (PixelYCbCr*)malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
+	fromRGBToYCbCrInto(blockRGB, blockYCbCr);
 	return blockYCbCr;
 }
 
@@ -161,35 +173,54 @@ void shiftBlockYCbCr(PixelYCbCr* const blockYCbCr) {
 	}
 }
 
-PixelYCbCr* dctOnBlockYCbCr(PixelYCbCr* const blockYCbCr) {
-	float const cSqrt = 1 / (float)sqrt(2);
-	PixelYCbCr* const dctBlock = (PixelYCbCr*)malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
-	for (size_t u = 0; u < BLOCK_DIM; ++u) {
-		float const cu = u == 0 ? cSqrt : 1;
+// cosTable[u][i] = c(u) / 2 * cos((2i + 1) * u * PI / 16), precomputed so the transform can run
+// as separate row and column passes instead of evaluating cos() in the innermost loop.
+static float const cosTable[BLOCK_DIM][BLOCK_DIM] = {
+		{ 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f },
+		{ 0.490392640f, 0.415734806f, 0.277785117f, 0.097545161f, -0.097545161f, -0.277785117f, -0.415734806f, -0.490392640f },
+		{ 0.461939766f, 0.191341716f, -0.191341716f, -0.461939766f, -0.461939766f, -0.191341716f, 0.191341716f, 0.461939766f },
+		{ 0.415734806f, -0.097545161f, -0.490392640f, -0.277785117f, 0.277785117f, 0.490392640f, 0.097545161f, -0.415734806f },
+		{ 0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f, 0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f },
+		{ 0.277785117f, -0.490392640f, 0.097545161f, 0.415734806f, -0.415734806f, -0.097545161f, 0.490392640f, -0.277785117f },
+		{ 0.191341716f, -0.461939766f, 0.461939766f, -0.191341716f, -0.191341716f, 0.461939766f, -0.461939766f, 0.191341716f },
+		{ 0.097545161f, -0.277785117f, 0.415734806f, -0.490392640f, 0.490392640f, -0.415734806f, 0.277785117f, -0.097545161f }
+};
+
+void dctOnBlockYCbCrInto(const PixelYCbCr* const blockYCbCr, PixelYCbCr* const dctBlock) {
+	PixelYCbCr rows[BLOCK_SIZE];
+	for (size_t i = 0; i < BLOCK_DIM; ++i) {
 		for (size_t v = 0; v < BLOCK_DIM; ++v) {
-			float const cv = v == 0 ? cSqrt : 1;
+			float tmpY = 0, tmpCb = 0, tmpCr = 0;
+			for (size_t j = 0; j < BLOCK_DIM; ++j) {
+				PixelYCbCr const pixel = blockYCbCr[i * BLOCK_DIM + j];
+				tmpY += pixel.y * cosTable[v][j];
+				tmpCb += pixel.cb * cosTable[v][j];
+				tmpCr += pixel.cr * cosTable[v][j];
+			}
+			rows[i * BLOCK_DIM + v] = (PixelYCbCr){ .y = tmpY, .cb = tmpCb, .cr = tmpCr };
+		}
+	}
+	for (size_t v = 0; v < BLOCK_DIM; ++v) {
+		for (size_t u = 0; u < BLOCK_DIM; ++u) {
 			float tmpY = 0, tmpCb = 0, tmpCr = 0;
 			for (size_t i = 0; i < BLOCK_DIM; ++i) {
-				for (size_t j = 0; j < BLOCK_DIM; ++j) {
-					float const common = (float)(cos((2 * i + 1) * u * M_PI / 16) * cos((2 * j + 1) * v * M_PI / 16));
-					PixelYCbCr const block = blockYCbCr[i * BLOCK_DIM + j];
-					tmpY += block.y * common;
-					tmpCb += block.cb * common;
-					tmpCr += block.cr * common;
-				}
+				PixelYCbCr const pixel = rows[i * BLOCK_DIM + v];
+				tmpY += pixel.y * cosTable[u][i];
+				tmpCb += pixel.cb * cosTable[u][i];
+				tmpCr += pixel.cr * cosTable[u][i];
 			}
-			PixelYCbCr* const block = dctBlock + u * BLOCK_DIM + v;
-			block->y = 0.25f * cu * cv * tmpY;
-			block->cb = 0.25f * cu * cv * tmpCb;
-			block->cr = 0.25f * cu * cv * tmpCr;
+			dctBlock[u * BLOCK_DIM + v] = (PixelYCbCr){ .y = tmpY, .cb = tmpCb, .cr = tmpCr };
 		}
 	}
+}
+
+PixelYCbCr* dctOnBlockYCbCr(PixelYCbCr* const blockYCbCr) {
+	PixelYCbCr* const dctBlock = (PixelYCbCr*)malloc(sizeof(PixelYCbCr) * BLOCK_SIZE);
+	dctOnBlockYCbCrInto(blockYCbCr, dctBlock);
 	return dctBlock;
 }
 
-PixelYCbCrQuantized* quantizeBlock(const PixelYCbCr* const block) {
-	PixelYCbCrQuantized* const quantizedBlock = (PixelYCbCrQuantized*)
-		malloc(sizeof(PixelYCbCrQuantized) * BLOCK_SIZE);
+void quantizeBlockInto(const PixelYCbCr* const block, PixelYCbCrQuantized* const quantizedBlock) {
 	for (size_t i = 0; i < BLOCK_SIZE; ++i) {
 		PixelYCbCr const pixel = block[i];
 		quantizedBlock[i] = (PixelYCbCrQuantized){
@@ -197,6 +228,12 @@ PixelYCbCrQuantized* quantizeBlock(const PixelYCbCr* const block) {
 				.cb = (int8_t)round((double)pixel.cb / (double)k2Table[i]),
 				.cr = (int8_t)round((double)pixel.cr / (double)k2Table[i]) };
 	}
+}
+
+PixelYCbCrQuantized* quantizeBlock(const PixelYCbCr* const block) {
+	PixelYCbCrQuantized* const quantizedBlock = (PixelYCbCrQuantized*)
+		malloc(sizeof(PixelYCbCrQuantized) * BLOCK_SIZE);
+	quantizeBlockInto(block, quantizedBlock);
 	return quantizedBlock;
 }
 
@@ -215,16 +252,18 @@ int main(int32_t const argc, const char* const argv[]) {
 	uint32_t const xBlockCount = imageRGB.width / BLOCK_DIM;
 	uint32_t const yBlockCount = imageRGB.height / BLOCK_DIM;
 
+	// One set of block buffers reused for every block, nothing is allocated inside the loop
+	PixelRGB blockRGB[BLOCK_SIZE];
+	PixelYCbCr blockYCbCr[BLOCK_SIZE];
+	PixelYCbCr dctBlock[BLOCK_SIZE];
+	PixelYCbCrQuantized quantizedBlock[BLOCK_SIZE];
+
 	for (int i = 0; i < xBlockCount * yBlockCount; ++i) {
-		PixelRGB* const blockRGB = retrieveRGBBlock(&imageRGB, i, xBlockCount, yBlockCount);
-		PixelYCbCr* const blockYCbCr = fromRGBToYCbCr(blockRGB);
+		retrieveRGBBlockInto(&imageRGB, i, xBlockCount, blockRGB);
+		fromRGBToYCbCrInto(blockRGB, blockYCbCr);
 		shiftBlockYCbCr(blockYCbCr);
-		PixelYCbCr* const dctBlock = dctOnBlockYCbCr(blockYCbCr);
-		PixelYCbCrQuantized* const quantizedBlock = quantizeBlock(dctBlock);
-		free(blockRGB);
-		free(blockYCbCr);
-		free(dctBlock);
-		free(quantizedBlock);
+		dctOnBlockYCbCrInto(blockYCbCr, dctBlock);
+		quantizeBlockInto(dctBlock, quantizedBlock);
 	}
 
 	free(imageRGB.pixels);
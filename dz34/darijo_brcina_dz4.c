@@ -17,9 +17,13 @@ typedef struct {
 	Ipp8u* data;
 } PPMImage;
 
-Ipp8u blockRgb[BLOCK_DIM * 3];
-Ipp8u blockYCbCr[3][BLOCK_DIM];
-Ipp16s dctCoeffs[3][BLOCK_DIM];
+// Everything one block needs on its way through the pipeline. Each thread that encodes blocks owns
+// its own instance, so blocks can be processed in parallel.
+typedef struct {
+	Ipp8u blockRgb[BLOCK_DIM * 3];
+	Ipp8u blockYCbCr[3][BLOCK_DIM];
+	Ipp16s dctCoeffs[3][BLOCK_DIM];
+} BlockState;
 
 static const Ipp16u qLum[BLOCK_DIM] = {
 		16, 11, 10, 16, 24, 40, 51, 61,
@@ -109,45 +113,44 @@ void freePPMImage(PPMImage* img) {
 	ippiFree(img->data);
 }
 
-void getBlock(PPMImage* img, int blockNumber, int xBlockCount, int yBlockCount) {
+void getBlock(PPMImage* img, int blockNumber, int xBlockCount, BlockState* state) {
 	int xOffset, yOffset, x, y, counter;
-	xOffset = (blockNumber % xBlockCount) * BLOCK_WIDTH;
-	yOffset = (blockNumber / yBlockCount) * BLOCK_HEIGHT * img->width * 3;
+	xOffset = (blockNumber % xBlockCount) * BLOCK_WIDTH * 3;
+	yOffset = (blockNumber / xBlockCount) * BLOCK_HEIGHT * img->width * 3;
 	y = yOffset;
 	counter = 0;
 	for (size_t i = 0; i < BLOCK_HEIGHT; i++) {
 		x = xOffset;
 		for (size_t j = 0; j < BLOCK_WIDTH * 3; j++) {
-			blockRgb[counter++] = img->data[y + x];
+			state->blockRgb[counter++] = img->data[y + x];
 			x++;
 		}
 		y += img->width * 3;
 	}
 }
 
-void rgb2YCbCr() {
+void rgb2YCbCr(BlockState* state) {
 	Ipp8u* temp[3] = { 0 };
 	IppiSize roiSize = { 8, 8 };
 	IppStatus status;
-	temp[0] = blockYCbCr[0];
-	temp[1] = blockYCbCr[1];
-	temp[2] = blockYCbCr[2];
-	status = ippiRGBToYCbCr_8u_C3P3R(blockRgb, 24, temp, 8, roiSize);
+	temp[0] = state->blockYCbCr[0];
+	temp[1] = state->blockYCbCr[1];
+	temp[2] = state->blockYCbCr[2];
+	status = ippiRGBToYCbCr_8u_C3P3R(state->blockRgb, 24, temp, 8, roiSize);
 }
 
-void dct() {
-	IppiSize roiSize = { 8, 8 };
+void dct(BlockState* state) {
 	IppStatus status;
-	status = ippiDCT8x8FwdLS_8u16s_C1R(blockYCbCr[0], 8, dctCoeffs[0], -128);
-	status = ippiDCT8x8FwdLS_8u16s_C1R(blockYCbCr[1], 8, dctCoeffs[1], -128);
-	status = ippiDCT8x8FwdLS_8u16s_C1R(blockYCbCr[2], 8, dctCoeffs[2], -128);
+	status = ippiDCT8x8FwdLS_8u16s_C1R(state->blockYCbCr[0], 8, state->dctCoeffs[0], -128);
+	status = ippiDCT8x8FwdLS_8u16s_C1R(state->blockYCbCr[1], 8, state->dctCoeffs[1], -128);
+	status = ippiDCT8x8FwdLS_8u16s_C1R(state->blockYCbCr[2], 8, state->dctCoeffs[2], -128);
 }
 
-void quantize() {
+void quantize(BlockState* state) {
 	for (size_t i = 0; i < 3; i++) {
 		for (size_t j = 0; j < BLOCK_DIM; j++) {
 			Ipp16s coef = i == 0 ? qLum[j] : qChrom[j];
-			dctCoeffs[i][j] /= coef;
+			state->dctCoeffs[i][j] /= coef;
 		}
 	}
 }
@@ -162,6 +165,7 @@ int main(int argc, char** argv) {
 	double timeInSeconds;
 	char* ppmFile;
 	PPMImage img;
+	BlockState state;
 	int xBlockCount, yBlockCount, nBlocks;
 
 	startTime = clock();
@@ -173,10 +177,10 @@ int main(int argc, char** argv) {
 	nBlocks = xBlockCount * yBlockCount;
 
 	for (int i = 0; i < nBlocks; i++) {
-		getBlock(&img, i, xBlockCount, yBlockCount);
-		rgb2YCbCr();
-		dct();
-		quantize();
+		getBlock(&img, i, xBlockCount, &state);
+		rgb2YCbCr(&state);
+		dct(&state);
+		quantize(&state);
 	}
 
 	freePPMImage(&img);